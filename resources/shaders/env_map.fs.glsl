@@ -6,12 +6,18 @@ layout(location = 0) in VS_OUT {
     vec3 local_pos;
 } fs_in;
 
-uniform samplerCube env_map;
+layout(binding = 0) uniform samplerCube env_map;
+// faded out from while switching environments
+layout(binding = 1) uniform samplerCube prev_env_map;
 uniform float lod = 1.2;
+uniform float blend = 1.0;
 
 void main() {
     // vec3 env_color = texture(env_map, fs_in.local_pos).rgb;
     vec3 env_color = textureLod(env_map, fs_in.local_pos, lod).rgb;
+    if (blend < 1.0) {
+        env_color = mix(textureLod(prev_env_map, fs_in.local_pos, lod).rgb, env_color, blend);
+    }
 
     o_color = vec4(env_color, 1.0);
 }
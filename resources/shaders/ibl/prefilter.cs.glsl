@@ -0,0 +1,124 @@
+#version 460 core
+// https://learnopengl.com/PBR/IBL/Specular-IBL
+// http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
+// https://developer.nvidia.com/gpugems/gpugems3/part-iii-rendering/chapter-20-gpu-based-importance-sampling
+// Prefilters one mip of the specular map, faces from first_face in one dispatch (z is the face).
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(binding = 0) uniform samplerCube env_map;
+layout(binding = 0, rgba16f) uniform writeonly imageCube prefilter_level;
+
+uniform float roughness;
+uniform int sample_count;
+// base level size of env_map
+uniform float env_resolution;
+uniform int first_face = 0;
+
+const float PI = 3.14159265359;
+
+float RadicalInverse_VdC(uint bits);
+vec2 Hammersley(uint i, uint N);
+vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness);
+float DistributionGGX(float NdotH, float roughness);
+
+// direction through texel uv in [-1,1] of a face, in GL cube map face order
+vec3 CubeDirection(uint face, vec2 uv) {
+    switch (face) {
+        case 0u: return vec3(1.0, -uv.y, -uv.x);
+        case 1u: return vec3(-1.0, -uv.y, uv.x);
+        case 2u: return vec3(uv.x, 1.0, uv.y);
+        case 3u: return vec3(uv.x, -1.0, -uv.y);
+        case 4u: return vec3(uv.x, -uv.y, 1.0);
+        default: return vec3(-uv.x, -uv.y, -1.0);
+    }
+}
+
+void main() {
+    ivec2 size = imageSize(prefilter_level);
+    uint face = uint(first_face) + gl_GlobalInvocationID.z;
+    ivec3 texel = ivec3(ivec2(gl_GlobalInvocationID.xy), face);
+    if (any(greaterThanEqual(texel.xy, size))) {
+        return;
+    }
+    vec2 uv = (vec2(texel.xy) + 0.5) / vec2(size) * 2.0 - 1.0;
+    vec3 N = normalize(CubeDirection(face, uv));
+    vec3 R = N;
+    vec3 V = R;
+
+    // a mirror lobe is the environment filtered down to this level's resolution
+    if (roughness == 0.0) {
+        float lod = log2(env_resolution / float(size.x));
+        imageStore(prefilter_level, texel, vec4(textureLod(env_map, N, lod).rgb, 1.0));
+        return;
+    }
+
+    // solid angle of a base level texel of env_map
+    float sa_texel = 4.0 * PI / (6.0 * env_resolution * env_resolution);
+    uint num_samples = uint(sample_count);
+    float total_weight = 0.0;
+    vec3 prefiltered_color = vec3(0.0);
+    for (uint i = 0u; i < num_samples; ++i) {
+        vec2 Xi = Hammersley(i, num_samples);
+        vec3 H = ImportanceSampleGGX(Xi, N, roughness);
+        vec3 L = normalize(2.0 * dot(V, H) * H - V);
+
+        float NdotL = max(dot(N, L), 0.0);
+        if (NdotL > 0.0) {
+            // sample the mip whose texels cover the sample's share of the lobe, so few samples
+            // integrate it without aliasing. One level of bias trades a little blur for noise.
+            float NdotH = max(dot(N, H), 0.0);
+            float HdotV = max(dot(H, V), 0.0);
+            float pdf = DistributionGGX(NdotH, roughness) * NdotH / (4.0 * HdotV) + 0.0001;
+            float sa_sample = 1.0 / (float(num_samples) * pdf + 0.0001);
+            float mip_level = 0.5 * log2(sa_sample / sa_texel) + 1.0;
+
+            prefiltered_color += textureLod(env_map, L, mip_level).rgb * NdotL;
+            total_weight += NdotL;
+        }
+    }
+    imageStore(prefilter_level, texel, vec4(prefiltered_color / total_weight, 1.0));
+}
+
+float DistributionGGX(float NdotH, float roughness) {
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float NdotH2 = NdotH * NdotH;
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    return a2 / (PI * denom * denom);
+}
+
+float RadicalInverse_VdC(uint bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10; // / 0x100000000
+}
+
+vec2 Hammersley(uint i, uint N) {
+    return vec2(float(i) / float(N), RadicalInverse_VdC(i));
+}
+
+vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness) {
+    float a = roughness * roughness;
+
+    float phi = 2.0 * PI * Xi.x;
+    float cos_theta = sqrt((1.0 - Xi.y) / (1.0 + (a * a - 1.0) * Xi.y));
+    float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+
+    // from spherical coordinates to cartesian coordinates
+    vec3 H;
+    H.x = cos(phi) * sin_theta;
+    H.y = sin(phi) * sin_theta;
+    H.z = cos_theta;
+
+    // from tangent-space vector to world-space sample vector
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+
+    vec3 sample_vec = tangent * H.x + bitangent * H.y + N * H.z;
+    return normalize(sample_vec);
+}
@@ -0,0 +1,22 @@
+#version 460 core
+// Position only depth pass of static draws, see Renderer::DrawStaticDepth.
+
+layout(location = 0) in vec3 a_position;
+
+struct UniformData {
+    mat4 model;
+    mat4 normal_matrix;
+    uint material_index;
+    uint reflection_probes;
+};
+
+layout(std430, binding = 0) readonly buffer Uniforms {
+    UniformData uniforms[];
+};
+
+uniform mat4 u_light_vp;
+
+void main() {
+    mat4 model = uniforms[gl_InstanceID + gl_BaseInstance].model;
+    gl_Position = u_light_vp * model * vec4(a_position, 1.0);
+}
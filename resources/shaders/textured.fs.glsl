@@ -1,6 +1,12 @@
 #version 460 core
+#ifdef TEXTURE_ARRAYS
+// no bindless support: handles hold (array index + 1, layer) as (y, x), see TextureArrays
+#define TEXTURE_HANDLE uvec2
+#else
 #extension GL_ARB_bindless_texture : enable
 #extension GL_NV_gpu_shader5 : enable
+#define TEXTURE_HANDLE uint64_t
+#endif
 
 layout(location = 0) in VS_OUT {
     mat3 TBN;
@@ -8,6 +14,7 @@ layout(location = 0) in VS_OUT {
     vec3 normal;
     vec2 tex_coords;
     flat uint material_idx;
+    flat uint reflection_probes;
 } fs_in;
 
 out vec4 o_color;
@@ -17,6 +24,9 @@ layout(std140, binding = 0) uniform UBOUniforms {
     mat4 view_matrix;
     mat4 proj_matrix;
     vec3 view_pos;
+    vec2 viewport_size;
+    // scale and bias of log(view depth) to the cluster depth slice
+    vec2 cluster_depth_params;
 };
 
 #define MATERIAL_FLAG_NONE 0 << 0
@@ -24,18 +34,16 @@ layout(std140, binding = 0) uniform UBOUniforms {
 #define MATERIAL_FLAG_OCCLUSION_ROUGHNESS_METALLIC 1 << 1
 #define MATERIAL_FLAG_ALPHA_MODE_MASK 1 << 2
 
-#define MAX_LIGHTS 100
-
 struct Material {
     vec4 base_color;
     vec4 emissive_factor;
     vec2 uv_scale;
     vec2 uv_offset;
-    uint64_t base_color_handle;
-    uint64_t metallic_roughness_handle;
-    uint64_t occlusion_handle;
-    uint64_t normal_handle;
-    uint64_t emissive_handle;
+    TEXTURE_HANDLE base_color_handle;
+    TEXTURE_HANDLE metallic_roughness_handle;
+    TEXTURE_HANDLE occlusion_handle;
+    TEXTURE_HANDLE normal_handle;
+    TEXTURE_HANDLE emissive_handle;
     float metallic_factor;
     float roughness_factor;
     float emissive_strength;
@@ -50,24 +58,119 @@ layout(std430, binding = 1) readonly buffer Materials {
 
 struct PointLight {
     vec3 position;
-    float _pad1;
+    float radius;
     vec3 color;
     float intensity;
 };
 
-layout(binding = 1, std140) uniform PointLights {
-    PointLight pointLights[MAX_LIGHTS];
+layout(std430, binding = 4) readonly buffer PointLights {
+    PointLight point_lights[];
+};
+
+// must match LightClusters.hpp
+#define CLUSTER_TILES_X 16u
+#define CLUSTER_TILES_Y 9u
+#define CLUSTER_DEPTH_SLICES 24u
+// (offset, count) of each cluster's lights in light_indices
+layout(std430, binding = 5) readonly buffer LightGrid {
+    uvec2 light_grid[];
+};
+layout(std430, binding = 6) readonly buffer LightIndices {
+    uint light_indices[];
+};
+
+// finest UV footprint each material was sampled at, see TextureFeedback
+layout(std430, binding = 2) buffer TextureFeedback {
+    uint texture_feedback[];
 };
 
 uniform bool point_lights_enabled = true;
+uniform bool texture_feedback_enabled = false;
 uniform bool directional_light_enabled = true;
 uniform vec3 u_directional_dir;
 uniform vec3 u_directional_color;
 
-layout(binding = 0) uniform samplerCube irradiance_map;
+// diffuse irradiance / PI as SH9 coefficients, see SphericalHarmonics.hpp
+uniform vec3 u_irradiance_sh[9];
 layout(binding = 1) uniform samplerCube prefilter_map;
+// faded out from by 1 - u_environment_blend while switching environments
+layout(binding = 0) uniform samplerCube prev_prefilter_map;
+uniform float u_environment_blend = 1.0;
 layout(binding = 2) uniform sampler2D brdf_lookup;
+uniform bool u_analytic_env_brdf = false;
+// coefficients of EnvBRDFApprox fit to the LUT, see BrdfLut.hpp
+uniform vec4 u_env_brdf_c0;
+uniform vec4 u_env_brdf_c1;
+uniform vec2 u_env_brdf_scales;
 
+// must match ReflectionProbes.cpp and kNoReflectionProbe in Renderer.cpp
+#define NO_REFLECTION_PROBE 0xFFFFu
+struct ReflectionProbe {
+    vec4 position; // w: distance inside the box over which the probe fades out
+    vec4 box_min;
+    vec4 box_max;
+};
+
+layout(std430, binding = 3) readonly buffer ReflectionProbes {
+    ReflectionProbe reflection_probes[];
+};
+layout(binding = 13) uniform samplerCubeArray probe_map;
+uniform bool u_reflection_probes_enabled = false;
+
+// must match CascadedShadowMaps::kNumCascades
+#define NUM_SHADOW_CASCADES 4
+layout(binding = 14) uniform sampler2DArrayShadow shadow_map;
+uniform bool u_shadows_enabled = false;
+uniform mat4 u_cascade_vp[NUM_SHADOW_CASCADES];
+// world distance to offset the shaded position along the normal in each cascade
+uniform vec4 u_cascade_normal_offsets;
+
+// must match PointLightShadows.hpp
+#define MAX_SHADOWED_POINT_LIGHTS 16
+#define NO_POINT_SHADOW_SLOT 0xFFFFFFFFu
+// must match kNearPlane in PointLightShadows.cpp
+#define POINT_SHADOW_NEAR 0.05
+layout(binding = 15) uniform samplerCubeArrayShadow point_shadow_map;
+// atlas slot of each point light, by light index
+layout(std430, binding = 7) readonly buffer PointShadowSlots {
+    uint point_shadow_slots[];
+};
+uniform bool u_point_shadows_enabled = false;
+// xyz: position the slot was rendered from, w: its far plane, 0 while the slot isn't rendered
+uniform vec4 u_point_shadow_params[MAX_SHADOWED_POINT_LIGHTS];
+// normal offset per unit of distance to the light
+uniform float u_point_shadow_normal_bias;
+
+#ifdef TEXTURE_ARRAYS
+// must match TextureArrays::kMaxArrays
+#define MAX_TEXTURE_ARRAYS 10
+layout(binding = 3) uniform sampler2DArray texture_arrays[MAX_TEXTURE_ARRAYS];
+
+bool HasTexture(uvec2 handle) {
+    return handle.y != 0u;
+}
+
+// the material is the same for every invocation of a draw, so the index is dynamically uniform
+vec4 SampleTexture(uvec2 handle, vec2 uv) {
+    return texture(texture_arrays[handle.y - 1u], vec3(uv, float(handle.x)));
+}
+#else
+bool HasTexture(uint64_t handle) {
+    return handle != 0;
+}
+
+vec4 SampleTexture(uint64_t handle, vec2 uv) {
+    return texture(sampler2D(handle), uv);
+}
+#endif
+
+void RecordTextureFeedback(vec2 uv, uint material_idx);
+vec3 IrradianceSH(vec3 n);
+uint LightCluster();
+vec3 SampleReflectionProbes(vec3 global_color, vec3 R, float lod);
+float DirectionalShadow(vec3 geom_normal, vec3 L);
+float PointShadow(uint light_idx, vec3 geom_normal);
+vec2 EnvBRDFApprox(float NdotV, float roughness);
 vec3 FresnelSchlick(float cosTheta, vec3 F0);
 vec3 FresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness);
 float DistributionGGX(vec3 normal, vec3 halfVector, float roughness);
@@ -86,36 +189,40 @@ vec2 CalculateUV(Material mat, vec2 uv) {
 void main() {
     Material mat = materials[fs_in.material_idx];
     vec2 uv = CalculateUV(mat, fs_in.tex_coords);
+    if (texture_feedback_enabled) {
+        // before any discard, derivatives need the whole quad
+        RecordTextureFeedback(uv, fs_in.material_idx);
+    }
     vec4 base_color = mat.base_color;
     float roughness = mat.roughness_factor;
     float metallic = mat.metallic_factor;
     float ao = 1.0;
     vec3 normal;
 
-    if (mat.base_color_handle != 0) {
-        base_color = texture(sampler2D(mat.base_color_handle), uv);
+    if (HasTexture(mat.base_color_handle)) {
+        base_color = SampleTexture(mat.base_color_handle, uv);
         if ((mat.material_flags & MATERIAL_FLAG_ALPHA_MODE_MASK) != 0 && base_color.a < mat.alpha_cutoff) {
             discard;
         }
     }
-    if (mat.metallic_roughness_handle != 0 && (mat.material_flags & MATERIAL_FLAG_METALLIC_ROUGHNESS) != 0) {
-        vec4 metallic_roughness_tex = texture(sampler2D(mat.metallic_roughness_handle), uv);
+    if (HasTexture(mat.metallic_roughness_handle) && (mat.material_flags & MATERIAL_FLAG_METALLIC_ROUGHNESS) != 0) {
+        vec4 metallic_roughness_tex = SampleTexture(mat.metallic_roughness_handle, uv);
         roughness = metallic_roughness_tex.g;
         metallic = metallic_roughness_tex.b;
-    } else if (mat.metallic_roughness_handle != 0
+    } else if (HasTexture(mat.metallic_roughness_handle)
             && (mat.material_flags & MATERIAL_FLAG_OCCLUSION_ROUGHNESS_METALLIC) != 0) {
-        vec4 occ_rough_metallic_tex = texture(sampler2D(mat.metallic_roughness_handle), uv);
+        vec4 occ_rough_metallic_tex = SampleTexture(mat.metallic_roughness_handle, uv);
         ao = occ_rough_metallic_tex.r;
         roughness = occ_rough_metallic_tex.g;
         metallic = occ_rough_metallic_tex.b;
     }
-    if (mat.occlusion_handle != 0) {
-        ao = texture(sampler2D(mat.occlusion_handle), uv).r;
+    if (HasTexture(mat.occlusion_handle)) {
+        ao = SampleTexture(mat.occlusion_handle, uv).r;
     }
-    if (mat.normal_handle != 0) {
-        normal = texture(sampler2D(mat.normal_handle), uv).rgb;
-        // transform to [-1,1]
-        normal = normal * 2.0 - 1.0;
+    if (HasTexture(mat.normal_handle)) {
+        // normal maps only store XY, transform to [-1,1] and reconstruct Z on the unit hemisphere
+        vec2 normal_xy = SampleTexture(mat.normal_handle, uv).rg * 2.0 - 1.0;
+        normal = vec3(normal_xy, sqrt(max(1.0 - dot(normal_xy, normal_xy), 0.0)));
         // apply TBN matrix: tangent space -> world space
         normal = normalize(fs_in.TBN * normal);
     } else {
@@ -127,14 +234,22 @@ void main() {
     vec3 F0 = vec3(0.04);
     F0 = mix(F0, albedo.rgb, metallic);
 
+    // shadow lookups are offset along the surface rather than the normal map
+    vec3 geom_normal = normalize(fs_in.normal);
     vec3 light_out = vec3(0.0);
     if (point_lights_enabled) {
-        for (int i = 0; i < 1; i++) {
-            vec3 L = normalize(pointLights[i].position.xyz - fs_in.pos_world_space);
+        uvec2 cluster_lights = light_grid[LightCluster()];
+        for (uint i = 0u; i < cluster_lights.y; i++) {
+            uint light_idx = light_indices[cluster_lights.x + i];
+            PointLight light = point_lights[light_idx];
+            vec3 L = normalize(light.position - fs_in.pos_world_space);
             vec3 H = normalize(V + L);
-            float dist_to_light = length(pointLights[i].position.xyz - fs_in.pos_world_space);
-            float attenuation = 1.0 / (dist_to_light * dist_to_light);
-            vec3 radiance = pointLights[i].color * pointLights[i].intensity * attenuation;
+            float dist_to_light = length(light.position - fs_in.pos_world_space);
+            // windowed so the light fades to zero at its culling radius
+            float falloff = clamp(1.0 - pow(dist_to_light / light.radius, 4.0), 0.0, 1.0);
+            float attenuation = falloff * falloff / (dist_to_light * dist_to_light);
+            vec3 radiance = light.color * light.intensity * attenuation;
+            if (u_point_shadows_enabled) radiance *= PointShadow(light_idx, geom_normal);
             float NDF = DistributionGGX(normal, H, roughness);
             float G = GeometrySmith(normal, V, L, roughness);
             vec3 F = FresnelSchlick(clamp(dot(H, V), 0.0, 1.0), F0);
@@ -165,12 +280,13 @@ void main() {
         // scale light by NdotL
         float NdotL = max(dot(normal, L), 0.0);
         vec3 directional_out = ((kD * albedo.rgb / PI + specular) * radiance * NdotL);
+        if (u_shadows_enabled) directional_out *= DirectionalShadow(geom_normal, L);
         light_out += directional_out;
     }
 
     vec3 emissive;
-    if (mat.emissive_handle != 0) {
-        emissive = texture(sampler2D(mat.emissive_handle), uv).rgb * mat.emissive_strength;
+    if (HasTexture(mat.emissive_handle)) {
+        emissive = SampleTexture(mat.emissive_handle, uv).rgb * mat.emissive_strength;
     } else {
         emissive = mat.emissive_factor.rgb * mat.emissive_strength;
     }
@@ -179,14 +295,23 @@ void main() {
     vec3 R = reflect(-V, normal);
     const float MAX_REFLECTION_LOD = 5.0;
     vec3 prefiltered_color = textureLod(prefilter_map, R, roughness * MAX_REFLECTION_LOD).rgb;
+    if (u_environment_blend < 1.0) {
+        vec3 prev_color = textureLod(prev_prefilter_map, R, roughness * MAX_REFLECTION_LOD).rgb;
+        prefiltered_color = mix(prev_color, prefiltered_color, u_environment_blend);
+    }
+    if (u_reflection_probes_enabled && fs_in.reflection_probes != 0xFFFFFFFFu) {
+        prefiltered_color = SampleReflectionProbes(prefiltered_color, R,
+                roughness * MAX_REFLECTION_LOD);
+    }
     vec3 F = FresnelSchlickRoughness(max(dot(normal, V), 0.0), F0, roughness);
     vec3 kS = F;
-    vec2 env_brdf = texture(brdf_lookup, vec2(max(dot(normal, V), 0.0), roughness)).rg;
+    vec2 env_brdf = u_analytic_env_brdf ? EnvBRDFApprox(max(dot(normal, V), 0.0), roughness)
+            : texture(brdf_lookup, vec2(max(dot(normal, V), 0.0), roughness)).rg;
     vec3 specular = prefiltered_color * (F * env_brdf.x + env_brdf.y);
 
     vec3 kD = 1.0 - kS;
     kD *= 1.0 - metallic;
-    vec3 irradiance = texture(irradiance_map, normal).rgb;
+    vec3 irradiance = IrradianceSH(normal);
     vec3 diffuse = irradiance * albedo;
     vec3 ambient = (kD * diffuse + specular) * ao;
 
@@ -196,6 +321,127 @@ void main() {
     o_color = vec4(color, base_color.a);
 }
 
+// must match LightClusters.cpp: screen tiles by exponential depth slices
+uint LightCluster() {
+    uvec2 tiles = uvec2(CLUSTER_TILES_X, CLUSTER_TILES_Y);
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / viewport_size * vec2(tiles)), tiles - 1u);
+    float depth = -(view_matrix * vec4(fs_in.pos_world_space, 1.0)).z;
+    float slice = log(max(depth, 1e-4)) * cluster_depth_params.x + cluster_depth_params.y;
+    uint z = uint(clamp(slice, 0.0, float(CLUSTER_DEPTH_SLICES - 1u)));
+    return (z * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+}
+
+// basis constants must match SphericalHarmonics.cpp
+vec3 IrradianceSH(vec3 n) {
+    vec3 result = u_irradiance_sh[0] * 0.282095
+            + u_irradiance_sh[1] * (0.488603 * n.y)
+            + u_irradiance_sh[2] * (0.488603 * n.z)
+            + u_irradiance_sh[3] * (0.488603 * n.x)
+            + u_irradiance_sh[4] * (1.092548 * n.x * n.y)
+            + u_irradiance_sh[5] * (1.092548 * n.y * n.z)
+            + u_irradiance_sh[6] * (0.315392 * (3.0 * n.z * n.z - 1.0))
+            + u_irradiance_sh[7] * (1.092548 * n.x * n.z)
+            + u_irradiance_sh[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+    // band limiting rings negative behind bright sources
+    return max(result, vec3(0.0));
+}
+
+// Uses the first cascade containing the position rather than picking by view depth, so views
+// other than the one the cascades were fitted to, like reflection probe captures, are shadowed
+// wherever any cascade covers them.
+float DirectionalShadow(vec3 geom_normal, vec3 L) {
+    // offset more where the surface is at a grazing angle to the light
+    float normal_scale = 1.0 - max(dot(geom_normal, L), 0.0);
+    for (int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+        vec3 pos = fs_in.pos_world_space + geom_normal * u_cascade_normal_offsets[i] * normal_scale;
+        vec4 light_clip = u_cascade_vp[i] * vec4(pos, 1.0);
+        vec3 coords = light_clip.xyz * 0.5 + 0.5;
+        if (any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0)))) continue;
+        // 3x3 taps of the hardware 2x2 PCF
+        vec2 texel = 1.0 / vec2(textureSize(shadow_map, 0).xy);
+        float lit = 0.0;
+        for (int y = -1; y <= 1; y++) {
+            for (int x = -1; x <= 1; x++) {
+                lit += texture(shadow_map, vec4(coords.xy + vec2(x, y) * texel, i, coords.z));
+            }
+        }
+        return lit / 9.0;
+    }
+    return 1.0;
+}
+
+float PointShadow(uint light_idx, vec3 geom_normal) {
+    uint slot = point_shadow_slots[light_idx];
+    if (slot == NO_POINT_SHADOW_SLOT) return 1.0;
+    vec4 params = u_point_shadow_params[slot];
+    if (params.w == 0.0) return 1.0;
+    vec3 to_light = params.xyz - fs_in.pos_world_space;
+    // texels widen with distance from the light, and the offset with them
+    float normal_scale = 1.0 - max(dot(geom_normal, normalize(to_light)), 0.0);
+    float offset = length(to_light) * u_point_shadow_normal_bias * normal_scale;
+    vec3 dir = fs_in.pos_world_space + geom_normal * offset - params.xyz;
+    // the face's perspective depth follows from the distance along its axis
+    float z = max(abs(dir.x), max(abs(dir.y), abs(dir.z)));
+    float n = POINT_SHADOW_NEAR;
+    float f = params.w;
+    float ndc_depth = (f + n) / (f - n) - 2.0 * f * n / ((f - n) * z);
+    return texture(point_shadow_map, vec4(dir, float(slot)), ndc_depth * 0.5 + 0.5);
+}
+
+// Blends the up to two probes assigned to the draw, nearest first. Each probe's weight fades to
+// zero at its box edges, and whatever weight is left over goes to the global environment.
+vec3 SampleReflectionProbes(vec3 global_color, vec3 R, float lod) {
+    vec3 color = vec3(0.0);
+    float remaining = 1.0;
+    for (int i = 0; i < 2 && remaining > 0.0; i++) {
+        uint probe_idx = (fs_in.reflection_probes >> (16 * i)) & 0xFFFFu;
+        if (probe_idx == NO_REFLECTION_PROBE) {
+            break;
+        }
+        ReflectionProbe probe = reflection_probes[probe_idx];
+        vec3 pos = fs_in.pos_world_space;
+        vec3 to_edge = min(pos - probe.box_min.xyz, probe.box_max.xyz - pos);
+        float edge_dist = min(min(to_edge.x, to_edge.y), to_edge.z);
+        if (edge_dist <= 0.0) {
+            continue;
+        }
+        float weight = min(clamp(edge_dist / max(probe.position.w, 1e-4), 0.0, 1.0), remaining);
+        // parallax correction: intersect R with the box and look up the hit point from the probe
+        vec3 first_plane = (probe.box_max.xyz - pos) / R;
+        vec3 second_plane = (probe.box_min.xyz - pos) / R;
+        vec3 furthest = max(first_plane, second_plane);
+        float t = min(min(furthest.x, furthest.y), furthest.z);
+        vec3 box_R = pos + R * t - probe.position.xyz;
+        color += textureLod(probe_map, vec4(box_R, float(probe_idx)), lod).rgb * weight;
+        remaining -= weight;
+    }
+    return color + global_color * remaining;
+}
+
+// must match TextureFeedback.cpp
+const float FEEDBACK_FOOTPRINT_BIAS = 32.0;
+const float FEEDBACK_FOOTPRINT_SCALE = 16.0;
+
+// Every material texture is sampled with the same UVs, so one footprint per material gives the
+// mip level of each of its textures: log2(texture size) + footprint.
+void RecordTextureFeedback(vec2 uv, uint material_idx) {
+    vec2 dx = dFdx(uv);
+    vec2 dy = dFdy(uv);
+    // same isotropic footprint as the LOD calculation, in log2 UV units per pixel
+    float footprint = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-20));
+    // one pixel in 4x4 records to cut contention on the material's counter. The footprint varies
+    // smoothly over a surface, and primitives small enough to be missed only need low mips.
+    if (((uint(gl_FragCoord.x) | uint(gl_FragCoord.y)) & 3u) != 0u) {
+        return;
+    }
+    uint encoded = uint(clamp((footprint + FEEDBACK_FOOTPRINT_BIAS) * FEEDBACK_FOOTPRINT_SCALE,
+                0.0, 4294967040.0));
+    // skip the atomic when a finer footprint was already recorded
+    if (encoded < texture_feedback[material_idx]) {
+        atomicMin(texture_feedback[material_idx], encoded);
+    }
+}
+
 // F0: surface reflection at zero incidence - how much surface reflects if looking directly at the surface.
 // varies per material. tinted on metals. Common practice is to use 0.04 for dielectrics
 vec3 FresnelSchlick(float cosTheta, vec3 F0) {
@@ -205,6 +451,14 @@ vec3 FresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness) {
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
 }
 
+// Karis' analytic approximation of the BRDF LUT, the scale and bias of F0. Must match
+// brdf_lut::Analytic.
+vec2 EnvBRDFApprox(float NdotV, float roughness) {
+    vec4 r = roughness * u_env_brdf_c0 + u_env_brdf_c1;
+    float a004 = min(r.x * r.x, exp2(u_env_brdf_scales.x * NdotV)) * r.x + r.y;
+    return vec2(-u_env_brdf_scales.y, u_env_brdf_scales.y) * a004 + r.zw;
+}
+
 // D in the Cook-Torrance BRDF: normal Distribution function.
 // approximates the amount of the surface's microfacets that are aligned to the halfway vector, influenced by
 // surface roughness
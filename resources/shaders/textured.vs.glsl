@@ -11,12 +11,14 @@ layout(location = 0) out VS_OUT {
     vec3 normal;
     vec2 tex_coords;
     flat uint material_idx;
+    flat uint reflection_probes;
 } vs_out;
 
 struct UniformData {
     mat4 model;
     mat4 normal_matrix;
     uint material_index;
+    uint reflection_probes;
 };
 
 layout(std140, binding = 0) uniform UBOUniforms {
@@ -24,6 +26,9 @@ layout(std140, binding = 0) uniform UBOUniforms {
     mat4 view_matrix;
     mat4 proj_matrix;
     vec3 view_pos;
+    // unused here, but the block must match textured.fs.glsl
+    vec2 viewport_size;
+    vec2 cluster_depth_params;
 };
 
 layout(std430, binding = 0) readonly buffer Uniforms {
@@ -34,6 +39,7 @@ void main() {
     UniformData uniform_data = uniforms[gl_InstanceID + gl_BaseInstance];
     vs_out.tex_coords = a_tex_coords;
     vs_out.material_idx = uniform_data.material_index;
+    vs_out.reflection_probes = uniform_data.reflection_probes;
     vs_out.normal = mat3(uniform_data.normal_matrix) * normalize(a_normal);
     vec4 pos_world_space = uniform_data.model * vec4(a_position, 1.0);
     gl_Position = vp_matrix * pos_world_space;
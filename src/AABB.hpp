@@ -13,4 +13,20 @@ struct AABB {
     result |= other;
     return result;
   }
+
+  [[nodiscard]] bool Intersects(const AABB& other) const {
+    return glm::all(glm::lessThanEqual(min, other.max)) &&
+           glm::all(glm::lessThanEqual(other.min, max));
+  }
 };
+
+// Bounds of the box after transforming it by matrix.
+inline AABB TransformedAABB(const AABB& aabb, const glm::mat4& matrix) {
+  const glm::vec3 center = glm::vec3(matrix * glm::vec4((aabb.min + aabb.max) * 0.5f, 1.f));
+  const glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+  glm::vec3 transformed_extent{0.f};
+  for (int axis = 0; axis < 3; axis++) {
+    transformed_extent += glm::abs(glm::vec3(matrix[axis])) * extent[axis];
+  }
+  return {center - transformed_extent, center + transformed_extent};
+}
@@ -7,11 +7,15 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <random>
 
+#include "CascadedShadowMaps.hpp"
 #include "CubeMapConverter.hpp"
+#include "HdrImage.hpp"
 #include "Input.hpp"
 #include "MeshLoader.hpp"
 #include "Path.hpp"
 #include "Player.hpp"
+#include "PointLightShadows.hpp"
+#include "ReflectionProbes.hpp"
 #include "Renderer.hpp"
 #include "ResourceManager.hpp"
 #include "Window.hpp"
@@ -43,7 +47,19 @@ AssetHandle model_handle{};
 LightsInfo lights_info{.directional_dir = glm::vec3{0, -1, 0}, .directional_color = glm::vec3(1)};
 int cam_index = -1;
 ImGui::FileBrowser file_dialog;
-std::vector<PointLight> point_lights;
+bool animate_point_lights{false};
+// positions the animated lights circle around, by light index
+std::vector<glm::vec3> point_light_origins;
+
+void AddRandomPointLights(LightManager& lights, int count) {
+  static RandomGen g(-10, 10);
+  for (int i = 0; i < count; i++) {
+    glm::vec3 position = {g.Get(), g.Get() / 2, g.Get()};
+    lights.Add(
+        PointLight{.position = position, .radius = 0, .color = glm::vec3{1}, .intensity = 0.1});
+    point_light_origins.push_back(position);
+  }
+}
 
 }  // namespace
 
@@ -63,37 +79,64 @@ void App::OnModelChange(const std::string& model) {
 
 void App::Run() {
   ThreadPool::Init();
+  // the cached bake, or the decoded HDR on a miss, is loaded on the pool while the renderer and
+  // shaders are set up
+  const char* k_hdr_img_path = GET_PATH("resources/textures/hdr/newport_loft.hdr");
+  std::future<EnvironmentSource> env_source_future =
+      ThreadPool::Get().thread_pool.submit_task(
+          [k_hdr_img_path]() { return CubeMapConverter::LoadSource(k_hdr_img_path); });
   gl::ShaderManager::Init();
-  gl::ShaderManager::Get().AddShader(
-      "textured", {{GET_SHADER_PATH("textured.vs.glsl"), gl::ShaderType::kVertex, {}},
-                   {GET_SHADER_PATH("textured.fs.glsl"), gl::ShaderType::kFragment, {}}});
   renderer_.Init();
+  resource_manager_.Init();
+  std::vector<std::pair<std::string, std::string>> textured_defines;
+  if (!renderer_.BindlessTextures()) textured_defines.emplace_back("TEXTURE_ARRAYS", "1");
+  gl::ShaderManager::Get().AddShader(
+      "textured",
+      {{GET_SHADER_PATH("textured.vs.glsl"), gl::ShaderType::kVertex, {}},
+       {GET_SHADER_PATH("textured.fs.glsl"), gl::ShaderType::kFragment, textured_defines}});
+  // depth of static draws for directional and point light shadows
+  gl::ShaderManager::Get().AddShader(
+      "shadow_depth", {{GET_SHADER_PATH("shadow_depth.vs.glsl"), gl::ShaderType::kVertex, {}}});
 
   CubeMapConverter cube_map_converter;
   cube_map_converter.Init();
-  const char* k_hdr_img_path = GET_PATH("resources/textures/hdr/newport_loft.hdr");
-  AssetHandle hdr_equirect_handle = resource_manager_.Load<gl::Texture>(
-      k_hdr_img_path, gl::Tex2DCreateInfoLoadImage{.path = k_hdr_img_path,
-                                                   .wrap_s = GL_CLAMP_TO_EDGE,
-                                                   .wrap_t = GL_CLAMP_TO_EDGE,
-                                                   .internal_format = GL_RGB16F,
-                                                   .format = GL_RGB,
-                                                   .type = GL_FLOAT,
-                                                   .min_filter = GL_LINEAR,
-                                                   .mag_filter = GL_LINEAR,
-                                                   .bindless = false,
-                                                   .gen_mipmaps = false,
-                                                   .flip_image = true});
-  cube_map_converter.RenderEquirectangularEnvMap(
-      *resource_manager_.Get<gl::Texture>(hdr_equirect_handle));
-
-  RandomGen g(-10, 10);
-  for (int i = 0; i < 100; i++) {
-    glm::vec3 color = {g.Get(), g.Get() / 2, g.Get()};
-    point_lights.emplace_back(
-        PointLight{.position = color, ._pad1 = 0, .color = glm::vec3{1}, .intensity = 0.1});
+  EnvironmentSource env_source = env_source_future.get();
+  if (env_source.baked) {
+    cube_map_converter.UploadBaked(env_source.baked.value());
+  } else {
+    // black in place of an environment that failed to load, which isn't cached
+    const bool cache_bake = env_source.image.has_value() && env_source.bake_key.has_value();
+    HalfImage hdr_image = std::move(env_source.image)
+                              .value_or(HalfImage{.width = 1, .height = 1,
+                                                  .rgb = std::vector<uint16_t>(3)});
+    AssetHandle hdr_equirect_handle = resource_manager_.Load<gl::Texture>(
+        k_hdr_img_path,
+        gl::Tex2DCreateInfo{.dims = glm::ivec2{hdr_image.width, hdr_image.height},
+                            .wrap_s = GL_CLAMP_TO_EDGE,
+                            .wrap_t = GL_CLAMP_TO_EDGE,
+                            .internal_format = GL_RGB16F,
+                            .format = GL_RGB,
+                            .type = GL_HALF_FLOAT,
+                            .min_filter = GL_LINEAR,
+                            .mag_filter = GL_LINEAR,
+                            .data = reinterpret_cast<unsigned char*>(hdr_image.rgb.data()),
+                            .bindless = false,
+                            .gen_mipmaps = false});
+    cube_map_converter.RenderEquirectangularEnvMap(
+        *resource_manager_.Get<gl::Texture>(hdr_equirect_handle), env_source.irradiance_sh);
+    if (cache_bake) cube_map_converter.QueueStore(env_source.bake_key.value());
   }
-  renderer_.SubmitPointLights(point_lights);
+
+  AddRandomPointLights(renderer_.GetLightManager(), 100);
+  // a few casters to start with, more can be marked in the light editor
+  for (uint32_t i = 0; i < 8; i++) renderer_.GetLightManager().SetCastsShadows(i, true);
+
+  ReflectionProbes reflection_probes(renderer_);
+  reflection_probes.Init();
+  CascadedShadowMaps cascaded_shadows;
+  cascaded_shadows.Init();
+  PointLightShadows point_light_shadows;
+  point_light_shadows.Init();
 
   file_dialog.SetTitle("Select GLTF Model");
   file_dialog.SetTypeFilters({".gltf", ".glb"});
@@ -134,6 +177,17 @@ void App::Run() {
     window_.PollEvents();
     window_.StartRenderFrame(imgui_enabled_);
     player_.Update(dt);
+    if (animate_point_lights) {
+      // every light moves, uploaded as one range by the next draw
+      static float time = 0;
+      time += static_cast<float>(dt);
+      LightManager& lights = renderer_.GetLightManager();
+      for (uint32_t i = 0; i < lights.Size(); i++) {
+        const float phase = time + static_cast<float>(i);
+        const glm::vec3 offset{std::sin(phase), 0, std::cos(phase)};
+        lights.SetPosition(i, point_light_origins[i] + offset);
+      }
+    }
     static float scale = 1.0f;
 
     if (ImGui::SliderFloat("Scale", &scale, 0.1, 20)) {
@@ -141,7 +195,7 @@ void App::Run() {
       renderer_.SubmitStaticModel(*active_model, glm::scale(glm::mat4(1), glm::vec3(scale)));
     }
 
-    RenderInfo render_info;
+    RenderInfo render_info{.viewport_size = glm::vec2(window_.GetWindowSize())};
     if (cam_index != -1 && active_model != nullptr) {
       CameraData& cam = active_model->camera_data[cam_index];
       player_.camera_mode = Player::CameraMode::kFPS;
@@ -156,6 +210,47 @@ void App::Run() {
       render_info.view_pos = player_.Position();
     }
 
+    TextureStreamer& texture_streamer = resource_manager_.GetTextureStreamer();
+    if (renderer_.GetTextureFeedback().HasData()) {
+      texture_streamer.RequestFromFeedback(renderer_.GetTextureFeedback());
+    } else if (active_model) {
+      texture_streamer.RequestModel(*active_model, glm::scale(glm::mat4(1), glm::vec3(scale)),
+                                    render_info, window_.GetWindowSize().y);
+    }
+    texture_streamer.Update();
+    // after streaming, which may replace textures with new resident ones
+    TextureResidency& texture_residency = resource_manager_.GetTextureResidency();
+    texture_residency.MarkStaticDraws(renderer_, render_info);
+    for (const RenderInfo& capture_info : reflection_probes.UpcomingCaptures()) {
+      texture_residency.MarkStaticDraws(renderer_, capture_info);
+    }
+    texture_residency.Update();
+    cube_map_converter.Update(static_cast<float>(dt));
+    if (directional_light_enabled) {
+      cascaded_shadows.Update(renderer_, render_info, lights_info.directional_dir);
+    }
+    if (point_lights_enabled) point_light_shadows.Update(renderer_, render_info);
+
+    // the main view and reflection probe captures
+    auto draw_scene = [&](const RenderInfo& info) {
+      auto shader = gl::ShaderManager::Get().GetShader("textured").value();
+      shader.Bind();
+      shader.SetBool("point_lights_enabled", point_lights_enabled);
+      shader.SetBool("directional_light_enabled", directional_light_enabled);
+      shader.SetBool("texture_feedback_enabled",
+                     info.main_view && renderer_.GetTextureFeedback().enabled);
+      shader.SetVec3("u_directional_dir", lights_info.directional_dir);
+      shader.SetVec3("u_directional_color", lights_info.directional_color);
+      cube_map_converter.BindForShading(shader);
+      reflection_probes.BindForShading(shader);
+      cascaded_shadows.BindForShading(shader);
+      point_light_shadows.BindForShading(shader);
+      renderer_.DrawStaticOpaque(info);
+
+      cube_map_converter.Draw();
+    };
+    reflection_probes.Update(draw_scene);
+
     glDisable(GL_FRAMEBUFFER_SRGB);
     glClearColor(0.1, 0.1, 0.1, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -167,22 +262,15 @@ void App::Run() {
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
 
-    auto shader = gl::ShaderManager::Get().GetShader("textured").value();
-    shader.Bind();
-    shader.SetBool("point_lights_enabled", point_lights_enabled);
-    shader.SetBool("directional_light_enabled", directional_light_enabled);
-    shader.SetVec3("u_directional_dir", lights_info.directional_dir);
-    shader.SetVec3("u_directional_color", lights_info.directional_color);
-    cube_map_converter.irradiance_map.Bind(0);
-    cube_map_converter.prefilter_map.Bind(1);
-    cube_map_converter.brdf_lookup_tex.Bind(2);
-    renderer_.DrawStaticOpaque(render_info);
-
-    cube_map_converter.Draw();
+    draw_scene(render_info);
 
     if (imgui_enabled_) {
       OnImGui();
       player_.OnImGui();
+      cube_map_converter.OnImGui();
+      reflection_probes.OnImGui(render_info.view_pos);
+      cascaded_shadows.OnImGui();
+      point_light_shadows.OnImGui();
     }
 
     glDisable(GL_FRAMEBUFFER_SRGB);
@@ -237,20 +325,32 @@ void App::OnImGui() {
 
   if (ImGui::CollapsingHeader("Point Lights")) {
     ImGui::Checkbox("Enabled", &point_lights_enabled);
-    int i = 0;
-    for (auto& light : point_lights) {
-      ImGui::PushID(&light);
-      if (ImGui::ColorEdit3("Color", &light.color.x)) {
-        renderer_.EditPointLight(light, i);
-      }
-      if (ImGui::DragFloat3("Position", &light.position.x)) {
-        renderer_.EditPointLight(light, i);
-      }
-      if (ImGui::SliderFloat("Intensity", &light.intensity, 0.1, 100)) {
-        renderer_.EditPointLight(light, i);
+    LightManager& lights = renderer_.GetLightManager();
+    ImGui::Checkbox("Animate", &animate_point_lights);
+    if (ImGui::Button("Add 1000 Lights")) AddRandomPointLights(lights, 1000);
+    ImGui::Text("Lights: %u, uploaded last frame: %u, BVH rebuild: %.3f ms", lights.Size(),
+                lights.LastUploadCount(), lights.LastRebuildMs());
+    ImGui::Text("Light indices in clusters: %zu", renderer_.GetLightClusters().NumLightIndices());
+    // only the visible rows of thousands of lights get widgets
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(lights.Size()), ImGui::GetFrameHeightWithSpacing() * 4);
+    while (clipper.Step()) {
+      for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+        PointLight light = lights.Get(i);
+        ImGui::PushID(i);
+        bool changed = ImGui::ColorEdit3("Color", &light.color.x);
+        if (ImGui::DragFloat3("Position", &light.position.x)) {
+          changed = true;
+          point_light_origins[i] = light.position;
+        }
+        changed |= ImGui::SliderFloat("Intensity", &light.intensity, 0.1, 100);
+        if (changed) lights.Set(i, light);
+        bool casts_shadows = lights.CastsShadows(i);
+        if (ImGui::Checkbox("Casts Shadows", &casts_shadows)) {
+          lights.SetCastsShadows(i, casts_shadows);
+        }
+        ImGui::PopID();
       }
-      ImGui::PopID();
-      i++;
     }
   }
   if (ImGui::Button("Select Model glTF")) {
@@ -264,6 +364,19 @@ void App::OnImGui() {
     file_dialog.ClearSelected();
   }
 
+  const TextureQualityTier texture_quality = resource_manager_.GetTextureQualityTier();
+  if (ImGui::BeginCombo("Texture Quality", texture_quality::Name(texture_quality))) {
+    for (int i = 0; i < kNumTextureQualityTiers; i++) {
+      const auto tier = static_cast<TextureQualityTier>(i);
+      if (ImGui::Selectable(texture_quality::Name(tier), tier == texture_quality)) {
+        resource_manager_.SetTextureQualityTier(tier);
+      }
+    }
+    ImGui::EndCombo();
+  }
+  resource_manager_.GetTextureStreamer().OnImGui();
+  resource_manager_.GetTextureResidency().OnImGui();
+
   if (ImGui::CollapsingHeader("Directional Light")) {
     ImGui::Checkbox("Enabled", &directional_light_enabled);
     ImGui::ColorEdit3("Directional Color", &lights_info.directional_color.x);
@@ -0,0 +1,403 @@
+#include "BlockCompression.hpp"
+
+#include <cfloat>
+#include <cstring>
+
+#include "pch.hpp"
+
+namespace bc {
+
+namespace {
+
+// 4x4 texels, expanded to RGBA
+struct Block {
+  uint8_t texels[16][4];
+};
+
+void LoadBlock(const uint8_t* pixels, int width, int height, int channels, int block_x,
+               int block_y, Block& block) {
+  for (int y = 0; y < 4; y++) {
+    const int py = std::min(block_y * 4 + y, height - 1);
+    for (int x = 0; x < 4; x++) {
+      const int px = std::min(block_x * 4 + x, width - 1);
+      const uint8_t* src = pixels + (static_cast<size_t>(py) * width + px) * channels;
+      uint8_t* dst = block.texels[y * 4 + x];
+      dst[0] = src[0];
+      dst[1] = channels == 1 ? src[0] : src[1];
+      dst[2] = channels == 1 ? src[0] : channels == 2 ? 0 : src[2];
+      dst[3] = channels == 4 ? src[3] : 255;
+    }
+  }
+}
+
+// Principal axis of the texels' first N channels via power iteration on the covariance matrix.
+template <int N>
+void PrincipalAxis(const Block& block, float mean[N], float axis[N]) {
+  for (int c = 0; c < N; c++) {
+    mean[c] = 0;
+    for (const auto& texel : block.texels) mean[c] += texel[c];
+    mean[c] /= 16.f;
+  }
+  float cov[N][N]{};
+  for (const auto& texel : block.texels) {
+    for (int i = 0; i < N; i++) {
+      for (int j = i; j < N; j++) {
+        cov[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+      }
+    }
+  }
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < i; j++) cov[i][j] = cov[j][i];
+  }
+
+  for (int c = 0; c < N; c++) axis[c] = 1.f;
+  for (int iter = 0; iter < 8; iter++) {
+    float next[N]{};
+    for (int i = 0; i < N; i++) {
+      for (int j = 0; j < N; j++) next[i] += cov[i][j] * axis[j];
+    }
+    float max_component = 0;
+    for (int c = 0; c < N; c++) max_component = std::max(max_component, std::abs(next[c]));
+    // uniform block, any axis works
+    if (max_component < 1e-6f) return;
+    for (int c = 0; c < N; c++) axis[c] = next[c] / max_component;
+  }
+}
+
+// Endpoints at the extremes of the texels projected onto the principal axis.
+template <int N>
+void FitEndpoints(const Block& block, float e0[N], float e1[N]) {
+  float mean[N];
+  float axis[N];
+  PrincipalAxis<N>(block, mean, axis);
+  float len_sq = 0;
+  for (int c = 0; c < N; c++) len_sq += axis[c] * axis[c];
+  float min_t = 0;
+  float max_t = 0;
+  for (const auto& texel : block.texels) {
+    float t = 0;
+    for (int c = 0; c < N; c++) t += (texel[c] - mean[c]) * axis[c];
+    t /= len_sq;
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  for (int c = 0; c < N; c++) {
+    e0[c] = std::clamp(mean[c] + axis[c] * max_t, 0.f, 255.f);
+    e1[c] = std::clamp(mean[c] + axis[c] * min_t, 0.f, 255.f);
+  }
+}
+
+uint16_t To565(const float rgb[3]) {
+  const auto r = static_cast<uint16_t>(std::lround(rgb[0] * 31.f / 255.f));
+  const auto g = static_cast<uint16_t>(std::lround(rgb[1] * 63.f / 255.f));
+  const auto b = static_cast<uint16_t>(std::lround(rgb[2] * 31.f / 255.f));
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void From565(uint16_t color, int rgb[3]) {
+  const int r = (color >> 11) & 31;
+  const int g = (color >> 5) & 63;
+  const int b = color & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Index of the nearest of the 4 color palette entries for each texel.
+uint32_t ColorIndices(const Block& block, uint16_t c0, uint16_t c1, uint8_t indices[16]) {
+  int palette[4][3];
+  From565(c0, palette[0]);
+  From565(c1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+  uint32_t packed = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = 0;
+    int best_error = INT32_MAX;
+    for (int p = 0; p < 4; p++) {
+      int error = 0;
+      for (int c = 0; c < 3; c++) {
+        const int diff = block.texels[i][c] - palette[p][c];
+        error += diff * diff;
+      }
+      if (error < best_error) {
+        best_error = error;
+        best = p;
+      }
+    }
+    indices[i] = static_cast<uint8_t>(best);
+    packed |= static_cast<uint32_t>(best) << (i * 2);
+  }
+  return packed;
+}
+
+// Least squares endpoints for fixed indices. Returns false if the system is degenerate.
+bool RefineColorEndpoints(const Block& block, const uint8_t indices[16], float e0[3],
+                          float e1[3]) {
+  constexpr float kWeights[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+  float aa = 0;
+  float bb = 0;
+  float ab = 0;
+  float ap[3]{};
+  float bp[3]{};
+  for (int i = 0; i < 16; i++) {
+    const float a = kWeights[indices[i]];
+    const float b = 1.f - a;
+    aa += a * a;
+    bb += b * b;
+    ab += a * b;
+    for (int c = 0; c < 3; c++) {
+      ap[c] += a * block.texels[i][c];
+      bp[c] += b * block.texels[i][c];
+    }
+  }
+  const float det = aa * bb - ab * ab;
+  if (std::abs(det) < 1e-6f) return false;
+  for (int c = 0; c < 3; c++) {
+    e0[c] = std::clamp((ap[c] * bb - bp[c] * ab) / det, 0.f, 255.f);
+    e1[c] = std::clamp((bp[c] * aa - ap[c] * ab) / det, 0.f, 255.f);
+  }
+  return true;
+}
+
+void WriteColorBlock(uint16_t c0, uint16_t c1, uint32_t indices, uint8_t* out) {
+  std::memcpy(out, &c0, 2);
+  std::memcpy(out + 2, &c1, 2);
+  std::memcpy(out + 4, &indices, 4);
+}
+
+// Always encodes in 4 color mode (c0 > c1), which BC3 requires.
+void EncodeColorBlock(const Block& block, uint8_t* out) {
+  float e0[3];
+  float e1[3];
+  FitEndpoints<3>(block, e0, e1);
+  uint16_t c0 = To565(e0);
+  uint16_t c1 = To565(e1);
+  uint8_t indices[16];
+  uint32_t packed = ColorIndices(block, c0, c1, indices);
+  if (c0 != c1 && RefineColorEndpoints(block, indices, e0, e1)) {
+    const uint16_t refined_c0 = To565(e0);
+    const uint16_t refined_c1 = To565(e1);
+    if (refined_c0 != refined_c1) {
+      c0 = refined_c0;
+      c1 = refined_c1;
+      packed = ColorIndices(block, c0, c1, indices);
+    }
+  }
+
+  if (c0 == c1) {
+    WriteColorBlock(c0, c1, 0, out);
+    return;
+  }
+  if (c0 < c1) {
+    std::swap(c0, c1);
+    // swap 0 <-> 1 and 2 <-> 3 by flipping the low bit of every index
+    packed ^= 0x55555555u;
+  }
+  WriteColorBlock(c0, c1, packed, out);
+}
+
+// 8 value interpolation mode (a0 > a1).
+void EncodeSingleChannelBlock(const Block& block, int channel, uint8_t* out) {
+  int min_value = 255;
+  int max_value = 0;
+  for (const auto& texel : block.texels) {
+    min_value = std::min<int>(min_value, texel[channel]);
+    max_value = std::max<int>(max_value, texel[channel]);
+  }
+  out[0] = static_cast<uint8_t>(max_value);
+  out[1] = static_cast<uint8_t>(min_value);
+  uint64_t packed = 0;
+  if (max_value != min_value) {
+    const int range = max_value - min_value;
+    for (int i = 0; i < 16; i++) {
+      // position along the palette: 0 is a0 (max), 7 is a1 (min)
+      const int t = ((max_value - block.texels[i][channel]) * 14 + range) / (2 * range);
+      const uint64_t index = t == 0 ? 0 : t == 7 ? 1 : t + 1;
+      packed |= index << (i * 3);
+    }
+  }
+  for (int i = 0; i < 6; i++) out[2 + i] = static_cast<uint8_t>(packed >> (i * 8));
+}
+
+struct BitWriter {
+  uint8_t* out;
+  int pos{0};
+  void Write(uint32_t value, int num_bits) {
+    for (int i = 0; i < num_bits; i++, pos++) {
+      if ((value >> i) & 1) out[pos >> 3] |= static_cast<uint8_t>(1 << (pos & 7));
+    }
+  }
+};
+
+// Quantizes an endpoint to 7 bits per channel plus a shared p-bit, picking the p-bit with the
+// lowest error.
+void QuantizeMode6Endpoint(const float endpoint[4], uint8_t quantized[4], uint8_t& p_bit) {
+  float best_error = FLT_MAX;
+  for (uint8_t p = 0; p < 2; p++) {
+    uint8_t candidate[4];
+    float error = 0;
+    for (int c = 0; c < 4; c++) {
+      const long q = std::clamp(std::lround((endpoint[c] - p) / 2.f), 0l, 127l);
+      candidate[c] = static_cast<uint8_t>(q);
+      const float diff = static_cast<float>((q << 1) | p) - endpoint[c];
+      error += diff * diff;
+    }
+    if (error < best_error) {
+      best_error = error;
+      p_bit = p;
+      std::memcpy(quantized, candidate, 4);
+    }
+  }
+}
+
+// BC7 mode 6: a single subset with 7.7.7.7 RGBA endpoints, per endpoint p-bits and 4 bit indices.
+void EncodeBC7Mode6Block(const Block& block, uint8_t* out) {
+  constexpr int kWeights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+  float e0[4];
+  float e1[4];
+  FitEndpoints<4>(block, e0, e1);
+  uint8_t q[2][4];
+  uint8_t p[2];
+  QuantizeMode6Endpoint(e0, q[0], p[0]);
+  QuantizeMode6Endpoint(e1, q[1], p[1]);
+
+  int endpoints[2][4];
+  for (int e = 0; e < 2; e++) {
+    for (int c = 0; c < 4; c++) endpoints[e][c] = (q[e][c] << 1) | p[e];
+  }
+  int palette[16][4];
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 4; c++) {
+      palette[i][c] =
+          ((64 - kWeights[i]) * endpoints[0][c] + kWeights[i] * endpoints[1][c] + 32) >> 6;
+    }
+  }
+  uint8_t indices[16];
+  for (int i = 0; i < 16; i++) {
+    int best = 0;
+    int best_error = INT32_MAX;
+    for (int entry = 0; entry < 16; entry++) {
+      int error = 0;
+      for (int c = 0; c < 4; c++) {
+        const int diff = block.texels[i][c] - palette[entry][c];
+        error += diff * diff;
+      }
+      if (error < best_error) {
+        best_error = error;
+        best = entry;
+      }
+    }
+    indices[i] = static_cast<uint8_t>(best);
+  }
+
+  // the anchor index's MSB is implicitly 0, swap the endpoints to make it so
+  if (indices[0] & 8) {
+    std::swap(q[0], q[1]);
+    std::swap(p[0], p[1]);
+    for (uint8_t& index : indices) index = 15 - index;
+  }
+
+  std::memset(out, 0, 16);
+  BitWriter writer{out};
+  writer.Write(1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    writer.Write(q[0][c], 7);
+    writer.Write(q[1][c], 7);
+  }
+  writer.Write(p[0], 1);
+  writer.Write(p[1], 1);
+  writer.Write(indices[0], 3);
+  for (int i = 1; i < 16; i++) writer.Write(indices[i], 4);
+}
+
+void EncodeBlock(Format format, const Block& block, uint8_t* out) {
+  switch (format) {
+    case Format::kBC1:
+    case Format::kBC1A:
+      EncodeColorBlock(block, out);
+      break;
+    case Format::kBC3:
+      EncodeSingleChannelBlock(block, 3, out);
+      EncodeColorBlock(block, out + 8);
+      break;
+    case Format::kBC4:
+      EncodeSingleChannelBlock(block, 0, out);
+      break;
+    case Format::kBC5:
+      EncodeSingleChannelBlock(block, 0, out);
+      EncodeSingleChannelBlock(block, 1, out + 8);
+      break;
+    case Format::kBC7:
+      EncodeBC7Mode6Block(block, out);
+      break;
+  }
+}
+
+}  // namespace
+
+uint32_t BlockSizeBytes(Format format) {
+  return format == Format::kBC1 || format == Format::kBC1A || format == Format::kBC4 ? 8 : 16;
+}
+
+size_t CompressedSizeBytes(Format format, int width, int height) {
+  return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * BlockSizeBytes(format);
+}
+
+GLenum GLInternalFormat(Format format, bool srgb) {
+  switch (format) {
+    case Format::kBC1:
+      return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case Format::kBC1A:
+      return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case Format::kBC3:
+      return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case Format::kBC4:
+      return GL_COMPRESSED_RED_RGTC1;
+    case Format::kBC5:
+      return GL_COMPRESSED_RG_RGTC2;
+    case Format::kBC7:
+      return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+  }
+  return GL_NONE;
+}
+
+void Encode(Format format, const uint8_t* pixels, int width, int height, int channels,
+            uint8_t* out) {
+  ZoneScoped;
+  const int blocks_x = (width + 3) / 4;
+  const int blocks_y = (height + 3) / 4;
+  const uint32_t block_size = BlockSizeBytes(format);
+  Block block;
+  for (int by = 0; by < blocks_y; by++) {
+    for (int bx = 0; bx < blocks_x; bx++) {
+      LoadBlock(pixels, width, height, channels, bx, by, block);
+      EncodeBlock(format, block, out);
+      out += block_size;
+    }
+  }
+}
+
+CompressedImage EncodeMipChain(Format format, const mip::Chain& chain) {
+  ZoneScoped;
+  CompressedImage result;
+  result.format = format;
+  size_t total_size = 0;
+  for (const mip::Level& level : chain.levels) {
+    const size_t size = CompressedSizeBytes(format, level.width, level.height);
+    result.levels.emplace_back(MipLevel{
+        .width = level.width, .height = level.height, .offset = total_size, .size_bytes = size});
+    total_size += size;
+  }
+  result.data.resize(total_size);
+  for (size_t i = 0; i < chain.levels.size(); i++) {
+    const mip::Level& level = chain.levels[i];
+    Encode(format, chain.data.data() + level.offset, level.width, level.height, chain.channels,
+           result.data.data() + result.levels[i].offset);
+  }
+  return result;
+}
+
+}  // namespace bc
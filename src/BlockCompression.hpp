@@ -0,0 +1,44 @@
+#pragma once
+
+#include "MipChain.hpp"
+
+namespace bc {
+
+enum class Format : uint8_t {
+  kBC1,  // RGB, 4 bpp
+  kBC3,  // RGBA, BC1 color + BC4 alpha, 8 bpp
+  kBC4,  // R, 4 bpp
+  kBC5,  // RG, 8 bpp
+  kBC7,  // RGBA, mode 6 only, 8 bpp
+  // RGB with 1 bit alpha, 4 bpp. Only read from KTX2 files, Encode writes opaque BC1 blocks.
+  kBC1A,
+};
+
+struct MipLevel {
+  int width;
+  int height;
+  size_t offset;
+  size_t size_bytes;
+};
+
+// All mip levels of a block compressed texture, stored contiguously from level 0 down.
+struct CompressedImage {
+  Format format{};
+  std::vector<MipLevel> levels;
+  std::vector<uint8_t> data;
+};
+
+[[nodiscard]] uint32_t BlockSizeBytes(Format format);
+[[nodiscard]] size_t CompressedSizeBytes(Format format, int width, int height);
+[[nodiscard]] GLenum GLInternalFormat(Format format, bool srgb);
+
+// Encodes width x height pixels of interleaved 8 bit channels. BC4 reads the first channel, BC5
+// the first two, and the color formats treat missing alpha as opaque. Partial edge blocks repeat
+// the last row/column.
+void Encode(Format format, const uint8_t* pixels, int width, int height, int channels,
+            uint8_t* out);
+
+// Encodes every level of the chain.
+[[nodiscard]] CompressedImage EncodeMipChain(Format format, const mip::Chain& chain);
+
+}  // namespace bc
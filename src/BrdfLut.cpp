@@ -0,0 +1,196 @@
+#include "BrdfLut.hpp"
+
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <numeric>
+
+#include "IblParams.hpp"
+#include "pch.hpp"
+
+namespace brdf_lut {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x46445242;  // "BRDF"
+constexpr size_t kNumFitParams = 10;
+// Nelder-Mead iterations, the fit converges in well under this
+constexpr int kFitIterations = 1500;
+
+struct Header {
+  uint32_t magic{kMagic};
+  uint32_t width{};
+  uint32_t height{};
+  uint32_t sample_count{};
+  AnalyticFit fit{};
+};
+
+using FitParams = std::array<float, kNumFitParams>;
+
+FitParams ToParams(const AnalyticFit& fit) {
+  return {fit.c0.x, fit.c0.y, fit.c0.z, fit.c0.w, fit.c1.x,
+          fit.c1.y, fit.c1.z, fit.c1.w, fit.scales.x, fit.scales.y};
+}
+
+AnalyticFit FromParams(const FitParams& p) {
+  return {.c0 = {p[0], p[1], p[2], p[3]}, .c1 = {p[4], p[5], p[6], p[7]}, .scales = {p[8], p[9]}};
+}
+
+struct Texel {
+  float n_dot_v;
+  float roughness;
+  glm::vec2 value;
+};
+
+std::vector<Texel> Texels(const IblMap& lut) {
+  const auto* data = reinterpret_cast<const uint16_t*>(lut.levels[0].data());
+  std::vector<Texel> texels;
+  texels.reserve(static_cast<size_t>(lut.dims.x) * lut.dims.y);
+  for (int y = 0; y < lut.dims.y; y++) {
+    for (int x = 0; x < lut.dims.x; x++) {
+      const size_t i = (static_cast<size_t>(y) * lut.dims.x + x) * 2;
+      const float n_dot_v = (static_cast<float>(x) + 0.5f) / static_cast<float>(lut.dims.x);
+      const float roughness = (static_cast<float>(y) + 0.5f) / static_cast<float>(lut.dims.y);
+      texels.push_back({.n_dot_v = n_dot_v,
+                        .roughness = roughness,
+                        .value = {static_cast<float>(data[i]) / 65535.f,
+                                  static_cast<float>(data[i + 1]) / 65535.f}});
+    }
+  }
+  return texels;
+}
+
+double SquaredError(const AnalyticFit& fit, const std::vector<Texel>& texels) {
+  double sum = 0;
+  for (const Texel& texel : texels) {
+    const glm::vec2 error = Analytic(fit, texel.n_dot_v, texel.roughness) - texel.value;
+    sum += static_cast<double>(error.x) * error.x + static_cast<double>(error.y) * error.y;
+  }
+  return sum;
+}
+
+// Downhill simplex, the approximation's min and exp2 aren't smooth enough for gradients.
+FitParams Minimize(const std::function<double(const FitParams&)>& cost, const FitParams& start) {
+  std::array<FitParams, kNumFitParams + 1> simplex;
+  std::array<double, kNumFitParams + 1> costs;
+  simplex.fill(start);
+  for (size_t i = 0; i < kNumFitParams; i++) {
+    float& param = simplex[i + 1][i];
+    param = param != 0.f ? param * 1.1f : 0.01f;
+  }
+  for (size_t i = 0; i <= kNumFitParams; i++) costs[i] = cost(simplex[i]);
+  std::array<size_t, kNumFitParams + 1> order;
+
+  auto lerp = [](const FitParams& from, const FitParams& to, float t) {
+    FitParams result;
+    for (size_t i = 0; i < kNumFitParams; i++) result[i] = from[i] + (to[i] - from[i]) * t;
+    return result;
+  };
+  for (int iteration = 0; iteration < kFitIterations; iteration++) {
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::sort(order, [&costs](size_t a, size_t b) { return costs[a] < costs[b]; });
+    const size_t best = order.front();
+    const size_t worst = order.back();
+    const size_t second_worst = order[kNumFitParams - 1];
+    FitParams centroid{};
+    for (size_t i = 0; i < kNumFitParams; i++) {
+      for (size_t j = 0; j < kNumFitParams; j++) centroid[j] += simplex[order[i]][j];
+    }
+    for (float& value : centroid) value /= static_cast<float>(kNumFitParams);
+
+    const FitParams reflected = lerp(centroid, simplex[worst], -1.f);
+    const double reflected_cost = cost(reflected);
+    if (reflected_cost < costs[best]) {
+      const FitParams expanded = lerp(centroid, simplex[worst], -2.f);
+      const double expanded_cost = cost(expanded);
+      const bool expand = expanded_cost < reflected_cost;
+      simplex[worst] = expand ? expanded : reflected;
+      costs[worst] = expand ? expanded_cost : reflected_cost;
+      continue;
+    }
+    if (reflected_cost < costs[second_worst]) {
+      simplex[worst] = reflected;
+      costs[worst] = reflected_cost;
+      continue;
+    }
+    const FitParams contracted = lerp(centroid, simplex[worst], 0.5f);
+    const double contracted_cost = cost(contracted);
+    if (contracted_cost < costs[worst]) {
+      simplex[worst] = contracted;
+      costs[worst] = contracted_cost;
+      continue;
+    }
+    for (size_t i = 0; i <= kNumFitParams; i++) {
+      if (i == best) continue;
+      simplex[i] = lerp(simplex[best], simplex[i], 0.5f);
+      costs[i] = cost(simplex[i]);
+    }
+  }
+  return simplex[std::distance(costs.begin(), std::ranges::min_element(costs))];
+}
+
+}  // namespace
+
+std::optional<Lut> Load(const std::string& path) {
+  ZoneScoped;
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) return std::nullopt;
+  Header header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  const glm::ivec2 dims = ibl::kBrdfLookupDims;
+  if (!file || header.magic != kMagic || header.width != static_cast<uint32_t>(dims.x) ||
+      header.height != static_cast<uint32_t>(dims.y) ||
+      header.sample_count != static_cast<uint32_t>(ibl::kBrdfSampleCount)) {
+    spdlog::warn("brdf lut: {} doesn't match the bake parameters", path);
+    return std::nullopt;
+  }
+  Lut lut{.map = {.dims = dims, .num_faces = 1, .internal_format = GL_RG16}, .fit = header.fit};
+  std::vector<uint8_t>& data =
+      lut.map.levels.emplace_back(static_cast<size_t>(dims.x) * dims.y * 4);
+  file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  if (!file) {
+    spdlog::warn("brdf lut: {} is truncated", path);
+    return std::nullopt;
+  }
+  return lut;
+}
+
+bool Write(const std::string& path, const Lut& lut) {
+  const Header header{.width = static_cast<uint32_t>(lut.map.dims.x),
+                      .height = static_cast<uint32_t>(lut.map.dims.y),
+                      .sample_count = static_cast<uint32_t>(ibl::kBrdfSampleCount),
+                      .fit = lut.fit};
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(lut.map.levels[0].data()),
+             static_cast<std::streamsize>(lut.map.levels[0].size()));
+  return static_cast<bool>(file);
+}
+
+glm::vec2 Analytic(const AnalyticFit& fit, float n_dot_v, float roughness) {
+  const glm::vec4 r = roughness * fit.c0 + fit.c1;
+  const float a004 = std::min(r.x * r.x, std::exp2(fit.scales.x * n_dot_v)) * r.x + r.y;
+  return glm::vec2{-fit.scales.y, fit.scales.y} * a004 + glm::vec2{r.z, r.w};
+}
+
+AnalyticFit FitAnalytic(const IblMap& lut) {
+  ZoneScoped;
+  const std::vector<Texel> texels = Texels(lut);
+  return FromParams(Minimize(
+      [&texels](const FitParams& params) { return SquaredError(FromParams(params), texels); },
+      ToParams(AnalyticFit{})));
+}
+
+glm::vec2 FitError(const AnalyticFit& fit, const IblMap& lut) {
+  const std::vector<Texel> texels = Texels(lut);
+  float max_error = 0.f;
+  for (const Texel& texel : texels) {
+    const glm::vec2 error = glm::abs(Analytic(fit, texel.n_dot_v, texel.roughness) - texel.value);
+    max_error = std::max({max_error, error.x, error.y});
+  }
+  const double rmse = std::sqrt(SquaredError(fit, texels) / static_cast<double>(texels.size() * 2));
+  return {static_cast<float>(rmse), max_error};
+}
+
+}  // namespace brdf_lut
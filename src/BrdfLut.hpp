@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include "IblCache.hpp"
+
+// The split sum BRDF LUT, generated at build time by brdf_lut_gen and shipped as a blob of
+// GL_RG16 texels after a small header, so it's loaded with a single upload. The blob also holds
+// an analytic fit of the LUT the shader can evaluate instead of sampling it.
+namespace brdf_lut {
+
+// Karis' approximation of the LUT (Physically Based Shading on Mobile, 2014), with coefficients
+// refit to this LUT. Defaults are his. Must match EnvBRDFApprox in textured.fs.glsl.
+struct AnalyticFit {
+  glm::vec4 c0{-1.f, -0.0275f, -0.572f, 0.022f};
+  glm::vec4 c1{1.f, 0.0425f, 1.04f, -0.04f};
+  // x scales NdotV in the exponent, y scales the grazing term
+  glm::vec2 scales{-9.28f, 1.04f};
+};
+
+struct Lut {
+  IblMap map{};
+  AnalyticFit fit{};
+};
+
+// nullopt if the file is missing or was generated with other parameters than IblParams.hpp.
+[[nodiscard]] std::optional<Lut> Load(const std::string& path);
+[[nodiscard]] bool Write(const std::string& path, const Lut& lut);
+
+// The scale and bias of F0.
+[[nodiscard]] glm::vec2 Analytic(const AnalyticFit& fit, float n_dot_v, float roughness);
+// Least squares fit of the approximation's coefficients to the LUT, starting from Karis'.
+[[nodiscard]] AnalyticFit FitAnalytic(const IblMap& lut);
+// Root mean square and max error of the fit over the LUT's texels.
+[[nodiscard]] glm::vec2 FitError(const AnalyticFit& fit, const IblMap& lut);
+
+}  // namespace brdf_lut
@@ -0,0 +1,178 @@
+#include "CascadedShadowMaps.hpp"
+
+#include <imgui.h>
+
+#include "Renderer.hpp"
+#include "gl/ShaderManager.hpp"
+#include "pch.hpp"
+
+namespace {
+
+// must match shadow_map in textured.fs.glsl
+constexpr GLuint kShadowMapUnit = 14;
+// the cascade depth range is padded past the scene so casters at its edge aren't clipped
+constexpr float kDepthPadding = 1.f;
+
+}  // namespace
+
+void CascadedShadowMaps::Init() {
+  depth_array_ = gl::CreateTexture(GL_TEXTURE_2D_ARRAY);
+  glTextureStorage3D(depth_array_.Id(), 1, GL_DEPTH_COMPONENT32F, kMapSize, kMapSize,
+                     kNumCascades);
+  // hardware PCF of the 2x2 texels around each lookup
+  glTextureParameteri(depth_array_.Id(), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(depth_array_.Id(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(depth_array_.Id(), GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTextureParameteri(depth_array_.Id(), GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glTextureParameteri(depth_array_.Id(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTextureParameteri(depth_array_.Id(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  const glm::vec4 border{1.f};
+  glTextureParameterfv(depth_array_.Id(), GL_TEXTURE_BORDER_COLOR, &border.x);
+
+  fbo_ = gl::CreateFramebuffer();
+  glNamedFramebufferDrawBuffer(fbo_.Id(), GL_NONE);
+  glNamedFramebufferReadBuffer(fbo_.Id(), GL_NONE);
+}
+
+void CascadedShadowMaps::Update(Renderer& renderer, const RenderInfo& render_info,
+                                const glm::vec3& light_dir) {
+  ZoneScoped;
+  renders_last_frame_ = 0;
+  const std::optional<AABB>& scene_bounds = renderer.StaticBounds();
+  if (!settings.enabled || !scene_bounds || glm::length(light_dir) < 1e-6f) return;
+
+  const glm::mat4& proj = render_info.projection_matrix;
+  // planes of a GL perspective projection, an infinite far plane leaves the shadow distance
+  const float near = proj[3][2] / (proj[2][2] - 1.f);
+  const float far_denom = proj[2][2] + 1.f;
+  const float far = std::min(std::abs(far_denom) > 1e-6f ? proj[3][2] / far_denom
+                                                         : settings.shadow_distance,
+                             settings.shadow_distance);
+  const glm::mat4 inv_view = glm::inverse(render_info.view_matrix);
+
+  const glm::vec3 dir = glm::normalize(light_dir);
+  const glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3{0, 0, 1} : glm::vec3{0, 1, 0};
+  const glm::mat4 light_view = glm::lookAt(glm::vec3{0.f}, dir, up);
+  // the light looks down -z, every caster in the scene must be in front of the near plane
+  const AABB scene_light_space = TransformedAABB(*scene_bounds, light_view);
+  const uint64_t static_generation = renderer.StaticGeneration();
+
+  float slice_near = near;
+  for (uint32_t i = 0; i < kNumCascades; i++) {
+    const float t = static_cast<float>(i + 1) / kNumCascades;
+    const float slice_far = settings.split_lambda * near * std::pow(far / near, t) +
+                            (1.f - settings.split_lambda) * (near + (far - near) * t);
+    // bounding sphere of the slice's corners
+    std::array<glm::vec3, 8> corners;
+    glm::vec3 center{0.f};
+    for (uint32_t corner = 0; corner < 8; corner++) {
+      const float depth = corner & 4 ? slice_far : slice_near;
+      const float ndc_x = corner & 1 ? 1.f : -1.f;
+      const float ndc_y = corner & 2 ? 1.f : -1.f;
+      const glm::vec4 view_pos{(ndc_x + proj[2][0]) * depth / proj[0][0],
+                               (ndc_y + proj[2][1]) * depth / proj[1][1], -depth, 1.f};
+      corners[corner] = glm::vec3(inv_view * view_pos);
+      center += corners[corner] / 8.f;
+    }
+    float radius = 0.f;
+    for (const glm::vec3& corner : corners) {
+      radius = std::max(radius, glm::distance(corner, center));
+    }
+    slice_near = slice_far;
+
+    Cascade& cascade = cascades_[i];
+    const bool scene_unchanged = cascade.valid && cascade.light_dir == dir &&
+                                 cascade.static_generation == static_generation;
+    if (i >= settings.first_cached_cascade) {
+      if (scene_unchanged && glm::distance(center, cascade.center) + radius <= cascade.radius) {
+        continue;
+      }
+      radius *= settings.cache_margin;
+    }
+    // rounded up so the texel size stays put as the slice's sphere wobbles with the camera
+    radius = std::ceil(radius * 16.f) / 16.f;
+    const float texel_size = 2.f * radius / kMapSize;
+    glm::vec3 light_center = glm::vec3(light_view * glm::vec4(center, 1.f));
+    light_center.x = std::floor(light_center.x / texel_size) * texel_size;
+    light_center.y = std::floor(light_center.y / texel_size) * texel_size;
+    const float z_max = std::max(scene_light_space.max.z, light_center.z + radius) + kDepthPadding;
+    const float z_min = std::min(scene_light_space.min.z, light_center.z - radius) - kDepthPadding;
+    const glm::mat4 light_proj =
+        glm::ortho(light_center.x - radius, light_center.x + radius, light_center.y - radius,
+                   light_center.y + radius, -z_max, -z_min);
+    const glm::mat4 view_proj = light_proj * light_view;
+    if (scene_unchanged && view_proj == cascade.view_proj) continue;
+
+    cascade = Cascade{.view_proj = view_proj,
+                      .center = center,
+                      .radius = radius,
+                      .texel_size = texel_size,
+                      .static_generation = static_generation,
+                      .light_dir = dir,
+                      .valid = true};
+    RenderCascade(renderer, cascade, i);
+    renders_last_frame_++;
+  }
+}
+
+void CascadedShadowMaps::RenderCascade(Renderer& renderer, Cascade& cascade, uint32_t idx) const {
+  ZoneScoped;
+  glNamedFramebufferTextureLayer(fbo_.Id(), GL_DEPTH_ATTACHMENT, depth_array_.Id(), 0,
+                                 static_cast<GLint>(idx));
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_.Id());
+  glViewport(0, 0, kMapSize, kMapSize);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+  // open meshes cast shadows from both sides
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(settings.slope_bias, settings.constant_bias);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  gl::Shader shader = gl::ShaderManager::Get().GetShader("shadow_depth").value();
+  shader.Bind();
+  shader.SetMat4("u_light_vp", cascade.view_proj);
+  cascade.num_draws = renderer.DrawStaticDepth(cascade.view_proj);
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CascadedShadowMaps::BindForShading(gl::Shader& shader) const {
+  const bool enabled = settings.enabled && cascades_[0].valid;
+  shader.SetBool("u_shadows_enabled", enabled);
+  if (!enabled) return;
+  std::array<glm::mat4, kNumCascades> view_projs;
+  glm::vec4 normal_offsets;
+  for (uint32_t i = 0; i < kNumCascades; i++) {
+    view_projs[i] = cascades_[i].view_proj;
+    normal_offsets[i] = cascades_[i].texel_size * settings.normal_bias;
+  }
+  shader.SetMat4Arr("u_cascade_vp[0]", kNumCascades, view_projs.data());
+  shader.SetVec4("u_cascade_normal_offsets", normal_offsets);
+  glBindTextureUnit(kShadowMapUnit, depth_array_.Id());
+}
+
+void CascadedShadowMaps::OnImGui() {
+  ImGui::Begin("Shadows", nullptr,
+               ImGuiWindowFlags_NoNavFocus | ImGuiWindowFlags_NoFocusOnAppearing);
+  ImGui::Checkbox("Enabled", &settings.enabled);
+  bool changed = ImGui::SliderFloat("Shadow Distance", &settings.shadow_distance, 5.f, 200.f);
+  changed |= ImGui::SliderFloat("Split Lambda", &settings.split_lambda, 0.f, 1.f);
+  int first_cached = static_cast<int>(settings.first_cached_cascade);
+  if (ImGui::SliderInt("First Cached Cascade", &first_cached, 0, kNumCascades)) {
+    settings.first_cached_cascade = first_cached;
+    changed = true;
+  }
+  changed |= ImGui::SliderFloat("Cache Margin", &settings.cache_margin, 1.f, 3.f);
+  ImGui::SliderFloat("Normal Bias (texels)", &settings.normal_bias, 0.f, 4.f);
+  changed |= ImGui::SliderFloat("Slope Bias", &settings.slope_bias, 0.f, 8.f);
+  changed |= ImGui::SliderFloat("Constant Bias", &settings.constant_bias, 0.f, 16.f);
+  if (changed) {
+    for (Cascade& cascade : cascades_) cascade.valid = false;
+  }
+  ImGui::Text("Cascades rendered last frame: %u", renders_last_frame_);
+  for (uint32_t i = 0; i < kNumCascades; i++) {
+    ImGui::Text("Cascade %u: radius %.1f, %u draws%s", i, cascades_[i].radius,
+                cascades_[i].num_draws, i >= settings.first_cached_cascade ? " (cached)" : "");
+  }
+  ImGui::End();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+
+#include "gl/Handle.hpp"
+
+class Renderer;
+struct RenderInfo;
+namespace gl {
+class Shader;
+}  // namespace gl
+
+struct CascadedShadowSettings {
+  bool enabled{true};
+  // view distance the cascades cover
+  float shadow_distance{40.f};
+  // blend of logarithmic (1) and uniform (0) cascade splits
+  float split_lambda{0.8f};
+  // Cascades from this one on are cached: they're re-rendered only when static geometry or the
+  // light direction changes, or the view leaves the margin they were rendered with.
+  uint32_t first_cached_cascade{2};
+  // radius of a cached cascade relative to its slice of the view
+  float cache_margin{1.5f};
+  // offset of the shaded position along the normal, in shadow texels
+  float normal_bias{1.5f};
+  float slope_bias{2.f};
+  float constant_bias{4.f};
+};
+
+// Shadow maps of the directional light fitted to slices of the view frustum. Each cascade bounds
+// its slice with a sphere so its size doesn't change as the camera turns, and snaps to whole
+// texels so it doesn't shimmer as the camera moves. Near cascades follow the view every frame,
+// far ones cover a margin around it and are reused until the view leaves it. A cascade is only
+// drawn when its matrix or the static geometry changed, with static instances culled against it.
+class CascadedShadowMaps {
+ public:
+  // must match textured.fs.glsl
+  static constexpr uint32_t kNumCascades = 4;
+  static constexpr int kMapSize = 2048;
+
+  CascadedShadowMaps() = default;
+  CascadedShadowMaps(const CascadedShadowMaps& other) = delete;
+  CascadedShadowMaps& operator=(const CascadedShadowMaps& other) = delete;
+
+  void Init();
+  // Fits the cascades to the view and renders those that changed. Call before the frame's passes,
+  // which must set their own framebuffer, viewport and cull state.
+  void Update(Renderer& renderer, const RenderInfo& render_info, const glm::vec3& light_dir);
+  // Binds the cascades for textured.fs.glsl.
+  void BindForShading(gl::Shader& shader) const;
+  void OnImGui();
+
+  CascadedShadowSettings settings;
+
+ private:
+  struct Cascade {
+    glm::mat4 view_proj{1.f};
+    // world bounding sphere the cascade covers
+    glm::vec3 center{0.f};
+    float radius{};
+    float texel_size{};
+    // what the cascade was last rendered with
+    uint64_t static_generation{};
+    glm::vec3 light_dir{0.f};
+    bool valid{false};
+    uint32_t num_draws{};
+  };
+
+  void RenderCascade(Renderer& renderer, Cascade& cascade, uint32_t idx) const;
+
+  std::array<Cascade, kNumCascades> cascades_{};
+  gl::TextureHandle depth_array_;
+  gl::FramebufferHandle fbo_;
+  uint32_t renders_last_frame_{};
+};
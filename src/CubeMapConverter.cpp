@@ -2,31 +2,171 @@
 
 #include <imgui.h>
 
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#include "BrdfLut.hpp"
+#include "IblParams.hpp"
 #include "Path.hpp"
 #include "Shape.hpp"
+#include "SphericalHarmonics.hpp"
 #include "gl/ShaderManager.hpp"
 #include "gl/Texture.hpp"
 #include "pch.hpp"
 #include "types.hpp"
+#include "util/ThreadPool.hpp"
 
 namespace {
-constexpr glm::ivec2 kIrradianceDims = {128, 128};
-constexpr glm::ivec2 kPrefilterDims = {256, 256};
+
+using ibl::kBrdfLookupDims;
+using ibl::kEnvCubeDims;
+using ibl::kPrefilterDims;
+using ibl::kPrefilterMipLevels;
+using ibl::kPrefilterSampleCounts;
+
+// must match the local size in prefilter.cs.glsl
+constexpr int kPrefilterGroupSize = 8;
+
+// cost slots of bake steps, each prefilter mip has its own after kPrefilterCostSlot
+constexpr uint32_t kUploadCostSlot = 0;
+constexpr uint32_t kCubeFaceCostSlot = 1;
+constexpr uint32_t kMipmapsCostSlot = 2;
+constexpr uint32_t kReadbackCostSlot = 3;
+constexpr uint32_t kPrefilterCostSlot = 4;
+// assumed until a step of the slot is measured
+constexpr float kInitialStepCostMs = 1.f;
+// weight of a new measurement in the running estimate
+constexpr float kStepCostSmoothing = 0.25f;
+// rows of the equirect image uploaded per step
+constexpr size_t kEquirectUploadChunkBytes = 4ull * 1024 * 1024;
+
+// views from the center at each face of the cube, in GL face order
+const glm::mat4& CaptureViewMatrix(int face) {
+  static const std::array<glm::mat4, 6> kViews = {
+      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f)),
+      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f)),
+      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                  glm::vec3(0.0f, 0.0f, 1.0f)),
+      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+                  glm::vec3(0.0f, 0.0f, -1.0f)),
+      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f)),
+      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+                  glm::vec3(0.0f, -1.0f, 0.0f))};
+  return kViews[face];
+}
+
+void LoadEnvCubeMap(gl::Texture& texture) {
+  // mipmapped for the prefilter's PDF based sampling
+  texture.Load(gl::TexCubeCreateParamsEmpty{.dims = kEnvCubeDims,
+                                            .internal_format = GL_RGB16F,
+                                            .wrap_s = GL_CLAMP_TO_EDGE,
+                                            .wrap_t = GL_CLAMP_TO_EDGE,
+                                            .wrap_r = GL_CLAMP_TO_EDGE,
+                                            .min_filter = GL_LINEAR_MIPMAP_LINEAR,
+                                            .mag_filter = GL_LINEAR,
+                                            .gen_mipmaps = true});
+}
+
+void LoadPrefilterMap(gl::Texture& texture) {
+  // written as an image by the prefilter compute shader, which can't store RGB formats
+  texture.Load(gl::TexCubeCreateParamsEmpty{.dims = kPrefilterDims,
+                                            .internal_format = GL_RGBA16F,
+                                            .wrap_s = GL_CLAMP_TO_EDGE,
+                                            .wrap_t = GL_CLAMP_TO_EDGE,
+                                            .wrap_r = GL_CLAMP_TO_EDGE,
+                                            .min_filter = GL_LINEAR_MIPMAP_LINEAR,
+                                            .mag_filter = GL_LINEAR,
+                                            .gen_mipmaps = true});
+}
+
+// client format the baked maps are read back and uploaded as
+std::pair<GLenum, GLenum> ClientFormat(GLenum internal_format) {
+  if (internal_format == GL_RG16) return {GL_RG, GL_UNSIGNED_SHORT};
+  return {GL_RGB, GL_HALF_FLOAT};
+}
+
+// a map with its levels sized to read back into
+IblMap MapLayout(glm::ivec2 dims, uint32_t num_faces, GLenum internal_format,
+                 uint32_t num_levels) {
+  IblMap map{.dims = dims, .num_faces = num_faces, .internal_format = internal_format};
+  for (uint32_t level = 0; level < num_levels; level++) {
+    const size_t width = std::max(dims.x >> level, 1);
+    const size_t height = std::max(dims.y >> level, 1);
+    map.levels.emplace_back(width * height * num_faces * gl::BytesPerTexel(internal_format));
+  }
+  return map;
+}
+
+// Queues copies of every level of texture into the bound pixel pack buffer from offset, packed
+// like the levels of layout. Returns the offset past them.
+size_t ReadBackToBuffer(const gl::Texture& texture, const IblMap& layout, size_t offset) {
+  const auto [format, type] = ClientFormat(layout.internal_format);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  for (size_t level = 0; level < layout.levels.size(); level++) {
+    const size_t size = layout.levels[level].size();
+    // cube maps are read back as all 6 faces in order
+    glGetTextureImage(texture.Id(), static_cast<GLint>(level), format, type,
+                      static_cast<GLsizei>(size), reinterpret_cast<void*>(offset));
+    offset += size;
+  }
+  return offset;
+}
+
+void Upload(const gl::Texture& texture, const IblMap& map) {
+  ZoneScoped;
+  const auto [format, type] = ClientFormat(map.internal_format);
+  // rows of RGB and RG data are tightly packed
+  const gl::ScopedUnpackAlignment unpack_alignment{1};
+  for (size_t level = 0; level < map.levels.size(); level++) {
+    const GLsizei width = std::max(map.dims.x >> level, 1);
+    const GLsizei height = std::max(map.dims.y >> level, 1);
+    if (map.num_faces == 6) {
+      glTextureSubImage3D(texture.Id(), static_cast<GLint>(level), 0, 0, 0, width, height, 6,
+                          format, type, map.levels[level].data());
+    } else {
+      glTextureSubImage2D(texture.Id(), static_cast<GLint>(level), 0, 0, width, height, format,
+                          type, map.levels[level].data());
+    }
+  }
+}
+
+// level 0 of one face of a cube map
+void UploadFace(const gl::Texture& texture, const IblMap& map, int face) {
+  ZoneScoped;
+  const auto [format, type] = ClientFormat(map.internal_format);
+  const size_t face_bytes = map.levels[0].size() / 6;
+  const gl::ScopedUnpackAlignment unpack_alignment{1};
+  glTextureSubImage3D(texture.Id(), 0, 0, 0, face, map.dims.x, map.dims.y, 1, format, type,
+                      map.levels[0].data() + face * face_bytes);
+}
 
 }  // namespace
+
+EnvironmentSource CubeMapConverter::LoadSource(const std::string& path) {
+  ZoneScoped;
+  EnvironmentSource source;
+  if (std::optional<size_t> hdr_hash = ibl_cache::HashFile(path)) {
+    source.bake_key = ibl_cache::EnvironmentKey(hdr_hash.value());
+    source.baked = ibl_cache::LoadEnvironment(source.bake_key.value());
+  }
+  if (!source.baked) {
+    source.image = hdr::LoadHalf(path, true);
+    if (source.image) source.irradiance_sh = sh::ProjectIrradiance(source.image.value());
+  }
+  return source;
+}
+
 void CubeMapConverter::Init() {
   gl::ShaderManager::Get().AddShader(
       "equirectangular_to_cube",
       {{GET_SHADER_PATH("cubemap.vs.glsl"), gl::ShaderType::kVertex, {}},
        {GET_SHADER_PATH("equirectangular_to_cube.fs.glsl"), gl::ShaderType::kFragment, {}}});
   gl::ShaderManager::Get().AddShader(
-      "irradiance_convolution",
-      {{GET_SHADER_PATH("cubemap.vs.glsl"), gl::ShaderType::kVertex, {}},
-       {GET_SHADER_PATH("ibl/irradiance_convolution.fs.glsl"), gl::ShaderType::kFragment, {}}});
-  gl::ShaderManager::Get().AddShader(
-      "prefilter_convolution",
-      {{GET_SHADER_PATH("cubemap.vs.glsl"), gl::ShaderType::kVertex, {}},
-       {GET_SHADER_PATH("ibl/prefilter_convolution.fs.glsl"), gl::ShaderType::kFragment, {}}});
+      "prefilter", {{GET_SHADER_PATH("ibl/prefilter.cs.glsl"), gl::ShaderType::kCompute, {}}});
   gl::ShaderManager::Get().AddShader(
       "env_map", {{GET_SHADER_PATH("env_map.vs.glsl"), gl::ShaderType::kVertex, {}},
                   {GET_SHADER_PATH("env_map.fs.glsl"), gl::ShaderType::kFragment, {}}});
@@ -43,36 +183,15 @@ void CubeMapConverter::Init() {
   glCreateFramebuffers(1, &capture_fbo_);
   glCreateRenderbuffers(1, &capture_rbo_);
 
-  glNamedRenderbufferStorage(capture_rbo_, GL_DEPTH_COMPONENT24, dims.x, dims.y);
+  glNamedRenderbufferStorage(capture_rbo_, GL_DEPTH_COMPONENT24, kEnvCubeDims.x, kEnvCubeDims.y);
   glNamedFramebufferRenderbuffer(capture_fbo_, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, capture_rbo_);
   if (glCheckNamedFramebufferStatus(capture_fbo_, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
     spdlog::error("framebuffer incomplete");
   }
 
-  env_cube_map.Load(gl::TexCubeCreateParamsEmpty{.dims = dims,
-                                                 .internal_format = GL_RGB16F,
-                                                 .wrap_s = GL_CLAMP_TO_EDGE,
-                                                 .wrap_t = GL_CLAMP_TO_EDGE,
-                                                 .wrap_r = GL_CLAMP_TO_EDGE,
-                                                 .min_filter = GL_LINEAR,
-                                                 .mag_filter = GL_LINEAR,
-                                                 .gen_mipmaps = false});
-  irradiance_map.Load(gl::TexCubeCreateParamsEmpty{.dims = kIrradianceDims,
-                                                   .internal_format = GL_RGB16F,
-                                                   .wrap_s = GL_CLAMP_TO_EDGE,
-                                                   .wrap_t = GL_CLAMP_TO_EDGE,
-                                                   .wrap_r = GL_CLAMP_TO_EDGE,
-                                                   .min_filter = GL_LINEAR_MIPMAP_LINEAR,
-                                                   .mag_filter = GL_LINEAR,
-                                                   .gen_mipmaps = true});
-  prefilter_map.Load(gl::TexCubeCreateParamsEmpty{.dims = kPrefilterDims,
-                                                  .internal_format = GL_RGB16F,
-                                                  .wrap_s = GL_CLAMP_TO_EDGE,
-                                                  .wrap_t = GL_CLAMP_TO_EDGE,
-                                                  .wrap_r = GL_CLAMP_TO_EDGE,
-                                                  .min_filter = GL_LINEAR_MIPMAP_LINEAR,
-                                                  .mag_filter = GL_LINEAR,
-                                                  .gen_mipmaps = true});
+  LoadEnvCubeMap(env_cube_map);
+  LoadPrefilterMap(prefilter_map);
+  bake_step_cost_ms_.fill(kInitialStepCostMs);
 
   quad_vao_.Init();
   quad_vao_.EnableAttribute<float>(0, 3, offsetof(PosTexVertex, position));
@@ -90,124 +209,375 @@ void CubeMapConverter::Init() {
   quad_ebo_.Init(sizeof(uint32_t) * 6, 0, indices.data());
   quad_vao_.AttachVertexBuffer(quad_vbo_.Id(), 0, 0, sizeof(PosTexVertex));
   quad_vao_.AttachElementBuffer(quad_ebo_.Id());
+  LoadBRDFLookupTexture();
+}
+
+void CubeMapConverter::UploadBaked(const BakedEnvironment& baked) {
+  ZoneScoped;
+  Upload(env_cube_map, baked.env_cube);
+  glGenerateTextureMipmap(env_cube_map.Id());
+  irradiance_sh = baked.irradiance_sh;
+  Upload(prefilter_map, baked.prefilter);
+}
+
+void CubeMapConverter::RenderEquirectangularEnvMap(const gl::Texture& texture,
+                                                   const SH9& environment_sh) {
+  irradiance_sh = environment_sh;
+  for (int face = 0; face < 6; face++) RenderCubeFace(texture, env_cube_map, face);
+  glGenerateTextureMipmap(env_cube_map.Id());
+  for (uint32_t mip = 0; mip < kPrefilterMipLevels; ++mip) {
+    PrefilterFaces(env_cube_map.Id(), kEnvCubeDims.x, prefilter_map.Id(), kPrefilterDims.x, mip,
+                   0, 6);
+  }
+  // levels are independent, only later sampling and readback wait on the writes
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
 }
 
-void CubeMapConverter::RenderEquirectangularEnvMap(const gl::Texture& texture) {
+void CubeMapConverter::RenderCubeFace(const gl::Texture& equirect, const gl::Texture& target,
+                                      int face) {
   // put cube exactly in perspective
   const glm::mat4 capture_proj_matrix = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-  // view matrices look from the center at each side of the cube
-  const std::array<glm::mat4, 6> capture_view_matrices = {
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f),
-                  glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
-                  glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
-                  glm::vec3(0.0f, 0.0f, 1.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
-                  glm::vec3(0.0f, 0.0f, -1.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
-                  glm::vec3(0.0f, -1.0f, 0.0f)),
-      glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
-                  glm::vec3(0.0f, -1.0f, 0.0f))};
+  gl::Shader shader = gl::ShaderManager::Get().GetShader("equirectangular_to_cube").value();
+  shader.Bind();
+  shader.SetMat4("u_projection", capture_proj_matrix);
+  shader.SetMat4("u_view", CaptureViewMatrix(face));
+  equirect.Bind(0);
 
   glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo_);
+  glNamedFramebufferTexture2DEXT(capture_fbo_, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, target.Id(), 0);
+  glViewport(0, 0, kEnvCubeDims.x, kEnvCubeDims.y);
+  // the cube is seen from inside
+  glDisable(GL_CULL_FACE);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   cube_pos_only_vao.Bind();
+  glDrawArrays(GL_TRIANGLES, 0, 36);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CubeMapConverter::PrefilterFaces(GLuint env, int env_size, GLuint target, int target_size,
+                                      uint32_t mip, int first_face, int num_faces) {
+  const int mip_size = std::max(target_size >> mip, 1);
+  const int num_groups = (mip_size + kPrefilterGroupSize - 1) / kPrefilterGroupSize;
+  gl::Shader shader = gl::ShaderManager::Get().GetShader("prefilter").value();
+  shader.Bind();
+  shader.SetFloat("env_resolution", static_cast<float>(env_size));
+  shader.SetFloat("roughness", static_cast<float>(mip) / (kPrefilterMipLevels - 1));
+  shader.SetInt("sample_count", kPrefilterSampleCounts[mip]);
+  shader.SetInt("first_face", first_face);
+  glBindTextureUnit(0, env);
+  glBindImageTexture(0, target, static_cast<GLint>(mip), GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+  glDispatchCompute(num_groups, num_groups, num_faces);
+}
+
+glm::mat4 CubeMapConverter::CaptureView(int face, const glm::vec3& eye) {
+  return glm::translate(CaptureViewMatrix(face), -eye);
+}
+
+void CubeMapConverter::SwitchEnvironment(const std::string& path) {
+  bake_ = EnvironmentBake{.source_future = ThreadPool::Get().thread_pool.submit_task(
+                              [path]() { return LoadSource(path); })};
+}
 
-  auto draw_cube_map = [&capture_view_matrices, this](gl::Shader& shader, const gl::Texture& tex) {
-    for (int i = 0; i < 6; i++) {
-      shader.SetMat4("u_view", capture_view_matrices[i]);
-      glNamedFramebufferTexture2DEXT(capture_fbo_, GL_COLOR_ATTACHMENT0,
-                                     GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, tex.Id(), 0);
-      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+void CubeMapConverter::Update(float dt) {
+  ZoneScoped;
+  ReadBakeTimings();
+  UpdateStore();
+  if (fade_ < 1.f) {
+    fade_ = settings.fade_seconds > 0.f ? std::min(fade_ + dt / settings.fade_seconds, 1.f) : 1.f;
+    // the spare maps are faded out from until then
+    return;
+  }
+  if (!bake_) return;
+  if (bake_->source_future.valid()) {
+    if (bake_->source_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      return;
     }
-  };
-
-  // equirectangular to cube render
-  gl::Shader equirect_to_cube_shader =
-      gl::ShaderManager::Get().GetShader("equirectangular_to_cube").value();
-  equirect_to_cube_shader.Bind();
-  equirect_to_cube_shader.SetMat4("u_projection", capture_proj_matrix);
-  texture.Bind(0);
-  glViewport(0, 0, dims.x, dims.y);
-  draw_cube_map(equirect_to_cube_shader, env_cube_map);
-
-  // irradiance map render
-  glNamedRenderbufferStorage(capture_rbo_, GL_DEPTH_COMPONENT24, kIrradianceDims.x,
-                             kIrradianceDims.y);
-  gl::Shader irradiance_shader =
-      gl::ShaderManager::Get().GetShader("irradiance_convolution").value();
-  irradiance_shader.Bind();
-  irradiance_shader.SetMat4("u_projection", capture_proj_matrix);
-  env_cube_map.Bind(0);
-  glViewport(0, 0, kIrradianceDims.x, kIrradianceDims.y);
-  draw_cube_map(irradiance_shader, irradiance_map);
-
-  // prefilter maps render
-  gl::Shader prefilter_shader = gl::ShaderManager::Get().GetShader("prefilter_convolution").value();
-  prefilter_shader.Bind();
-  prefilter_shader.SetMat4("u_projection", capture_proj_matrix);
-  env_cube_map.Bind(0);
-  constexpr const uint32_t kMaxMipLevels = 6;
-  for (uint32_t mip = 0; mip < kMaxMipLevels; ++mip) {
-    uint32_t mip_width = kPrefilterDims.x * std::pow(0.5, mip);
-    uint32_t mip_height = kPrefilterDims.y * std::pow(0.5, mip);
-    glNamedRenderbufferStorage(capture_rbo_, GL_DEPTH_COMPONENT24, mip_width, mip_height);
-    glViewport(0, 0, mip_width, mip_height);
-    float roughness = static_cast<float>(mip) / static_cast<float>(kMaxMipLevels - 1);
-    prefilter_shader.SetFloat("roughness", roughness);
-
-    for (int i = 0; i < 6; i++) {
-      prefilter_shader.SetMat4("u_view", capture_view_matrices[i]);
-      glNamedFramebufferTexture2DEXT(capture_fbo_, GL_COLOR_ATTACHMENT0,
-                                     GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilter_map.Id(), mip);
-      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+    if (!StartBake(bake_->source_future.get())) {
+      bake_.reset();
+      return;
     }
   }
+  RunBakeSteps();
+  if (bake_->steps.empty()) FinishBake();
+}
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  RenderBRDFLookupTexture();
+bool CubeMapConverter::StartBake(EnvironmentSource&& source) {
+  ZoneScoped;
+  if (!source.baked && !source.image) {
+    spdlog::error("failed to load environment, keeping the current one");
+    return false;
+  }
+  if (!spare_env_cube_.Id()) LoadEnvCubeMap(spare_env_cube_);
+  if (!spare_prefilter_.Id()) LoadPrefilterMap(spare_prefilter_);
+  EnvironmentBake& bake = bake_.value();
+  bake.source = std::move(source);
+  std::deque<BakeStep>& steps = bake.steps;
+
+  if (bake.source.baked) {
+    for (int face = 0; face < 6; face++) {
+      steps.push_back({kUploadCostSlot, [this, face]() {
+                         UploadFace(spare_env_cube_, bake_->source.baked->env_cube, face);
+                       }});
+    }
+    steps.push_back({kMipmapsCostSlot, [this]() {
+                       glGenerateTextureMipmap(spare_env_cube_.Id());
+                     }});
+    steps.push_back({kUploadCostSlot, [this]() {
+                       Upload(spare_prefilter_, bake_->source.baked->prefilter);
+                     }});
+    return true;
+  }
+
+  const HalfImage& image = bake.source.image.value();
+  bake.equirect.Load(gl::Tex2DCreateInfoEmpty{.dims = glm::ivec2{image.width, image.height},
+                                              .wrap_s = GL_CLAMP_TO_EDGE,
+                                              .wrap_t = GL_CLAMP_TO_EDGE,
+                                              .internal_format = GL_RGB16F,
+                                              .min_filter = GL_LINEAR,
+                                              .mag_filter = GL_LINEAR});
+  const size_t row_bytes = static_cast<size_t>(image.width) * 3 * sizeof(uint16_t);
+  const int chunk_rows = static_cast<int>(std::max<size_t>(kEquirectUploadChunkBytes / row_bytes,
+                                                           1));
+  for (int row = 0; row < image.height; row += chunk_rows) {
+    steps.push_back({kUploadCostSlot, [this, row, chunk_rows]() {
+                       const HalfImage& image = bake_->source.image.value();
+                       const int rows = std::min(chunk_rows, image.height - row);
+                       const gl::ScopedUnpackAlignment unpack_alignment{1};
+                       glTextureSubImage2D(bake_->equirect.Id(), 0, 0, row, image.width, rows,
+                                           GL_RGB, GL_HALF_FLOAT,
+                                           image.rgb.data() + static_cast<size_t>(row) *
+                                                                  image.width * 3);
+                     }});
+  }
+  for (int face = 0; face < 6; face++) {
+    steps.push_back({kCubeFaceCostSlot, [this, face]() {
+                       RenderCubeFace(bake_->equirect, spare_env_cube_, face);
+                     }});
+  }
+  steps.push_back({kMipmapsCostSlot, [this]() {
+                     glGenerateTextureMipmap(spare_env_cube_.Id());
+                   }});
+  for (uint32_t mip = 0; mip < kPrefilterMipLevels; ++mip) {
+    for (int face = 0; face < 6; face++) {
+      steps.push_back({kPrefilterCostSlot + mip, [this, mip, face]() {
+                         PrefilterFaces(spare_env_cube_.Id(), kEnvCubeDims.x, spare_prefilter_.Id(),
+                                        kPrefilterDims.x, mip, face, 1);
+                       }});
+    }
+  }
+  // a switch finishing while the last one is still being stored isn't cached, it's baked again
+  // the next time it's loaded
+  if (bake.source.bake_key && !store_) {
+    steps.push_back({kReadbackCostSlot, [this]() {
+                       QueueStore(bake_->source.bake_key.value(), bake_->source.irradiance_sh,
+                                  spare_env_cube_, spare_prefilter_);
+                     }});
+  }
+  return true;
 }
 
-void CubeMapConverter::Draw(const gl::Texture& tex) const {
-  glDepthFunc(GL_LEQUAL);
-  gl::Shader shader = gl::ShaderManager::Get().GetShader("env_map").value();
-  shader.Bind();
+void CubeMapConverter::RunBakeSteps() {
+  ZoneScoped;
+  std::deque<BakeStep>& steps = bake_->steps;
+  float frame_cost_ms = 0.f;
+  bool ran_step = false;
+  while (!steps.empty()) {
+    const BakeStep& step = steps.front();
+    const float cost_ms = bake_step_cost_ms_[step.cost_slot];
+    if (ran_step && frame_cost_ms + cost_ms > settings.gpu_budget_ms) break;
+    GLuint query{};
+    if (free_queries_.empty()) {
+      glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+    } else {
+      query = free_queries_.back();
+      free_queries_.pop_back();
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    step.run();
+    glEndQuery(GL_TIME_ELAPSED);
+    timing_queries_.push_back({.id = query, .cost_slot = step.cost_slot});
+    frame_cost_ms += cost_ms;
+    ran_step = true;
+    steps.pop_front();
+  }
+}
 
-  static float lod = 1.2;
-  ImGui::Begin("LOD");
-  ImGui::SliderFloat("LOD", &lod, 0, 4.99);
+void CubeMapConverter::FinishBake() {
+  ZoneScoped;
+  // the prefilter's image writes, for shading with the maps
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+  std::swap(env_cube_map, spare_env_cube_);
+  std::swap(prefilter_map, spare_prefilter_);
+  prev_irradiance_sh_ = irradiance_sh;
+  irradiance_sh = bake_->source.baked ? bake_->source.baked->irradiance_sh
+                                      : bake_->source.irradiance_sh;
+  fade_ = 0.f;
+  bake_.reset();
+}
+
+void CubeMapConverter::QueueStore(size_t key) {
+  // a switch's store takes precedence, its environment isn't cached otherwise
+  if (store_) return;
+  QueueStore(key, irradiance_sh, env_cube_map, prefilter_map);
+}
+
+void CubeMapConverter::QueueStore(size_t key, const SH9& environment_sh,
+                                  const gl::Texture& env_cube, const gl::Texture& prefilter) {
+  ZoneScoped;
+  // the prefilter's image writes, for the copies
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+  PendingStore& store = store_.emplace(PendingStore{
+      .key = key,
+      .baked = {.env_cube = MapLayout(kEnvCubeDims, 6, GL_RGB16F, 1),
+                .irradiance_sh = environment_sh,
+                // without the alpha of its RGBA16F storage
+                .prefilter = MapLayout(kPrefilterDims, 6, GL_RGB16F, kPrefilterMipLevels)}});
+  size_t size_bytes = 0;
+  for (const IblMap* map : {&store.baked.env_cube, &store.baked.prefilter}) {
+    for (const std::vector<uint8_t>& level : map->levels) size_bytes += level.size();
+  }
+  store.buffer.Init(size_bytes, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT, nullptr);
+  store.buffer.Bind(GL_PIXEL_PACK_BUFFER);
+  const size_t offset = ReadBackToBuffer(env_cube, store.baked.env_cube, 0);
+  ReadBackToBuffer(prefilter, store.baked.prefilter, offset);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  store.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void CubeMapConverter::UpdateStore() {
+  if (!store_) return;
+  if (store_->fence) {
+    const GLenum result = glClientWaitSync(store_->fence, 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) return;
+    glDeleteSync(store_->fence);
+    store_->fence = nullptr;
+    // the buffer stays mapped until the copy out of it is done
+    const auto* data = static_cast<const uint8_t*>(store_->buffer.Map(GL_READ_ONLY));
+    store_->store = ThreadPool::Get().thread_pool.submit_task(
+        [data, key = store_->key, baked = std::move(store_->baked)]() mutable {
+          for (IblMap* map : {&baked.env_cube, &baked.prefilter}) {
+            for (std::vector<uint8_t>& level : map->levels) {
+              std::memcpy(level.data(), data, level.size());
+              data += level.size();
+            }
+          }
+          ibl_cache::StoreEnvironment(key, baked);
+        });
+    return;
+  }
+  if (store_->store.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    store_.reset();
+  }
+}
+
+void CubeMapConverter::ReadBakeTimings() {
+  while (!timing_queries_.empty()) {
+    const TimingQuery& query = timing_queries_.front();
+    GLint available{};
+    glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) break;
+    GLuint64 elapsed_ns{};
+    glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &elapsed_ns);
+    float& cost_ms = bake_step_cost_ms_[query.cost_slot];
+    cost_ms += (static_cast<float>(elapsed_ns) * 1e-6f - cost_ms) * kStepCostSmoothing;
+    free_queries_.push_back(query.id);
+    timing_queries_.pop_front();
+  }
+}
+
+void CubeMapConverter::BindForShading(gl::Shader& shader) const {
+  // the previous maps while fading, the SH is faded on the CPU
+  const bool fading = fade_ < 1.f;
+  SH9 sh = irradiance_sh;
+  if (fading) {
+    for (size_t i = 0; i < sh.coeffs.size(); i++) {
+      sh.coeffs[i] = glm::mix(prev_irradiance_sh_.coeffs[i], sh.coeffs[i], fade_);
+    }
+  }
+  shader.SetVec3Arr("u_irradiance_sh[0]", sh.coeffs.size(), sh.coeffs.data());
+  shader.SetFloat("u_environment_blend", fade_);
+  shader.SetBool("u_analytic_env_brdf", analytic_brdf);
+  shader.SetVec4("u_env_brdf_c0", brdf_fit_.c0);
+  shader.SetVec4("u_env_brdf_c1", brdf_fit_.c1);
+  shader.SetVec2("u_env_brdf_scales", brdf_fit_.scales);
+  (fading ? spare_prefilter_ : prefilter_map).Bind(0);
+  prefilter_map.Bind(1);
+  brdf_lookup_tex.Bind(2);
+}
+
+void CubeMapConverter::OnImGui() {
+  ImGui::Begin("Environment", nullptr,
+               ImGuiWindowFlags_NoNavFocus | ImGuiWindowFlags_NoFocusOnAppearing);
+  const std::filesystem::path hdr_dir = GET_PATH("resources/textures/hdr");
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(hdr_dir, ec)) {
+    const std::string extension = entry.path().extension().string();
+    if (extension != ".hdr" && extension != ".exr") continue;
+    if (ImGui::Selectable(entry.path().filename().string().c_str())) {
+      SwitchEnvironment(entry.path().string());
+    }
+  }
+  ImGui::SliderFloat("Switch GPU Budget (ms)", &settings.gpu_budget_ms, 0.1f, 8.f);
+  ImGui::SliderFloat("Fade (s)", &settings.fade_seconds, 0.f, 4.f);
+  ImGui::Checkbox("Analytic Env BRDF", &analytic_brdf);
+  if (bake_ && bake_->source_future.valid()) {
+    ImGui::Text("Switching: loading");
+  } else if (bake_) {
+    ImGui::Text("Switching: %zu steps left", bake_->steps.size());
+  }
   ImGui::End();
+}
 
+void CubeMapConverter::Draw(const gl::Texture& tex, const gl::Texture& prev_tex, float blend,
+                            float lod) const {
+  glDepthFunc(GL_LEQUAL);
+  gl::Shader shader = gl::ShaderManager::Get().GetShader("env_map").value();
+  shader.Bind();
   shader.SetFloat("lod", lod);
+  shader.SetFloat("blend", blend);
 
   tex.Bind(0);
+  prev_tex.Bind(1);
   cube_pos_only_vao.Bind();
   glDrawArrays(GL_TRIANGLES, 0, 36);
   glDepthFunc(GL_LESS);
 }
 
-void CubeMapConverter::DrawPrefilter() const { Draw(prefilter_map); }
-void CubeMapConverter::DrawIrradiance() const { Draw(irradiance_map); }
-void CubeMapConverter::Draw() const { Draw(env_cube_map); }
+void CubeMapConverter::DrawPrefilter() const {
+  static float lod = 1.2;
+  ImGui::Begin("LOD");
+  ImGui::SliderFloat("LOD", &lod, 0, 4.99);
+  ImGui::End();
+  Draw(prefilter_map, prefilter_map, 1.f, lod);
+}
+// env_cube_map is mipmapped for prefiltering, the sky itself is drawn from the base level
+void CubeMapConverter::Draw() const {
+  Draw(env_cube_map, fade_ < 1.f ? spare_env_cube_ : env_cube_map, fade_, 0);
+}
 void CubeMapConverter::DrawBRDFTexture() {}
 
-void CubeMapConverter::RenderBRDFLookupTexture() {
-  constexpr const glm::ivec2 kBrdfLookupDims = {1024, 1024};
+void CubeMapConverter::LoadBRDFLookupTexture() {
+  ZoneScoped;
   brdf_lookup_tex.Load(gl::Tex2DCreateInfoEmpty{.dims = kBrdfLookupDims,
                                                 .wrap_s = GL_CLAMP_TO_EDGE,
                                                 .wrap_t = GL_CLAMP_TO_EDGE,
                                                 .internal_format = GL_RG16,
                                                 .min_filter = GL_LINEAR,
                                                 .mag_filter = GL_LINEAR});
+  if (std::optional<brdf_lut::Lut> lut = brdf_lut::Load(BRDF_LUT_PATH)) {
+    Upload(brdf_lookup_tex, lut->map);
+    brdf_fit_ = lut->fit;
+    return;
+  }
 
+  // the same integration on the GPU when the build's blob is missing, with the published fit
+  spdlog::warn("brdf lut: {} missing or stale, rendering it", BRDF_LUT_PATH);
   gl::Shader brdf_shader = gl::ShaderManager::Get().GetShader("brdf_lookup").value();
   brdf_shader.Bind();
   quad_vao_.Bind();
+  // the depth attachment stays at the env cube's size, only the common area is rendered
   glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo_);
-  glNamedRenderbufferStorage(capture_rbo_, GL_DEPTH_COMPONENT24, kBrdfLookupDims.x,
-                             kBrdfLookupDims.y);
   glNamedFramebufferTexture2DEXT(capture_fbo_, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
                                  brdf_lookup_tex.Id(), 0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1,42 +1,151 @@
 #pragma once
+#include <deque>
+#include <functional>
+#include <future>
+
+#include "BrdfLut.hpp"
+#include "HdrImage.hpp"
+#include "IblCache.hpp"
+#include "IblParams.hpp"
 #include "gl/Buffer.hpp"
 #include "gl/Texture.hpp"
 #include "gl/VertexArray.hpp"
 #include "types.hpp"
 namespace gl {
+class Shader;
 class Texture;
-}
+}  // namespace gl
+
+// An environment's cached bake, or its decoded HDR to bake from when there is none.
+struct EnvironmentSource {
+  std::optional<size_t> bake_key;
+  std::optional<BakedEnvironment> baked;
+  std::optional<HalfImage> image;
+  SH9 irradiance_sh;
+};
+
+struct EnvironmentSwitchSettings {
+  // GPU time baking a new environment may add to a frame, by the measured cost of each step. At
+  // least one step runs per frame.
+  float gpu_budget_ms{1.f};
+  float fade_seconds{0.75f};
+};
 
 struct CubeMapConverter {
   void Init();
 
-  void RenderEquirectangularEnvMap(const gl::Texture& texture);
+  // Hashes the file and loads its cached bake, or decodes it and projects its SH on a miss. Slow,
+  // call on the thread pool.
+  [[nodiscard]] static EnvironmentSource LoadSource(const std::string& path);
+
+  // Loads the environment on the thread pool, then bakes it into spare maps a few steps per frame
+  // in Update while the current maps keep being used, and cross-fades to it once complete.
+  // Replaces a switch that hasn't finished baking.
+  void SwitchEnvironment(const std::string& path);
+  // Advances the fade and runs this frame's share of a pending switch. Call once per frame before
+  // the frame's passes, which must set their own viewport and cull state.
+  void Update(float dt);
+  [[nodiscard]] bool Switching() const { return bake_.has_value(); }
+  // Sets the irradiance SH and binds the prefilter maps being faded between and the BRDF lookup
+  // for textured.fs.glsl.
+  void BindForShading(gl::Shader& shader) const;
+  void OnImGui();
+
+  void UploadBaked(const BakedEnvironment& baked);
+  // Queues a copy of the current maps to a buffer, and writes them to the cache on the thread pool
+  // from Update once the copy is done, so the readback doesn't stall.
+  void QueueStore(size_t key);
+
+  // environment_sh is projected from the same environment on the CPU, see sh::ProjectIrradiance.
+  void RenderEquirectangularEnvMap(const gl::Texture& texture, const SH9& environment_sh);
   void DrawBRDFTexture();
   void Draw() const;
-  void DrawIrradiance() const;
   void DrawPrefilter() const;
 
+  // Prefilters one mip of the specular map of the cube env into the cube target, faces from
+  // first_face in one dispatch. Sizes are of the base levels.
+  static void PrefilterFaces(GLuint env, int env_size, GLuint target, int target_size,
+                             uint32_t mip, int first_face, int num_faces);
+  // view from eye at a cube map face, in GL face order, for a 90 degree square projection
+  [[nodiscard]] static glm::mat4 CaptureView(int face, const glm::vec3& eye);
+
   gl::VertexArray cube_pos_only_vao;
   gl::Buffer<VertexPosOnly> cube_pos_only_vbo;
 
-  // TODO: be specific and move to impl file
-  glm::ivec2 dims{1024, 1024};
   gl::Texture env_cube_map;
-  gl::Texture irradiance_map;
   gl::Texture prefilter_map;
   gl::Texture brdf_lookup_tex;
+  SH9 irradiance_sh;
+  EnvironmentSwitchSettings settings;
+  // shade with the analytic fit of the LUT instead of sampling brdf_lookup_tex
+  bool analytic_brdf{false};
 
   ~CubeMapConverter() {
     // TODO: RAII wrapper
     glDeleteFramebuffers(1, &capture_fbo_);
     glDeleteRenderbuffers(1, &capture_rbo_);
+    for (const TimingQuery& query : timing_queries_) free_queries_.push_back(query.id);
+    glDeleteQueries(static_cast<GLsizei>(free_queries_.size()), free_queries_.data());
+    if (store_ && store_->fence) glDeleteSync(store_->fence);
   }
 
  private:
-  void RenderBRDFLookupTexture();
+  // steps of a bake with the same cost slot take about the same GPU time
+  static constexpr uint32_t kNumBakeCostSlots = 4 + ibl::kPrefilterMipLevels;
+  struct BakeStep {
+    uint32_t cost_slot{};
+    std::function<void()> run;
+  };
+  struct EnvironmentBake {
+    std::future<EnvironmentSource> source_future;
+    // what the steps upload from, once loaded
+    EnvironmentSource source{};
+    gl::Texture equirect{};
+    std::deque<BakeStep> steps{};
+  };
+  struct TimingQuery {
+    GLuint id{};
+    uint32_t cost_slot{};
+  };
+  // maps of a finished bake copied to a buffer by the GPU, then from the buffer to the cache on
+  // the thread pool once its fence signals
+  struct PendingStore {
+    size_t key{};
+    // levels are sized, filled from the buffer on the thread pool
+    BakedEnvironment baked{};
+    gl::Buffer<uint8_t> buffer{};
+    GLsync fence{};
+    std::future<void> store{};
+  };
+
+  void LoadBRDFLookupTexture();
+  void RenderCubeFace(const gl::Texture& equirect, const gl::Texture& target, int face);
+  // false if the source failed to load
+  bool StartBake(EnvironmentSource&& source);
+  void RunBakeSteps();
+  void FinishBake();
+  void QueueStore(size_t key, const SH9& environment_sh, const gl::Texture& env_cube,
+                  const gl::Texture& prefilter);
+  void UpdateStore();
+  void ReadBakeTimings();
+
+  // bake target of a switch, then the maps faded out from
+  brdf_lut::AnalyticFit brdf_fit_{};
+  gl::Texture spare_env_cube_;
+  gl::Texture spare_prefilter_;
+  SH9 prev_irradiance_sh_{};
+  // 1 once the maps of the last switch are fully faded in
+  float fade_{1.f};
+  std::optional<EnvironmentBake> bake_;
+  std::optional<PendingStore> store_;
+  std::array<float, kNumBakeCostSlots> bake_step_cost_ms_{};
+  std::deque<TimingQuery> timing_queries_;
+  std::vector<GLuint> free_queries_;
+
   gl::VertexArray quad_vao_;
   gl::Buffer<PosTexVertex> quad_vbo_;
   gl::Buffer<uint32_t> quad_ebo_;
   GLuint capture_fbo_, capture_rbo_;
-  void Draw(const gl::Texture& tex) const;
+  // tex faded in from prev_tex by blend
+  void Draw(const gl::Texture& tex, const gl::Texture& prev_tex, float blend, float lod) const;
 };
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "AABB.hpp"
+
+struct Sphere {
+  glm::vec3 center;
+  float radius;
+};
+
+// Bounding sphere of the box once transformed, conservative under non-uniform scale.
+inline Sphere TransformedBoundingSphere(const AABB& aabb, const glm::mat4& matrix) {
+  const float max_scale = std::sqrt(std::max({glm::dot(matrix[0], matrix[0]),
+                                              glm::dot(matrix[1], matrix[1]),
+                                              glm::dot(matrix[2], matrix[2])}));
+  const glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+  return Sphere{.center = glm::vec3(matrix * glm::vec4(center, 1.f)),
+                .radius = glm::length(aabb.max - aabb.min) * 0.5f * max_scale};
+}
+
+// Planes face inward: a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum {
+  glm::vec4 planes[6];
+
+  // Gribb-Hartmann extraction, the planes are in the space the matrix transforms from.
+  static Frustum FromViewProjection(const glm::mat4& matrix) {
+    const glm::mat4 rows = glm::transpose(matrix);
+    Frustum frustum{};
+    for (int i = 0; i < 3; i++) {
+      frustum.planes[i * 2] = rows[3] + rows[i];
+      frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4& plane : frustum.planes) {
+      const float length = glm::length(glm::vec3(plane));
+      // infinite projections have no far plane
+      plane = length > 1e-6f ? plane / length : glm::vec4{0, 0, 0, 1};
+    }
+    return frustum;
+  }
+
+  [[nodiscard]] bool Intersects(const Sphere& sphere) const {
+    for (const glm::vec4& plane : planes) {
+      if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) return false;
+    }
+    return true;
+  }
+
+  // Tests the corner of the box furthest along each plane's normal.
+  [[nodiscard]] bool Intersects(const AABB& aabb) const {
+    for (const glm::vec4& plane : planes) {
+      const glm::bvec3 positive = glm::greaterThan(glm::vec3(plane), glm::vec3{0.f});
+      const glm::vec3 corner = glm::mix(aabb.min, aabb.max, positive);
+      if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) return false;
+    }
+    return true;
+  }
+};
@@ -0,0 +1,148 @@
+#include "HalfFloat.hpp"
+
+#include <cstring>
+
+#include "pch.hpp"
+#include "util/ParallelFor.hpp"
+#include "util/ThreadPool.hpp"
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HALF_FLOAT_F16C
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HALF_FLOAT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace half {
+
+namespace {
+
+// floats this many and above round to infinity
+constexpr uint32_t kHalfMax = (127 + 16) << 23;
+// smallest float that is a normal half
+constexpr uint32_t kMinNormal = (127 - 14) << 23;
+// adding this float shifts a subnormal half's mantissa into the low bits, rounded
+constexpr uint32_t kSubnormalMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+// rebiases the exponent and rounds the mantissa, before shifting out the low 13 bits
+constexpr uint32_t kNormalBias = 0xfff - ((127 - 15) << 23);
+
+// floats per block of FromFloatsParallel
+constexpr size_t kBlockSize = 256 * 1024;
+
+#ifdef HALF_FLOAT_SSE2
+// Branchless form of FromFloat on four floats. Lanes hold the half sign extended to 32 bits, so a
+// signed saturating pack keeps them intact.
+__m128i FromFloat4(__m128 f) {
+  const __m128 sign = _mm_and_ps(f, _mm_set1_ps(-0.f));
+  const __m128 abs_f = _mm_xor_ps(f, sign);
+  const __m128i abs_bits = _mm_castps_si128(abs_f);
+  const __m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(abs_f, abs_f));
+  const __m128i is_finite = _mm_cmpgt_epi32(_mm_set1_epi32(kHalfMax), abs_bits);
+  // NaNs keep the top of their payload and are made quiet, like vcvtps2ph
+  const __m128i nan_mantissa = _mm_or_si128(
+      _mm_and_si128(_mm_srli_epi32(abs_bits, 13), _mm_set1_epi32(0x3ff)), _mm_set1_epi32(0x200));
+  const __m128i special =
+      _mm_or_si128(_mm_and_si128(is_nan, nan_mantissa), _mm_set1_epi32(0x7c00));
+
+  const __m128i is_subnormal = _mm_cmpgt_epi32(_mm_set1_epi32(kMinNormal), abs_bits);
+  const __m128i magic = _mm_set1_epi32(kSubnormalMagic);
+  const __m128i subnormal = _mm_sub_epi32(
+      _mm_castps_si128(_mm_add_ps(abs_f, _mm_castsi128_ps(magic))), magic);
+
+  // -1 where the half's mantissa is odd, so ties round to even
+  const __m128i mantissa_odd = _mm_srai_epi32(_mm_slli_epi32(abs_bits, 31 - 13), 31);
+  const __m128i normal = _mm_srli_epi32(
+      _mm_sub_epi32(_mm_add_epi32(abs_bits, _mm_set1_epi32(kNormalBias)), mantissa_odd), 13);
+
+  const __m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal),
+                                      _mm_andnot_si128(is_subnormal, normal));
+  const __m128i magnitude =
+      _mm_or_si128(_mm_and_si128(is_finite, finite), _mm_andnot_si128(is_finite, special));
+  return _mm_or_si128(magnitude, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+#endif
+
+}  // namespace
+
+uint16_t FromFloat(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+  uint32_t result;
+  if (bits >= kHalfMax) {
+    // NaNs keep the top of their payload and are made quiet, like vcvtps2ph
+    result = bits > (255u << 23) ? 0x7e00 | ((bits & 0x7fffff) >> 13) : 0x7c00;
+  } else if (bits < kMinNormal) {
+    float shifted;
+    std::memcpy(&shifted, &bits, sizeof(shifted));
+    float magic;
+    std::memcpy(&magic, &kSubnormalMagic, sizeof(magic));
+    shifted += magic;
+    std::memcpy(&result, &shifted, sizeof(result));
+    result -= kSubnormalMagic;
+  } else {
+    const uint32_t mantissa_odd = (bits >> 13) & 1;
+    result = (bits + kNormalBias + mantissa_odd) >> 13;
+  }
+  return static_cast<uint16_t>(result | (sign >> 16));
+}
+
+void FromFloats(const float* src, uint16_t* dst, size_t count) {
+  size_t i = 0;
+#if defined(HALF_FLOAT_F16C)
+  for (; i + 8 <= count; i += 8) {
+    const __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), halves);
+  }
+#elif defined(HALF_FLOAT_SSE2)
+  for (; i + 8 <= count; i += 8) {
+    const __m128i halves = _mm_packs_epi32(FromFloat4(_mm_loadu_ps(src + i)),
+                                           FromFloat4(_mm_loadu_ps(src + i + 4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), halves);
+  }
+#endif
+  for (; i < count; i++) dst[i] = FromFloat(src[i]);
+}
+
+void FromFloatsParallel(const float* src, uint16_t* dst, size_t count) {
+  ZoneScoped;
+  util::ParallelFor(ThreadPool::Get().thread_pool, count, kBlockSize,
+                    [src, dst](size_t begin, size_t end) {
+                      FromFloats(src + begin, dst + begin, end - begin);
+                    });
+}
+
+float ToFloat(uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1fu;
+  const uint32_t mantissa = value & 0x3ffu;
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+  } else {
+    // zero or subnormal, exactly mantissa * 2^-24
+    const float magnitude = static_cast<float>(mantissa) * 0x1p-24f;
+    std::memcpy(&bits, &magnitude, sizeof(bits));
+    bits |= sign;
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void ToFloats(const uint16_t* src, float* dst, size_t count) {
+  size_t i = 0;
+#if defined(HALF_FLOAT_F16C)
+  for (; i + 8 <= count; i += 8) {
+    const __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(halves));
+  }
+#endif
+  for (; i < count; i++) dst[i] = ToFloat(src[i]);
+}
+
+}  // namespace half
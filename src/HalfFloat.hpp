@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// IEEE 754 binary16 conversion, so float pixels can be uploaded as GL_HALF_FLOAT instead of
+// having the driver convert twice the bytes.
+namespace half {
+
+// Rounds to nearest even. Values past the half range become infinity. NaNs become quiet NaNs with
+// the top 10 bits of their payload, matching F16C's conversion bit for bit.
+[[nodiscard]] uint16_t FromFloat(float value);
+// Four floats per instruction with F16C or SSE2, scalar otherwise.
+void FromFloats(const float* src, uint16_t* dst, size_t count);
+// FromFloats split into blocks shared with the thread pool. The caller converts blocks too, so it
+// can be called from a pool task without waiting on queued work.
+void FromFloatsParallel(const float* src, uint16_t* dst, size_t count);
+
+[[nodiscard]] float ToFloat(uint16_t value);
+// Eight halves per instruction with F16C, scalar otherwise.
+void ToFloats(const uint16_t* src, float* dst, size_t count);
+
+}  // namespace half
@@ -0,0 +1,115 @@
+#include "HdrImage.hpp"
+
+#include <tinyexr.h>
+
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+
+#include "HalfFloat.hpp"
+#include "Image.hpp"
+#include "pch.hpp"
+
+namespace hdr {
+
+namespace {
+
+std::optional<HalfImage> LoadRadiance(const std::string& path, bool flip) {
+  ZoneScoped;
+  Image img;
+  img.LoadFromPathFloat(path, 3, flip);
+  if (!img.data) {
+    spdlog::error("hdr: failed to load {}", path);
+    return std::nullopt;
+  }
+  HalfImage result{.width = img.width, .height = img.height, .rgb = {}};
+  result.rgb.resize(static_cast<size_t>(img.width) * img.height * 3);
+  half::FromFloatsParallel(static_cast<const float*>(img.data), result.rgb.data(),
+                           result.rgb.size());
+  return result;
+}
+
+struct ExrDeleter {
+  void operator()(EXRHeader* header) const { FreeEXRHeader(header); }
+  void operator()(EXRImage* image) const { FreeEXRImage(image); }
+};
+
+std::optional<HalfImage> LoadExr(const std::string& path, bool flip) {
+  ZoneScoped;
+  const auto log_error = [&path](const char* err) {
+    spdlog::error("hdr: failed to load {}: {}", path, err ? err : "unknown error");
+    if (err) FreeEXRErrorMessage(err);
+  };
+  EXRVersion version;
+  if (ParseEXRVersionFromFile(&version, path.c_str()) != TINYEXR_SUCCESS) {
+    log_error(nullptr);
+    return std::nullopt;
+  }
+  if (version.multipart || version.tiled) {
+    spdlog::error("hdr: failed to load {}: {} EXR files are unsupported, save it as a single part "
+                  "scanline file",
+                  path, version.multipart ? "multipart" : "tiled");
+    return std::nullopt;
+  }
+  EXRHeader header;
+  InitEXRHeader(&header);
+  const char* err = nullptr;
+  if (ParseEXRHeaderFromFile(&header, &version, path.c_str(), &err) != TINYEXR_SUCCESS) {
+    log_error(err);
+    return std::nullopt;
+  }
+  std::unique_ptr<EXRHeader, ExrDeleter> header_owner(&header);
+  // float channels are narrowed by tinyexr while decoding, half channels are copied as stored
+  for (int c = 0; c < header.num_channels; c++) {
+    if (header.pixel_types[c] != TINYEXR_PIXELTYPE_UINT) {
+      header.requested_pixel_types[c] = TINYEXR_PIXELTYPE_HALF;
+    }
+  }
+  EXRImage image;
+  InitEXRImage(&image);
+  if (LoadEXRImageFromFile(&image, &header, path.c_str(), &err) != TINYEXR_SUCCESS) {
+    log_error(err);
+    return std::nullopt;
+  }
+  std::unique_ptr<EXRImage, ExrDeleter> image_owner(&image);
+
+  // channels are stored alphabetically, find RGB by name, or Y for greyscale
+  std::array<int, 3> rgb_channels{-1, -1, -1};
+  for (int c = 0; c < header.num_channels; c++) {
+    if (header.requested_pixel_types[c] != TINYEXR_PIXELTYPE_HALF) continue;
+    const char* name = header.channels[c].name;
+    if (std::strcmp(name, "R") == 0) rgb_channels[0] = c;
+    if (std::strcmp(name, "G") == 0) rgb_channels[1] = c;
+    if (std::strcmp(name, "B") == 0) rgb_channels[2] = c;
+    if (std::strcmp(name, "Y") == 0) rgb_channels.fill(c);
+  }
+  if (std::ranges::find(rgb_channels, -1) != rgb_channels.end()) {
+    spdlog::error("hdr: {}: no RGB or Y channels", path);
+    return std::nullopt;
+  }
+
+  HalfImage result{.width = image.width, .height = image.height, .rgb = {}};
+  result.rgb.resize(static_cast<size_t>(image.width) * image.height * 3);
+  for (int y = 0; y < image.height; y++) {
+    const size_t src_row = static_cast<size_t>(flip ? image.height - 1 - y : y) * image.width;
+    uint16_t* dst = &result.rgb[static_cast<size_t>(y) * image.width * 3];
+    for (int c = 0; c < 3; c++) {
+      const auto* src = reinterpret_cast<const uint16_t*>(image.images[rgb_channels[c]]) + src_row;
+      for (int x = 0; x < image.width; x++) dst[x * 3 + c] = src[x];
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+std::optional<HalfImage> LoadHalf(const std::string& path, bool flip) {
+  std::string extension = std::filesystem::path(path).extension().string();
+  std::ranges::transform(extension, extension.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return extension == ".exr" ? LoadExr(path, flip) : LoadRadiance(path, flip);
+}
+
+}  // namespace hdr
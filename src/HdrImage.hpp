@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+// RGB half float pixels, uploaded as GL_RGB16F from GL_HALF_FLOAT data as is.
+struct HalfImage {
+  int width{};
+  int height{};
+  std::vector<uint16_t> rgb;
+};
+
+namespace hdr {
+
+// Loads a Radiance .hdr or OpenEXR file, chosen by extension. Radiance files are decoded to float
+// and converted to half on the thread pool, EXR channels are read as half directly. Alpha is
+// dropped and single channel files are replicated to grey.
+[[nodiscard]] std::optional<HalfImage> LoadHalf(const std::string& path, bool flip);
+
+}  // namespace hdr
@@ -0,0 +1,339 @@
+#include "IblBaker.hpp"
+
+#include <cmath>
+#include <numbers>
+
+#include "HalfFloat.hpp"
+#include "HdrImage.hpp"
+#include "IblParams.hpp"
+#include "pch.hpp"
+#include "util/ParallelFor.hpp"
+#include "util/ThreadPool.hpp"
+
+namespace ibl_baker {
+
+namespace {
+
+constexpr float kPi = std::numbers::pi_v<float>;
+
+// rows converted together on a thread, few enough that the rows' uneven costs balance out
+constexpr size_t kRowsPerBlock = 4;
+constexpr size_t kFloatsPerBlock = size_t{1} << 16;
+
+float RadicalInverseVdC(uint32_t bits) {
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+// GGX half vector of a Hammersley point in tangent space, z along the normal
+glm::vec3 ImportanceSampleGGX(uint32_t i, uint32_t num_samples, float roughness) {
+  const float a = roughness * roughness;
+  const float phi = 2.f * kPi * static_cast<float>(i) / static_cast<float>(num_samples);
+  const float xi_y = RadicalInverseVdC(i);
+  const float cos_theta = std::sqrt((1.f - xi_y) / (1.f + (a * a - 1.f) * xi_y));
+  const float sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+  return {std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta};
+}
+
+// direction through face coordinates uv in [-1,1], as CubeDirection in prefilter.cs.glsl
+glm::vec3 CubeDirection(int face, float u, float v) {
+  switch (face) {
+    case 0:
+      return glm::normalize(glm::vec3{1.f, -v, -u});
+    case 1:
+      return glm::normalize(glm::vec3{-1.f, -v, u});
+    case 2:
+      return glm::normalize(glm::vec3{u, 1.f, v});
+    case 3:
+      return glm::normalize(glm::vec3{u, -1.f, -v});
+    case 4:
+      return glm::normalize(glm::vec3{u, -v, 1.f});
+    default:
+      return glm::normalize(glm::vec3{-u, -v, -1.f});
+  }
+}
+
+// Bilinear lookup with clamp to edge of an interleaved RGB image at texel coordinates whose
+// centers are at i + 0.5.
+glm::vec3 SampleBilinear(const float* rgb, int width, int height, float x, float y) {
+  x -= 0.5f;
+  y -= 0.5f;
+  const float x_floor = std::floor(x);
+  const float y_floor = std::floor(y);
+  const float fx = x - x_floor;
+  const float fy = y - y_floor;
+  const int x0 = std::clamp(static_cast<int>(x_floor), 0, width - 1);
+  const int x1 = std::clamp(static_cast<int>(x_floor) + 1, 0, width - 1);
+  const int y0 = std::clamp(static_cast<int>(y_floor), 0, height - 1);
+  const int y1 = std::clamp(static_cast<int>(y_floor) + 1, 0, height - 1);
+  const auto texel = [rgb, width](int tx, int ty) {
+    const float* p = rgb + (static_cast<size_t>(ty) * width + tx) * 3;
+    return glm::vec3{p[0], p[1], p[2]};
+  };
+  return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), fx),
+                  glm::mix(texel(x0, y1), texel(x1, y1), fx), fy);
+}
+
+// Trilinear lookup of a cube map without seamless filtering, faces chosen as in the GL spec.
+glm::vec3 SampleCube(const CubeMap& cube, glm::vec3 dir, float lod) {
+  const glm::vec3 abs_dir = glm::abs(dir);
+  int face;
+  float sc, tc, ma;
+  if (abs_dir.x >= abs_dir.y && abs_dir.x >= abs_dir.z) {
+    face = dir.x > 0 ? 0 : 1;
+    sc = dir.x > 0 ? -dir.z : dir.z;
+    tc = -dir.y;
+    ma = abs_dir.x;
+  } else if (abs_dir.y >= abs_dir.z) {
+    face = dir.y > 0 ? 2 : 3;
+    sc = dir.x;
+    tc = dir.y > 0 ? dir.z : -dir.z;
+    ma = abs_dir.y;
+  } else {
+    face = dir.z > 0 ? 4 : 5;
+    sc = dir.z > 0 ? dir.x : -dir.x;
+    tc = -dir.y;
+    ma = abs_dir.z;
+  }
+  const float s = 0.5f * (sc / ma + 1.f);
+  const float t = 0.5f * (tc / ma + 1.f);
+  const auto sample_level = [&cube, face, s, t](int level) {
+    const CubeLevel& cube_level = cube[level];
+    const size_t face_floats = static_cast<size_t>(cube_level.size) * cube_level.size * 3;
+    return SampleBilinear(cube_level.rgb.data() + face * face_floats, cube_level.size,
+                          cube_level.size, s * cube_level.size, t * cube_level.size);
+  };
+  lod = std::clamp(lod, 0.f, static_cast<float>(cube.size() - 1));
+  const int level = static_cast<int>(lod);
+  const float frac = lod - static_cast<float>(level);
+  if (frac == 0.f) return sample_level(level);
+  return glm::mix(sample_level(level), sample_level(level + 1), frac);
+}
+
+CubeLevel Downsample(const CubeLevel& src) {
+  CubeLevel dst{.size = std::max(src.size / 2, 1)};
+  dst.rgb.resize(static_cast<size_t>(dst.size) * dst.size * 3 * 6);
+  const auto downsample_rows = [&src, &dst](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; row++) {
+      const size_t face = row / dst.size;
+      const size_t y = row % dst.size;
+      const float* src_face = src.rgb.data() + face * src.size * src.size * 3;
+      float* dst_row = dst.rgb.data() + (face * dst.size + y) * dst.size * 3;
+      const float* row0 = src_face + (2 * y) * src.size * 3;
+      const float* row1 = row0 + src.size * 3;
+      for (int x = 0; x < dst.size; x++) {
+        for (int c = 0; c < 3; c++) {
+          dst_row[x * 3 + c] = 0.25f * (row0[x * 6 + c] + row0[x * 6 + 3 + c] +
+                                        row1[x * 6 + c] + row1[x * 6 + 3 + c]);
+        }
+      }
+    }
+  };
+  util::ParallelFor(ThreadPool::Get().thread_pool, static_cast<size_t>(dst.size) * 6,
+                    kRowsPerBlock, downsample_rows);
+  return dst;
+}
+
+// Samples of a prefilter mip in tangent space. V = N, so every texel's lobe is the same one
+// rotated, and directions, weights and PDF based lods are computed once per mip.
+struct LobeSamples {
+  // light directions as separate arrays so the rotation into a texel's frame vectorizes
+  std::vector<float> x, y, z;
+  std::vector<float> lod;
+  float total_weight{};
+};
+
+LobeSamples MakeLobeSamples(float roughness, int num_samples) {
+  LobeSamples samples;
+  const float env_size = static_cast<float>(ibl::kEnvCubeDims.x);
+  // solid angle of a base level texel of the environment
+  const float sa_texel = 4.f * kPi / (6.f * env_size * env_size);
+  const float a2 = roughness * roughness * roughness * roughness;
+  for (int i = 0; i < num_samples; i++) {
+    const glm::vec3 h = ImportanceSampleGGX(i, num_samples, roughness);
+    // reflect V = (0, 0, 1) about h
+    const glm::vec3 l = glm::vec3{2.f * h.z * h.x, 2.f * h.z * h.y, 2.f * h.z * h.z - 1.f};
+    if (l.z <= 0.f) continue;
+    const float n_dot_h = h.z;
+    const float denom = n_dot_h * n_dot_h * (a2 - 1.f) + 1.f;
+    const float distribution = a2 / (kPi * denom * denom);
+    // HdotV = NdotH
+    const float pdf = distribution * n_dot_h / (4.f * n_dot_h) + 0.0001f;
+    const float sa_sample = 1.f / (static_cast<float>(num_samples) * pdf + 0.0001f);
+    samples.x.push_back(l.x);
+    samples.y.push_back(l.y);
+    samples.z.push_back(l.z);
+    samples.lod.push_back(0.5f * std::log2(sa_sample / sa_texel) + 1.f);
+    samples.total_weight += l.z;
+  }
+  return samples;
+}
+
+CubeLevel PrefilterLevel(const CubeMap& env, int size, float roughness, int num_samples) {
+  CubeLevel dst{.size = size};
+  dst.rgb.resize(static_cast<size_t>(size) * size * 3 * 6);
+  const LobeSamples samples = MakeLobeSamples(roughness, num_samples);
+  // a mirror lobe is the environment filtered down to this level's resolution
+  const float mirror_lod = std::log2(static_cast<float>(env[0].size) / static_cast<float>(size));
+  const auto prefilter_rows = [&, size, roughness](size_t begin, size_t end) {
+    const size_t num_lobe_samples = samples.x.size();
+    std::vector<float> world_x(num_lobe_samples), world_y(num_lobe_samples),
+        world_z(num_lobe_samples);
+    for (size_t row = begin; row < end; row++) {
+      const int face = static_cast<int>(row / size);
+      const int y = static_cast<int>(row % size);
+      float* dst_row = dst.rgb.data() + row * size * 3;
+      for (int x = 0; x < size; x++) {
+        const float u = (static_cast<float>(x) + 0.5f) / static_cast<float>(size) * 2.f - 1.f;
+        const float v = (static_cast<float>(y) + 0.5f) / static_cast<float>(size) * 2.f - 1.f;
+        const glm::vec3 n = CubeDirection(face, u, v);
+        glm::vec3 color{0};
+        if (roughness == 0.f) {
+          color = SampleCube(env, n, mirror_lod);
+        } else {
+          const glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3{0, 0, 1} : glm::vec3{1, 0, 0};
+          const glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+          const glm::vec3 bitangent = glm::cross(n, tangent);
+          for (size_t i = 0; i < num_lobe_samples; i++) {
+            const float sx = samples.x[i];
+            const float sy = samples.y[i];
+            const float sz = samples.z[i];
+            world_x[i] = tangent.x * sx + bitangent.x * sy + n.x * sz;
+            world_y[i] = tangent.y * sx + bitangent.y * sy + n.y * sz;
+            world_z[i] = tangent.z * sx + bitangent.z * sy + n.z * sz;
+          }
+          for (size_t i = 0; i < num_lobe_samples; i++) {
+            color += SampleCube(env, {world_x[i], world_y[i], world_z[i]}, samples.lod[i]) *
+                     samples.z[i];
+          }
+          color /= samples.total_weight;
+        }
+        dst_row[x * 3 + 0] = color.r;
+        dst_row[x * 3 + 1] = color.g;
+        dst_row[x * 3 + 2] = color.b;
+      }
+    }
+  };
+  util::ParallelFor(ThreadPool::Get().thread_pool, static_cast<size_t>(size) * 6, kRowsPerBlock,
+                    prefilter_rows);
+  return dst;
+}
+
+}  // namespace
+
+CubeMap EquirectToCube(const HalfImage& equirect) {
+  ZoneScoped;
+  std::vector<float> src(equirect.rgb.size());
+  const auto to_floats = [&equirect, &src](size_t begin, size_t end) {
+    half::ToFloats(equirect.rgb.data() + begin, src.data() + begin, end - begin);
+  };
+  util::ParallelFor(ThreadPool::Get().thread_pool, src.size(), kFloatsPerBlock, to_floats);
+
+  CubeMap cube(1);
+  const int size = ibl::kEnvCubeDims.x;
+  cube[0].size = size;
+  cube[0].rgb.resize(static_cast<size_t>(size) * size * 3 * 6);
+  const auto project_rows = [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; row++) {
+      const int face = static_cast<int>(row / size);
+      const int y = static_cast<int>(row % size);
+      float* dst_row = cube[0].rgb.data() + row * size * 3;
+      for (int x = 0; x < size; x++) {
+        const float u = (static_cast<float>(x) + 0.5f) / static_cast<float>(size) * 2.f - 1.f;
+        const float v = (static_cast<float>(y) + 0.5f) / static_cast<float>(size) * 2.f - 1.f;
+        const glm::vec3 dir = CubeDirection(face, u, v);
+        // rows are flipped on load, so v = elevation / PI + 0.5 increases with the row
+        const float equirect_u = std::atan2(dir.z, dir.x) / (2.f * kPi) + 0.5f;
+        const float equirect_v = std::asin(std::clamp(dir.y, -1.f, 1.f)) / kPi + 0.5f;
+        const glm::vec3 color =
+            SampleBilinear(src.data(), equirect.width, equirect.height,
+                           equirect_u * equirect.width, equirect_v * equirect.height);
+        dst_row[x * 3 + 0] = color.r;
+        dst_row[x * 3 + 1] = color.g;
+        dst_row[x * 3 + 2] = color.b;
+      }
+    }
+  };
+  util::ParallelFor(ThreadPool::Get().thread_pool, static_cast<size_t>(size) * 6, kRowsPerBlock,
+                    project_rows);
+  while (cube.back().size > 1) cube.push_back(Downsample(cube.back()));
+  return cube;
+}
+
+CubeMap Prefilter(const CubeMap& env) {
+  ZoneScoped;
+  CubeMap prefilter;
+  for (uint32_t mip = 0; mip < ibl::kPrefilterMipLevels; mip++) {
+    const float roughness =
+        static_cast<float>(mip) / static_cast<float>(ibl::kPrefilterMipLevels - 1);
+    prefilter.push_back(PrefilterLevel(env, std::max(ibl::kPrefilterDims.x >> mip, 1),
+                                       roughness, ibl::kPrefilterSampleCounts[mip]));
+  }
+  return prefilter;
+}
+
+IblMap BrdfLut() {
+  ZoneScoped;
+  const glm::ivec2 dims = ibl::kBrdfLookupDims;
+  const uint32_t num_samples = ibl::kBrdfSampleCount;
+  IblMap lut{.dims = dims, .num_faces = 1, .internal_format = GL_RG16};
+  std::vector<uint8_t>& data = lut.levels.emplace_back(static_cast<size_t>(dims.x) * dims.y * 4);
+  // rows are roughness, so a row's half vectors are shared by every NdotV in it
+  const auto integrate_rows = [&](size_t begin, size_t end) {
+    std::vector<float> h_x(num_samples), h_z(num_samples);
+    for (size_t row = begin; row < end; row++) {
+      const float roughness = (static_cast<float>(row) + 0.5f) / static_cast<float>(dims.y);
+      const float k = roughness * roughness / 2.f;
+      for (uint32_t i = 0; i < num_samples; i++) {
+        const glm::vec3 h = ImportanceSampleGGX(i, num_samples, roughness);
+        // V has no y component, so H.y never contributes
+        h_x[i] = h.x;
+        h_z[i] = h.z;
+      }
+      auto* dst = reinterpret_cast<uint16_t*>(data.data()) + row * dims.x * 2;
+      for (int x = 0; x < dims.x; x++) {
+        const float n_dot_v = (static_cast<float>(x) + 0.5f) / static_cast<float>(dims.x);
+        const float v_x = std::sqrt(1.f - n_dot_v * n_dot_v);
+        const float g_v = n_dot_v / (n_dot_v * (1.f - k) + k);
+        float a = 0.f;
+        float b = 0.f;
+        // branch free so the loop vectorizes
+        for (uint32_t i = 0; i < num_samples; i++) {
+          const float v_dot_h = std::max(v_x * h_x[i] + n_dot_v * h_z[i], 0.f);
+          const float n_dot_l = 2.f * v_dot_h * h_z[i] - n_dot_v;
+          const float clamped_n_dot_l = std::max(n_dot_l, 0.f);
+          const float g_l = clamped_n_dot_l / (clamped_n_dot_l * (1.f - k) + k);
+          const float g_vis = g_v * g_l * v_dot_h / (h_z[i] * n_dot_v);
+          const float one_minus = 1.f - v_dot_h;
+          const float fc = one_minus * one_minus * one_minus * one_minus * one_minus;
+          const float weight = n_dot_l > 0.f ? g_vis : 0.f;
+          a += (1.f - fc) * weight;
+          b += fc * weight;
+        }
+        a /= static_cast<float>(num_samples);
+        b /= static_cast<float>(num_samples);
+        dst[x * 2 + 0] = static_cast<uint16_t>(std::lround(std::clamp(a, 0.f, 1.f) * 65535.f));
+        dst[x * 2 + 1] = static_cast<uint16_t>(std::lround(std::clamp(b, 0.f, 1.f) * 65535.f));
+      }
+    }
+  };
+  util::ParallelFor(ThreadPool::Get().thread_pool, dims.y, kRowsPerBlock, integrate_rows);
+  return lut;
+}
+
+IblMap ToIblMap(const CubeMap& cube, uint32_t num_levels) {
+  ZoneScoped;
+  IblMap map{.dims = glm::ivec2{cube[0].size}, .num_faces = 6, .internal_format = GL_RGB16F};
+  for (uint32_t level = 0; level < num_levels; level++) {
+    const std::vector<float>& rgb = cube[level].rgb;
+    std::vector<uint8_t>& data = map.levels.emplace_back(rgb.size() * sizeof(uint16_t));
+    half::FromFloatsParallel(rgb.data(), reinterpret_cast<uint16_t*>(data.data()), rgb.size());
+  }
+  return map;
+}
+
+}  // namespace ibl_baker
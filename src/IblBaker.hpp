@@ -0,0 +1,29 @@
+#pragma once
+
+#include "IblCache.hpp"
+
+struct HalfImage;
+
+// CPU implementation of CubeMapConverter's bake, for machines without a GPU. It follows the bake
+// shaders with the parameters in IblParams.hpp and splits the work across the thread pool, so it
+// must not be called from a pool task.
+namespace ibl_baker {
+
+// An RGB float cube map level, the six size x size faces in GL order.
+struct CubeLevel {
+  int size{};
+  std::vector<float> rgb{};
+};
+using CubeMap = std::vector<CubeLevel>;
+
+// Bilinear lookups of the equirectangular image like equirectangular_to_cube.fs.glsl, followed
+// by a box filtered mip chain like glGenerateTextureMipmap.
+[[nodiscard]] CubeMap EquirectToCube(const HalfImage& equirect);
+// Same sampling as prefilter.cs.glsl. env needs its full mip chain.
+[[nodiscard]] CubeMap Prefilter(const CubeMap& env);
+// Same integration as brdf.fs.glsl, as GL_RG16.
+[[nodiscard]] IblMap BrdfLut();
+// The first num_levels levels as GL_RGB16F.
+[[nodiscard]] IblMap ToIblMap(const CubeMap& cube, uint32_t num_levels);
+
+}  // namespace ibl_baker
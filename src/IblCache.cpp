@@ -0,0 +1,214 @@
+#include "IblCache.hpp"
+
+#include <ktx.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "IblParams.hpp"
+#include "Path.hpp"
+#include "pch.hpp"
+#include "util/Hash.hpp"
+
+namespace ibl_cache {
+
+namespace {
+
+// VkFormat values, libktx doesn't install vkformat_enum.h
+enum VkFormat : uint32_t {
+  kR16G16Unorm = 77,
+  kR16G16B16Sfloat = 90,
+  kR32G32B32Sfloat = 106,
+};
+
+std::optional<uint32_t> VkFormatFromGL(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_RG16:
+      return kR16G16Unorm;
+    case GL_RGB16F:
+      return kR16G16B16Sfloat;
+    case GL_RGB32F:
+      return kR32G32B32Sfloat;
+    default:
+      return std::nullopt;
+  }
+}
+
+std::optional<GLenum> GLFormatFromVk(uint32_t vk_format) {
+  switch (vk_format) {
+    case kR16G16Unorm:
+      return GL_RG16;
+    case kR16G16B16Sfloat:
+      return GL_RGB16F;
+    case kR32G32B32Sfloat:
+      return GL_RGB32F;
+    default:
+      return std::nullopt;
+  }
+}
+
+struct KtxTextureDeleter {
+  void operator()(ktxTexture2* texture) const { ktxTexture_Destroy(ktxTexture(texture)); }
+};
+
+// irradiance SH coefficients are cached as a row of RGB32F texels
+constexpr glm::ivec2 kSHMapDims = {9, 1};
+
+std::filesystem::path CachePath(size_t key, std::string_view name) {
+  return std::filesystem::path(GET_PATH(".cache/ibl")) / fmt::format("{:016x}_{}.ktx2", key, name);
+}
+
+bool Matches(const IblMap& map, glm::ivec2 dims, uint32_t num_faces, GLenum internal_format,
+             uint32_t num_levels) {
+  return map.dims == dims && map.num_faces == num_faces &&
+         map.internal_format == internal_format && map.levels.size() == num_levels;
+}
+
+}  // namespace
+
+std::optional<size_t> HashFile(const std::string& path) {
+  ZoneScoped;
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) return std::nullopt;
+  std::vector<char> bytes(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  if (!file) return std::nullopt;
+  return util::HashBytes(bytes.data(), bytes.size());
+}
+
+std::optional<IblMap> Load(size_t key, std::string_view name) {
+  ZoneScoped;
+  const std::filesystem::path path = CachePath(key, name);
+  std::error_code ec;
+  if (!std::filesystem::exists(path, ec)) return std::nullopt;
+  ktxTexture2* raw_texture{};
+  KTX_error_code result = ktxTexture2_CreateFromNamedFile(
+      path.string().c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &raw_texture);
+  if (result != KTX_SUCCESS) {
+    spdlog::warn("ibl cache: failed to load {}: {}", path.string(), ktxErrorString(result));
+    return std::nullopt;
+  }
+  std::unique_ptr<ktxTexture2, KtxTextureDeleter> texture(raw_texture);
+  const std::optional<GLenum> internal_format = GLFormatFromVk(texture->vkFormat);
+  if (!internal_format || texture->numDimensions != 2 || texture->isArray) {
+    spdlog::warn("ibl cache: unexpected layout in {}", path.string());
+    return std::nullopt;
+  }
+
+  IblMap map{.dims = glm::ivec2{texture->baseWidth, texture->baseHeight},
+             .num_faces = texture->numFaces,
+             .internal_format = internal_format.value()};
+  map.levels.resize(texture->numLevels);
+  const ktx_uint8_t* data = ktxTexture_GetData(ktxTexture(texture.get()));
+  for (ktx_uint32_t level = 0; level < texture->numLevels; level++) {
+    // size of one face of the level
+    const size_t face_size = ktxTexture_GetImageSize(ktxTexture(texture.get()), level);
+    map.levels[level].resize(face_size * map.num_faces);
+    for (ktx_uint32_t face = 0; face < map.num_faces; face++) {
+      ktx_size_t offset;
+      ktxTexture_GetImageOffset(ktxTexture(texture.get()), level, 0, face, &offset);
+      std::memcpy(map.levels[level].data() + face * face_size, data + offset, face_size);
+    }
+  }
+  return map;
+}
+
+void Store(size_t key, std::string_view name, const IblMap& map) {
+  ZoneScoped;
+  const std::optional<uint32_t> vk_format = VkFormatFromGL(map.internal_format);
+  if (!vk_format) {
+    spdlog::error("ibl cache: unsupported internal format {}", map.internal_format);
+    return;
+  }
+  ktxTextureCreateInfo create_info{};
+  create_info.vkFormat = vk_format.value();
+  create_info.baseWidth = map.dims.x;
+  create_info.baseHeight = map.dims.y;
+  create_info.baseDepth = 1;
+  create_info.numDimensions = 2;
+  create_info.numLevels = static_cast<ktx_uint32_t>(map.levels.size());
+  create_info.numLayers = 1;
+  create_info.numFaces = map.num_faces;
+  create_info.isArray = KTX_FALSE;
+  create_info.generateMipmaps = KTX_FALSE;
+  ktxTexture2* raw_texture{};
+  KTX_error_code result =
+      ktxTexture2_Create(&create_info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &raw_texture);
+  if (result != KTX_SUCCESS) {
+    spdlog::error("ibl cache: failed to create texture: {}", ktxErrorString(result));
+    return;
+  }
+  std::unique_ptr<ktxTexture2, KtxTextureDeleter> texture(raw_texture);
+  for (ktx_uint32_t level = 0; level < create_info.numLevels; level++) {
+    const size_t face_size = map.levels[level].size() / map.num_faces;
+    for (ktx_uint32_t face = 0; face < map.num_faces; face++) {
+      ktxTexture_SetImageFromMemory(ktxTexture(texture.get()), level, 0, face,
+                                    map.levels[level].data() + face * face_size, face_size);
+    }
+  }
+
+  const std::filesystem::path path = CachePath(key, name);
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  if (ec) {
+    spdlog::error("ibl cache: failed to create {}: {}", path.parent_path().string(), ec.message());
+    return;
+  }
+  // write then rename so concurrent loaders never read a partial entry
+  std::filesystem::path tmp_path = path;
+  tmp_path += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  result = ktxTexture_WriteToNamedFile(ktxTexture(texture.get()), tmp_path.string().c_str());
+  if (result != KTX_SUCCESS) {
+    spdlog::error("ibl cache: failed to write {}: {}", tmp_path.string(), ktxErrorString(result));
+    std::filesystem::remove(tmp_path, ec);
+    return;
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) std::filesystem::remove(tmp_path, ec);
+}
+
+size_t EnvironmentKey(size_t hdr_hash) {
+  size_t key = hdr_hash;
+  util::HashCombine(key, ibl::kBakeVersion);
+  for (glm::ivec2 map_dims : {ibl::kEnvCubeDims, ibl::kPrefilterDims}) {
+    util::HashCombine(key, map_dims.x);
+    util::HashCombine(key, map_dims.y);
+  }
+  for (int sample_count : ibl::kPrefilterSampleCounts) util::HashCombine(key, sample_count);
+  return key;
+}
+
+std::optional<BakedEnvironment> LoadEnvironment(size_t key) {
+  ZoneScoped;
+  std::optional<IblMap> env_cube = Load(key, "env");
+  std::optional<IblMap> irradiance_sh = Load(key, "irradiance_sh");
+  std::optional<IblMap> prefilter = Load(key, "prefilter");
+  if (!env_cube || !irradiance_sh || !prefilter ||
+      !Matches(*env_cube, ibl::kEnvCubeDims, 6, GL_RGB16F, 1) ||
+      !Matches(*irradiance_sh, kSHMapDims, 1, GL_RGB32F, 1) ||
+      !Matches(*prefilter, ibl::kPrefilterDims, 6, GL_RGB16F, ibl::kPrefilterMipLevels)) {
+    return std::nullopt;
+  }
+  BakedEnvironment baked{.env_cube = std::move(env_cube.value()),
+                         .prefilter = std::move(prefilter.value())};
+  std::memcpy(baked.irradiance_sh.coeffs.data(), irradiance_sh->levels[0].data(),
+              sizeof(baked.irradiance_sh.coeffs));
+  return baked;
+}
+
+void StoreEnvironment(size_t key, const BakedEnvironment& baked) {
+  ZoneScoped;
+  const auto* coeffs = reinterpret_cast<const uint8_t*>(baked.irradiance_sh.coeffs.data());
+  const IblMap irradiance_sh{.dims = kSHMapDims,
+                             .num_faces = 1,
+                             .internal_format = GL_RGB32F,
+                             .levels = {{coeffs, coeffs + sizeof(baked.irradiance_sh.coeffs)}}};
+  Store(key, "env", baked.env_cube);
+  Store(key, "irradiance_sh", irradiance_sh);
+  Store(key, "prefilter", baked.prefilter);
+}
+
+}  // namespace ibl_cache
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <string_view>
+
+#include "SphericalHarmonics.hpp"
+
+// A baked IBL map in client memory, read back after baking or loaded from the cache.
+struct IblMap {
+  glm::ivec2 dims{};
+  // 6 for cube maps, 1 for 2D textures
+  uint32_t num_faces{};
+  GLenum internal_format{};
+  // faces of each level tightly packed in GL face order, from level 0 down
+  std::vector<std::vector<uint8_t>> levels{};
+};
+
+// The environment dependent maps, as RGB halves. The BRDF LUT is generated at build time, see
+// BrdfLut.hpp.
+struct BakedEnvironment {
+  IblMap env_cube{};
+  SH9 irradiance_sh{};
+  IblMap prefilter{};
+};
+
+// Baked IBL maps persisted as KTX2 files, so the convolutions are paid once per environment.
+// Keys combine the source HDR's file hash with every parameter that affects the bake.
+namespace ibl_cache {
+
+// Hash of the file's bytes, nullopt if it can't be read.
+[[nodiscard]] std::optional<size_t> HashFile(const std::string& path);
+
+// name distinguishes the maps baked under one key. Only GL_RGB16F, GL_RG16 and GL_RGB32F are
+// supported.
+[[nodiscard]] std::optional<IblMap> Load(size_t key, std::string_view name);
+void Store(size_t key, std::string_view name, const IblMap& map);
+
+// Key of an environment's bake, from the hash of its source HDR file and the bake parameters.
+[[nodiscard]] size_t EnvironmentKey(size_t hdr_hash);
+// nullopt unless every map is present with the layout of the current bake parameters.
+[[nodiscard]] std::optional<BakedEnvironment> LoadEnvironment(size_t key);
+void StoreEnvironment(size_t key, const BakedEnvironment& baked);
+
+}  // namespace ibl_cache
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <array>
+#include <glm/vec2.hpp>
+
+// Parameters of the IBL bake, shared by the GPU bake in CubeMapConverter, the offline CPU baker,
+// the BRDF LUT generator and the cache keys.
+namespace ibl {
+
+constexpr glm::ivec2 kEnvCubeDims = {1024, 1024};
+constexpr glm::ivec2 kPrefilterDims = {256, 256};
+constexpr uint32_t kPrefilterMipLevels = 6;
+// GGX samples per texel of each prefilter mip. Sampling the environment's mips by the PDF keeps
+// wide lobes smooth with few samples, and mip 0 is a mirror lobe that needs only one.
+constexpr std::array<int, kPrefilterMipLevels> kPrefilterSampleCounts = {1, 64, 128, 192, 256, 256};
+// the BRDF LUT is generated at build time by brdf_lut_gen, its size is set by PBR_BRDF_LUT_SIZE
+#ifndef BRDF_LUT_SIZE
+#define BRDF_LUT_SIZE 128
+#endif
+constexpr glm::ivec2 kBrdfLookupDims = {BRDF_LUT_SIZE, BRDF_LUT_SIZE};
+// must match brdf.fs.glsl
+constexpr int kBrdfSampleCount = 1024;
+// bump when either baker's output changes to invalidate cached maps
+constexpr size_t kBakeVersion = 3;
+
+}  // namespace ibl
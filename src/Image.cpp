@@ -1,5 +1,14 @@
 #include "Image.hpp"
 
+#include <fstream>
+
+#include "ImageBufferPool.hpp"
+#include "ImageDecoder.hpp"
+
+// decode buffers come from the pool, so they are reused across images and models
+#define STBI_MALLOC(size) image_pool::Allocate(size)
+#define STBI_REALLOC(ptr, size) image_pool::Reallocate(ptr, size)
+#define STBI_FREE(ptr) image_pool::Free(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image/stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -12,50 +21,62 @@ Image::Image(const std::span<uint8_t>& bytes, int req_components) {
   LoadFromMemory(bytes, req_components);
 }
 
-// Image::Image(Image&& other) noexcept
-//     : data(std::exchange(other.data, nullptr)),
-//       width(std::exchange(other.width, 0)),
-//       height(std::exchange(other.height, 0)),
-//       channels(std::exchange(other.channels, 0)) {}
-//
-// Image& Image::operator=(Image&& other) noexcept {
-//   data = std::exchange(other.data, nullptr);
-//   width = std::exchange(other.width, 0);
-//   height = std::exchange(other.height, 0);
-//   channels = std::exchange(other.channels, 0);
-//   return *this;
-// }
+Image::~Image() { Free(); }
+
+Image::Image(Image&& other) noexcept
+    : data(std::exchange(other.data, nullptr)),
+      width(std::exchange(other.width, 0)),
+      height(std::exchange(other.height, 0)),
+      channels(std::exchange(other.channels, 0)) {}
+
+Image& Image::operator=(Image&& other) noexcept {
+  if (&other == this) return *this;
+  Free();
+  data = std::exchange(other.data, nullptr);
+  width = std::exchange(other.width, 0);
+  height = std::exchange(other.height, 0);
+  channels = std::exchange(other.channels, 0);
+  return *this;
+}
 
 void Image::LoadFromPathFloat(const std::string& path, int req_components, bool flip) {
-  if (flip) stbi_set_flip_vertically_on_load_thread(flip);
-  data = stbi_loadf(path.data(), &width, &height, &channels, req_components);
+  Free();
+  stbi_set_flip_vertically_on_load_thread(flip);
+  int file_channels;
+  float* pixels = stbi_loadf(path.data(), &width, &height, &file_channels, req_components);
+  if (!pixels) {
+    Free();
+    return;
+  }
+  data = pixels;
+  channels = req_components ? req_components : file_channels;
 }
 
 void Image::LoadFromPath(const std::string& path, int req_components, bool flip) {
-  if (flip) stbi_set_flip_vertically_on_load_thread(flip);
-  data = stbi_load(path.data(), &width, &height, &channels, req_components);
+  Free();
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) return;
+  std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  if (!file) return;
+  *this = image_decoder::Decode(bytes, req_components, flip);
 }
 
 void Image::LoadFromMemory(const std::span<uint8_t>& bytes, int req_components) {
-  data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()),
-                               static_cast<int>(bytes.size_bytes()), &width, &height, &channels,
-                               req_components);
+  *this = image_decoder::Decode(bytes, req_components, false);
 }
 
 void Image::LoadFromMemory(unsigned char* bytes, size_t size_bytes, int req_components) {
-  data =
-      stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes), static_cast<int>(size_bytes),
-                            &width, &height, &channels, req_components);
+  *this = image_decoder::Decode(std::span<const uint8_t>(bytes, size_bytes), req_components, false);
 }
 
 Image::Image(unsigned char* bytes, size_t size_bytes, int req_components) {
-  data =
-      stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes), static_cast<int>(size_bytes),
-                            &width, &height, &channels, req_components);
+  LoadFromMemory(bytes, size_bytes, req_components);
 }
 
 void Image::Free() {
-  if (data) stbi_image_free(data);
+  image_pool::Free(data);
   data = nullptr;
   width = 0;
   height = 0;
@@ -2,20 +2,28 @@
 
 #include <span>
 
+// Non-owning view of decoded pixels.
+struct ImageView {
+  const void* data;
+  int width, height, channels;
+};
+
+// Decoded pixels, allocated from the image buffer pool and returned to it on destruction.
 struct Image {
   explicit Image(const std::string& path, int req_components, bool flip = true);
   explicit Image(const std::span<uint8_t>& bytes, int req_components);
   explicit Image(unsigned char* bytes, size_t size_bytes, int req_components);
-  Image(void* data, int width, int height, int channels)
-      : data(data), width(width), height(height), channels(channels) {}
   Image() = default;
-  // Image(const Image& other) = delete;
-  // Image& operator=(const Image& other) = delete;
-  // Image(Image&& other) noexcept;
-  // Image& operator=(Image&& other) noexcept;
+  ~Image();
+  Image(const Image& other) = delete;
+  Image& operator=(const Image& other) = delete;
+  Image(Image&& other) noexcept;
+  Image& operator=(Image&& other) noexcept;
 
   void Free();
+  [[nodiscard]] ImageView View() const { return {data, width, height, channels}; }
   void* data{};
+  // channels of the decoded data: the requested component count, or the file's if 0 was requested
   int width{}, height{}, channels{};
   void LoadFromPath(const std::string& path, int req_components, bool flip = true);
   void LoadFromPathFloat(const std::string& path, int req_components, bool flip = true);
@@ -0,0 +1,157 @@
+#include "ImageBufferPool.hpp"
+
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "pch.hpp"
+
+namespace image_pool {
+
+namespace {
+
+// decoders make many small allocations for tables and rows, those go straight to the heap
+constexpr size_t kMinPooledSize = 64 * 1024;
+constexpr uint32_t kClassesPerOctave = 4;
+constexpr uint32_t kNumClasses = 64 * kClassesPerOctave;
+constexpr uint32_t kUnpooled = UINT32_MAX;
+
+// precedes every block, 16 bytes keeps the data as aligned as malloc's
+struct alignas(16) Header {
+  size_t size_bytes;
+  uint32_t size_class;
+};
+
+struct Pool {
+  std::mutex mutex;
+  std::array<std::vector<Header*>, kNumClasses> free_blocks;
+  size_t retained_bytes{};
+  size_t max_retained_bytes{512ull * 1024 * 1024};
+  size_t reused_blocks{};
+  size_t allocated_blocks{};
+};
+
+Pool& GetPool() {
+  static Pool pool;
+  return pool;
+}
+
+// Rounds up to the next of 4 evenly spaced sizes per power of two, wasting at most 25%.
+size_t ClassSize(size_t size_bytes, uint32_t& size_class) {
+  const int octave = std::bit_width(size_bytes) - 1;
+  const size_t step = size_t{1} << (octave - 2);
+  const size_t rounded = (size_bytes + step - 1) & ~(step - 1);
+  const int rounded_octave = std::bit_width(rounded) - 1;
+  size_class = rounded_octave * kClassesPerOctave +
+               static_cast<uint32_t>(rounded >> (rounded_octave - 2)) - kClassesPerOctave;
+  return rounded;
+}
+
+size_t ClassBytes(uint32_t size_class) {
+  const uint32_t octave = size_class / kClassesPerOctave;
+  return size_t{kClassesPerOctave + size_class % kClassesPerOctave} << (octave - 2);
+}
+
+void* ToData(Header* header) { return header + 1; }
+
+Header* ToHeader(void* ptr) { return static_cast<Header*>(ptr) - 1; }
+
+}  // namespace
+
+void* Allocate(size_t size_bytes) {
+  const size_t total_bytes = size_bytes + sizeof(Header);
+  if (total_bytes < kMinPooledSize) {
+    auto* header = static_cast<Header*>(std::malloc(total_bytes));
+    if (!header) return nullptr;
+    *header = Header{.size_bytes = size_bytes, .size_class = kUnpooled};
+    return ToData(header);
+  }
+
+  uint32_t size_class;
+  const size_t block_bytes = ClassSize(total_bytes, size_class);
+  Pool& pool = GetPool();
+  {
+    std::lock_guard lock(pool.mutex);
+    std::vector<Header*>& free_blocks = pool.free_blocks[size_class];
+    if (!free_blocks.empty()) {
+      Header* header = free_blocks.back();
+      free_blocks.pop_back();
+      pool.retained_bytes -= block_bytes;
+      pool.reused_blocks++;
+      header->size_bytes = size_bytes;
+      return ToData(header);
+    }
+    pool.allocated_blocks++;
+  }
+  auto* header = static_cast<Header*>(std::malloc(block_bytes));
+  if (!header) return nullptr;
+  *header = Header{.size_bytes = size_bytes, .size_class = size_class};
+  return ToData(header);
+}
+
+void* Reallocate(void* ptr, size_t size_bytes) {
+  if (!ptr) return Allocate(size_bytes);
+  Header* header = ToHeader(ptr);
+  if (header->size_class != kUnpooled) {
+    uint32_t size_class;
+    ClassSize(size_bytes + sizeof(Header), size_class);
+    // still fits its block
+    if (size_class <= header->size_class) {
+      header->size_bytes = size_bytes;
+      return ptr;
+    }
+  }
+  void* result = Allocate(size_bytes);
+  if (!result) return nullptr;
+  std::memcpy(result, ptr, std::min(header->size_bytes, size_bytes));
+  Free(ptr);
+  return result;
+}
+
+void Free(void* ptr) {
+  if (!ptr) return;
+  Header* header = ToHeader(ptr);
+  if (header->size_class == kUnpooled) {
+    std::free(header);
+    return;
+  }
+  const size_t block_bytes = ClassBytes(header->size_class);
+  Pool& pool = GetPool();
+  {
+    std::lock_guard lock(pool.mutex);
+    if (pool.retained_bytes + block_bytes <= pool.max_retained_bytes) {
+      pool.free_blocks[header->size_class].push_back(header);
+      pool.retained_bytes += block_bytes;
+      return;
+    }
+  }
+  std::free(header);
+}
+
+void Trim() {
+  Pool& pool = GetPool();
+  std::lock_guard lock(pool.mutex);
+  for (std::vector<Header*>& free_blocks : pool.free_blocks) {
+    for (Header* header : free_blocks) std::free(header);
+    free_blocks.clear();
+  }
+  pool.retained_bytes = 0;
+}
+
+void SetMaxRetainedBytes(size_t bytes) {
+  Pool& pool = GetPool();
+  std::lock_guard lock(pool.mutex);
+  pool.max_retained_bytes = bytes;
+}
+
+Stats GetStats() {
+  Pool& pool = GetPool();
+  std::lock_guard lock(pool.mutex);
+  return Stats{.retained_bytes = pool.retained_bytes,
+               .reused_blocks = pool.reused_blocks,
+               .allocated_blocks = pool.allocated_blocks};
+}
+
+}  // namespace image_pool
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+// Allocator behind image decoding. Large blocks are rounded up to quarter power of two size
+// classes and kept on per class free lists when released, so decoding the textures of the next
+// model reuses them instead of going back to the heap. Thread safe, decodes run on workers.
+namespace image_pool {
+
+struct Stats {
+  size_t retained_bytes;
+  size_t reused_blocks;
+  size_t allocated_blocks;
+};
+
+[[nodiscard]] void* Allocate(size_t size_bytes);
+[[nodiscard]] void* Reallocate(void* ptr, size_t size_bytes);
+void Free(void* ptr);
+// Returns every retained block to the heap.
+void Trim();
+// Blocks released past this many retained bytes go back to the heap.
+void SetMaxRetainedBytes(size_t bytes);
+[[nodiscard]] Stats GetStats();
+
+}  // namespace image_pool
@@ -0,0 +1,213 @@
+#include "ImageDecoder.hpp"
+
+#include <spng.h>
+#include <turbojpeg.h>
+
+#include <cstring>
+
+#include "ImageBufferPool.hpp"
+#include "pch.hpp"
+#include "stb_image/stb_image.h"
+
+namespace {
+
+constexpr uint8_t kJpegSignature[] = {0xFF, 0xD8, 0xFF};
+constexpr uint8_t kPngSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+template <size_t N>
+bool StartsWith(std::span<const uint8_t> bytes, const uint8_t (&signature)[N]) {
+  return bytes.size() >= N && std::memcmp(bytes.data(), signature, N) == 0;
+}
+
+void FlipRows(uint8_t* pixels, int height, size_t row_bytes) {
+  std::vector<uint8_t> row(row_bytes);
+  for (int y = 0; y < height / 2; y++) {
+    uint8_t* top = pixels + y * row_bytes;
+    uint8_t* bottom = pixels + (height - 1 - y) * row_bytes;
+    std::memcpy(row.data(), top, row_bytes);
+    std::memcpy(top, bottom, row_bytes);
+    std::memcpy(bottom, row.data(), row_bytes);
+  }
+}
+
+// libjpeg-turbo's SIMD IDCT and color conversion. JPEG has no alpha, so requests for 2 channels
+// are left to stb_image, and alpha of RGBA output is opaque.
+class TurboJpegDecoder final : public ImageDecoder {
+ public:
+  [[nodiscard]] const char* Name() const override { return "libjpeg-turbo"; }
+
+  [[nodiscard]] bool Supports(ImageContainer container) const override {
+    return container == ImageContainer::kJpeg;
+  }
+
+  [[nodiscard]] bool Decode(std::span<const uint8_t> bytes, int req_components, bool flip,
+                            Image& out) const override {
+    ZoneScoped;
+    if (req_components == 2) return false;
+    tjhandle handle = tjInitDecompress();
+    if (!handle) return false;
+    int width, height, subsampling, colorspace;
+    bool result = false;
+    const auto jpeg_size = static_cast<unsigned long>(bytes.size());
+    if (tjDecompressHeader3(handle, bytes.data(), jpeg_size, &width, &height, &subsampling,
+                            &colorspace) == 0) {
+      int channels = req_components;
+      if (channels == 0) channels = colorspace == TJCS_GRAY ? 1 : 3;
+      const int pixel_format = channels == 1 ? TJPF_GRAY : channels == 3 ? TJPF_RGB : TJPF_RGBA;
+      const size_t size_bytes = static_cast<size_t>(width) * height * channels;
+      auto* pixels = static_cast<uint8_t*>(image_pool::Allocate(size_bytes));
+      if (tjDecompress2(handle, bytes.data(), jpeg_size, pixels, width, 0, height,
+                        pixel_format, flip ? TJFLAG_BOTTOMUP : 0) == 0) {
+        out.Free();
+        out.data = pixels;
+        out.width = width;
+        out.height = height;
+        out.channels = channels;
+        result = true;
+      } else {
+        image_pool::Free(pixels);
+      }
+    }
+    if (!result) spdlog::warn("libjpeg-turbo: {}", tjGetErrorStr2(handle));
+    tjDestroy(handle);
+    return result;
+  }
+};
+
+// libspng decodes straight into the requested 8 bit format. It can't convert color to gray, and
+// only expands gray of up to 8 bits, those requests are left to stb_image.
+class SpngDecoder final : public ImageDecoder {
+ public:
+  [[nodiscard]] const char* Name() const override { return "libspng"; }
+
+  [[nodiscard]] bool Supports(ImageContainer container) const override {
+    return container == ImageContainer::kPng;
+  }
+
+  [[nodiscard]] bool Decode(std::span<const uint8_t> bytes, int req_components, bool flip,
+                            Image& out) const override {
+    ZoneScoped;
+    spng_ctx* ctx = spng_ctx_new(0);
+    if (!ctx) return false;
+    bool result = false;
+    spng_ihdr ihdr;
+    if (spng_set_png_buffer(ctx, bytes.data(), bytes.size()) == 0 &&
+        spng_get_ihdr(ctx, &ihdr) == 0) {
+      const int channels = req_components ? req_components : FileChannels(ctx, ihdr);
+      const std::optional<int> format = Format(ihdr, channels);
+      size_t size_bytes;
+      if (format && spng_decoded_image_size(ctx, *format, &size_bytes) == 0) {
+        auto* pixels = static_cast<uint8_t*>(image_pool::Allocate(size_bytes));
+        const int flags = channels == 2 || channels == 4 ? SPNG_DECODE_TRNS : 0;
+        if (spng_decode_image(ctx, pixels, size_bytes, *format, flags) == 0) {
+          const size_t row_bytes = static_cast<size_t>(ihdr.width) * channels;
+          if (flip) FlipRows(pixels, static_cast<int>(ihdr.height), row_bytes);
+          out.Free();
+          out.data = pixels;
+          out.width = static_cast<int>(ihdr.width);
+          out.height = static_cast<int>(ihdr.height);
+          out.channels = channels;
+          result = true;
+        } else {
+          image_pool::Free(pixels);
+        }
+      }
+    }
+    spng_ctx_free(ctx);
+    return result;
+  }
+
+ private:
+  // matches what stb_image reports for the file
+  static int FileChannels(spng_ctx* ctx, const spng_ihdr& ihdr) {
+    spng_trns trns;
+    const bool has_trns = spng_get_trns(ctx, &trns) == 0;
+    switch (ihdr.color_type) {
+      case SPNG_COLOR_TYPE_GRAYSCALE:
+        return has_trns ? 2 : 1;
+      case SPNG_COLOR_TYPE_GRAYSCALE_ALPHA:
+        return 2;
+      case SPNG_COLOR_TYPE_TRUECOLOR:
+      case SPNG_COLOR_TYPE_INDEXED:
+        return has_trns ? 4 : 3;
+      default:
+        return 4;
+    }
+  }
+
+  static std::optional<int> Format(const spng_ihdr& ihdr, int channels) {
+    const bool gray = ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE ||
+                      ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA;
+    switch (channels) {
+      case 1:
+        if (gray && ihdr.bit_depth <= 8) return SPNG_FMT_G8;
+        return std::nullopt;
+      case 2:
+        if (gray && ihdr.bit_depth <= 8) return SPNG_FMT_GA8;
+        return std::nullopt;
+      case 3:
+        return SPNG_FMT_RGB8;
+      case 4:
+        return SPNG_FMT_RGBA8;
+      default:
+        return std::nullopt;
+    }
+  }
+};
+
+class StbDecoder final : public ImageDecoder {
+ public:
+  [[nodiscard]] const char* Name() const override { return "stb_image"; }
+
+  [[nodiscard]] bool Supports(ImageContainer) const override { return true; }
+
+  [[nodiscard]] bool Decode(std::span<const uint8_t> bytes, int req_components, bool flip,
+                            Image& out) const override {
+    ZoneScoped;
+    stbi_set_flip_vertically_on_load_thread(flip);
+    int width, height, channels;
+    void* pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width,
+                                         &height, &channels, req_components);
+    if (!pixels) return false;
+    out.Free();
+    out.data = pixels;
+    out.width = width;
+    out.height = height;
+    out.channels = req_components ? req_components : channels;
+    return true;
+  }
+};
+
+}  // namespace
+
+ImageContainer SniffImageContainer(std::span<const uint8_t> bytes) {
+  if (StartsWith(bytes, kJpegSignature)) return ImageContainer::kJpeg;
+  if (StartsWith(bytes, kPngSignature)) return ImageContainer::kPng;
+  return ImageContainer::kUnknown;
+}
+
+namespace image_decoder {
+
+const std::vector<std::unique_ptr<ImageDecoder>>& Decoders() {
+  static const std::vector<std::unique_ptr<ImageDecoder>> decoders = [] {
+    std::vector<std::unique_ptr<ImageDecoder>> result;
+    result.emplace_back(std::make_unique<TurboJpegDecoder>());
+    result.emplace_back(std::make_unique<SpngDecoder>());
+    result.emplace_back(std::make_unique<StbDecoder>());
+    return result;
+  }();
+  return decoders;
+}
+
+Image Decode(std::span<const uint8_t> bytes, int req_components, bool flip) {
+  const ImageContainer container = SniffImageContainer(bytes);
+  Image image;
+  for (const std::unique_ptr<ImageDecoder>& decoder : Decoders()) {
+    if (decoder->Supports(container) && decoder->Decode(bytes, req_components, flip, image)) {
+      break;
+    }
+  }
+  return image;
+}
+
+}  // namespace image_decoder
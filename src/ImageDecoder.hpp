@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <span>
+
+#include "Image.hpp"
+
+enum class ImageContainer : uint8_t {
+  kUnknown,
+  kJpeg,
+  kPng,
+};
+
+// Identifies the container from its signature rather than the file extension, which glTF
+// buffer views don't have and files sometimes get wrong.
+[[nodiscard]] ImageContainer SniffImageContainer(std::span<const uint8_t> bytes);
+
+// An 8 bit per channel decoding backend. Pixels are allocated from the image buffer pool, so the
+// Image owns them like stb_image's.
+class ImageDecoder {
+ public:
+  virtual ~ImageDecoder() = default;
+  [[nodiscard]] virtual const char* Name() const = 0;
+  [[nodiscard]] virtual bool Supports(ImageContainer container) const = 0;
+  // Returns false if the decoder failed or can't produce the requested component count, so the
+  // next backend is tried. req_components of 0 keeps the file's.
+  [[nodiscard]] virtual bool Decode(std::span<const uint8_t> bytes, int req_components, bool flip,
+                                    Image& out) const = 0;
+};
+
+namespace image_decoder {
+
+// Every backend in order of preference, stb_image last as it decodes any container.
+[[nodiscard]] const std::vector<std::unique_ptr<ImageDecoder>>& Decoders();
+// Decodes with the first backend that supports the sniffed container and succeeds.
+[[nodiscard]] Image Decode(std::span<const uint8_t> bytes, int req_components, bool flip);
+
+}  // namespace image_decoder
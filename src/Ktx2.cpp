@@ -0,0 +1,179 @@
+#include "Ktx2.hpp"
+
+#include <ktx.h>
+
+#include <cstring>
+
+#include "pch.hpp"
+
+namespace ktx2 {
+
+namespace {
+
+// VkFormat values, libktx doesn't install vkformat_enum.h
+enum VkFormat : uint32_t {
+  kR8G8B8A8Unorm = 37,
+  kR8G8B8A8Srgb = 43,
+  kBC1RGBUnorm = 131,
+  kBC1RGBSrgb = 132,
+  kBC1RGBAUnorm = 133,
+  kBC1RGBASrgb = 134,
+  kBC3Unorm = 137,
+  kBC3Srgb = 138,
+  kBC4Unorm = 139,
+  kBC5Unorm = 141,
+  kBC7Unorm = 145,
+  kBC7Srgb = 146,
+};
+
+std::optional<bc::Format> BCFormatFromVkFormat(uint32_t vk_format) {
+  switch (vk_format) {
+    case kBC1RGBUnorm:
+    case kBC1RGBSrgb:
+      return bc::Format::kBC1;
+    case kBC1RGBAUnorm:
+    case kBC1RGBASrgb:
+      return bc::Format::kBC1A;
+    case kBC3Unorm:
+    case kBC3Srgb:
+      return bc::Format::kBC3;
+    case kBC4Unorm:
+      return bc::Format::kBC4;
+    case kBC5Unorm:
+      return bc::Format::kBC5;
+    case kBC7Unorm:
+    case kBC7Srgb:
+      return bc::Format::kBC7;
+    default:
+      return std::nullopt;
+  }
+}
+
+bool IsSrgb(uint32_t vk_format) {
+  switch (vk_format) {
+    case kR8G8B8A8Srgb:
+    case kBC1RGBSrgb:
+    case kBC1RGBASrgb:
+    case kBC3Srgb:
+    case kBC7Srgb:
+      return true;
+    default:
+      return false;
+  }
+}
+
+ktx_transcode_fmt_e TranscodeFormat(bc::Format format) {
+  switch (format) {
+    case bc::Format::kBC1:
+    case bc::Format::kBC1A:
+      return KTX_TTF_BC1_RGB;
+    case bc::Format::kBC3:
+      return KTX_TTF_BC3_RGBA;
+    case bc::Format::kBC4:
+      return KTX_TTF_BC4_R;
+    case bc::Format::kBC5:
+      return KTX_TTF_BC5_RG;
+    case bc::Format::kBC7:
+      return KTX_TTF_BC7_RGBA;
+  }
+  return KTX_TTF_BC7_RGBA;
+}
+
+struct KtxTextureDeleter {
+  void operator()(ktxTexture2* texture) const { ktxTexture_Destroy(ktxTexture(texture)); }
+};
+
+bc::CompressedImage CopyLevels(ktxTexture2* texture, bc::Format format) {
+  bc::CompressedImage result;
+  result.format = format;
+  result.levels.reserve(texture->numLevels);
+  for (ktx_uint32_t level = 0; level < texture->numLevels; level++) {
+    const size_t size_bytes = ktxTexture_GetImageSize(ktxTexture(texture), level);
+    result.levels.push_back(bc::MipLevel{
+        .width = std::max(static_cast<int>(texture->baseWidth >> level), 1),
+        .height = std::max(static_cast<int>(texture->baseHeight >> level), 1),
+        .offset = result.levels.empty()
+                      ? 0
+                      : result.levels.back().offset + result.levels.back().size_bytes,
+        .size_bytes = size_bytes});
+  }
+  result.data.resize(result.levels.empty()
+                         ? 0
+                         : result.levels.back().offset + result.levels.back().size_bytes);
+  // KTX2 stores the smallest level first, levels are laid out from level 0 down here
+  const ktx_uint8_t* data = ktxTexture_GetData(ktxTexture(texture));
+  for (ktx_uint32_t level = 0; level < texture->numLevels; level++) {
+    ktx_size_t offset;
+    ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, 0, &offset);
+    const bc::MipLevel& dst = result.levels[level];
+    std::memcpy(result.data.data() + dst.offset, data + offset, dst.size_bytes);
+  }
+  return result;
+}
+
+}  // namespace
+
+bool IsKtx2(std::span<const uint8_t> bytes) {
+  static constexpr uint8_t kIdentifier[12] = {0xAB, 'K',  'T',  'X',  ' ',  '2',
+                                              '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+  return bytes.size() >= sizeof(kIdentifier) &&
+         std::memcmp(bytes.data(), kIdentifier, sizeof(kIdentifier)) == 0;
+}
+
+std::optional<glm::ivec2> Dimensions(std::span<const uint8_t> bytes) {
+  // pixelWidth and pixelHeight follow the identifier, vkFormat and typeSize
+  constexpr size_t kPixelWidthOffset = 20;
+  if (!IsKtx2(bytes) || bytes.size() < kPixelWidthOffset + 2 * sizeof(uint32_t)) {
+    return std::nullopt;
+  }
+  uint32_t dims[2];
+  std::memcpy(dims, bytes.data() + kPixelWidthOffset, sizeof(dims));
+  return glm::ivec2{static_cast<int>(dims[0]), std::max(static_cast<int>(dims[1]), 1)};
+}
+
+std::optional<Texture> Load(std::span<const uint8_t> bytes,
+                            std::optional<bc::Format> transcode_target) {
+  ZoneScoped;
+  ktxTexture2* raw_texture{};
+  KTX_error_code result = ktxTexture2_CreateFromMemory(
+      bytes.data(), bytes.size(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &raw_texture);
+  if (result != KTX_SUCCESS) {
+    spdlog::error("ktx2: failed to create texture: {}", ktxErrorString(result));
+    return std::nullopt;
+  }
+  std::unique_ptr<ktxTexture2, KtxTextureDeleter> texture(raw_texture);
+  if (texture->numDimensions != 2 || texture->isArray || texture->isCubemap) {
+    spdlog::error("ktx2: only 2D textures are supported");
+    return std::nullopt;
+  }
+
+  if (ktxTexture2_NeedsTranscoding(texture.get())) {
+    ZoneScopedN("Transcode");
+    const ktx_transcode_fmt_e format =
+        transcode_target ? TranscodeFormat(transcode_target.value()) : KTX_TTF_RGBA32;
+    result = ktxTexture2_TranscodeBasis(texture.get(), format, 0);
+    if (result != KTX_SUCCESS) {
+      spdlog::error("ktx2: failed to transcode: {}", ktxErrorString(result));
+      return std::nullopt;
+    }
+  }
+
+  Texture out{.width = static_cast<int>(texture->baseWidth),
+              .height = static_cast<int>(texture->baseHeight),
+              .srgb = IsSrgb(texture->vkFormat)};
+  if (auto format = BCFormatFromVkFormat(texture->vkFormat)) {
+    out.compressed = CopyLevels(texture.get(), format.value());
+    return out;
+  }
+  if (texture->vkFormat != kR8G8B8A8Unorm && texture->vkFormat != kR8G8B8A8Srgb) {
+    spdlog::error("ktx2: unsupported VkFormat {}", texture->vkFormat);
+    return std::nullopt;
+  }
+  ktx_size_t offset;
+  ktxTexture_GetImageOffset(ktxTexture(texture.get()), 0, 0, 0, &offset);
+  const ktx_uint8_t* data = ktxTexture_GetData(ktxTexture(texture.get())) + offset;
+  out.rgba8.assign(data, data + ktxTexture_GetImageSize(ktxTexture(texture.get()), 0));
+  return out;
+}
+
+}  // namespace ktx2
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <span>
+
+#include "BlockCompression.hpp"
+
+namespace ktx2 {
+
+// A KTX2 texture's mip chain, or its base level when it can't be uploaded block compressed.
+struct Texture {
+  int width{};
+  int height{};
+  // the file's VkFormat is sRGB encoded, transcoded files take it from their transfer function
+  bool srgb{false};
+  // every level the file stores, either as stored or transcoded from Basis Universal
+  std::optional<bc::CompressedImage> compressed{};
+  // base level as interleaved RGBA8, set when compressed is empty
+  std::vector<uint8_t> rgba8{};
+};
+
+[[nodiscard]] bool IsKtx2(std::span<const uint8_t> bytes);
+// Size of the base level, read from the header without loading the texture.
+[[nodiscard]] std::optional<glm::ivec2> Dimensions(std::span<const uint8_t> bytes);
+
+// Basis Universal (ETC1S/UASTC) payloads are transcoded to transcode_target, or to RGBA8 without
+// one. BCn files keep their format and mips. Uncompressed RGBA8 files only return the base level.
+[[nodiscard]] std::optional<Texture> Load(std::span<const uint8_t> bytes,
+                                          std::optional<bc::Format> transcode_target);
+
+}  // namespace ktx2
@@ -0,0 +1,159 @@
+#include "LightClusters.hpp"
+
+#include <bit>
+
+#include "LightManager.hpp"
+#include "Renderer.hpp"
+#include "pch.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CLUSTERS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kTilesPerSlice = LightClusters::kTilesX * LightClusters::kTilesY;
+static_assert(kTilesPerSlice % 4 == 0, "slices are tested four clusters at a time");
+// the depth slices of infinite projections end here, lights beyond it aren't assigned
+constexpr float kMaxClusterDepth = 1000.f;
+constexpr uint32_t kInitialIndexCapacity = 1024;
+
+}  // namespace
+
+void LightClusters::Init() {
+  for (std::vector<float>* bounds : {&min_x_, &min_y_, &min_z_, &max_x_, &max_y_, &max_z_}) {
+    bounds->resize(kNumClusters);
+  }
+  grid_.resize(kNumClusters);
+  grid_ssbo_.Init(kNumClusters, GL_DYNAMIC_STORAGE_BIT, nullptr);
+  indices_capacity_ = kInitialIndexCapacity;
+  indices_ssbo_.Init(indices_capacity_, GL_DYNAMIC_STORAGE_BIT, nullptr);
+}
+
+void LightClusters::UpdateClusterBounds(const glm::mat4& projection) {
+  ZoneScoped;
+  bounds_projection_ = projection;
+  // planes of a GL perspective projection
+  near_ = projection[3][2] / (projection[2][2] - 1.f);
+  const float far_denom = projection[2][2] + 1.f;
+  far_ = std::abs(far_denom) > 1e-6f ? projection[3][2] / far_denom : kMaxClusterDepth;
+  far_ = std::min(far_, kMaxClusterDepth);
+  const float depth_scale = kDepthSlices / std::log(far_ / near_);
+  depth_slice_params_ = {depth_scale, -std::log(near_) * depth_scale};
+
+  // view x = (ndc x + proj[2][0]) * depth / proj[0][0], likewise for y
+  const auto view_x = [&projection](float ndc, float depth) {
+    return (ndc + projection[2][0]) * depth / projection[0][0];
+  };
+  const auto view_y = [&projection](float ndc, float depth) {
+    return (ndc + projection[2][1]) * depth / projection[1][1];
+  };
+  for (uint32_t slice = 0; slice < kDepthSlices; slice++) {
+    const float near_depth =
+        near_ * std::pow(far_ / near_, static_cast<float>(slice) / kDepthSlices);
+    const float far_depth =
+        near_ * std::pow(far_ / near_, static_cast<float>(slice + 1) / kDepthSlices);
+    for (uint32_t y = 0; y < kTilesY; y++) {
+      const float ndc_y0 = -1.f + 2.f * static_cast<float>(y) / kTilesY;
+      const float ndc_y1 = -1.f + 2.f * static_cast<float>(y + 1) / kTilesY;
+      for (uint32_t x = 0; x < kTilesX; x++) {
+        const float ndc_x0 = -1.f + 2.f * static_cast<float>(x) / kTilesX;
+        const float ndc_x1 = -1.f + 2.f * static_cast<float>(x + 1) / kTilesX;
+        const uint32_t cluster = slice * kTilesPerSlice + y * kTilesX + x;
+        min_x_[cluster] = std::min(view_x(ndc_x0, near_depth), view_x(ndc_x0, far_depth));
+        max_x_[cluster] = std::max(view_x(ndc_x1, near_depth), view_x(ndc_x1, far_depth));
+        min_y_[cluster] = std::min(view_y(ndc_y0, near_depth), view_y(ndc_y0, far_depth));
+        max_y_[cluster] = std::max(view_y(ndc_y1, near_depth), view_y(ndc_y1, far_depth));
+        min_z_[cluster] = near_depth;
+        max_z_[cluster] = far_depth;
+      }
+    }
+  }
+}
+
+void LightClusters::Build(const LightManager& lights, const std::vector<uint32_t>& light_indices,
+                          const RenderInfo& render_info) {
+  ZoneScoped;
+  if (render_info.projection_matrix != bounds_projection_) {
+    UpdateClusterBounds(render_info.projection_matrix);
+  }
+  const auto slice_of = [this](float depth) {
+    const float slice = std::log(depth) * depth_slice_params_.x + depth_slice_params_.y;
+    return static_cast<uint32_t>(std::clamp(slice, 0.f, static_cast<float>(kDepthSlices - 1)));
+  };
+
+  hits_.clear();
+  for (const uint32_t light_idx : light_indices) {
+    const glm::vec3 view_pos =
+        glm::vec3(render_info.view_matrix * glm::vec4(lights.Position(light_idx), 1.f));
+    const glm::vec3 center{view_pos.x, view_pos.y, -view_pos.z};
+    const float radius = lights.Radius(light_idx);
+    if (center.z + radius < near_ || center.z - radius > far_) continue;
+    const uint32_t first_slice = slice_of(std::max(center.z - radius, near_));
+    const uint32_t last_slice = slice_of(std::min(center.z + radius, far_));
+    for (uint32_t slice = first_slice; slice <= last_slice; slice++) {
+      const uint32_t first_cluster = slice * kTilesPerSlice;
+#ifdef LIGHT_CLUSTERS_SSE2
+      // squared distance from the center to each cluster's box, four clusters at a time
+      const __m128 cx = _mm_set1_ps(center.x);
+      const __m128 cy = _mm_set1_ps(center.y);
+      const __m128 cz = _mm_set1_ps(center.z);
+      const __m128 radius2 = _mm_set1_ps(radius * radius);
+      const __m128 zero = _mm_setzero_ps();
+      const auto axis_dist2 = [&zero](const float* min, const float* max, __m128 c) {
+        const __m128 dist = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min), c),
+                                                  _mm_sub_ps(c, _mm_loadu_ps(max))),
+                                       zero);
+        return _mm_mul_ps(dist, dist);
+      };
+      for (uint32_t cluster = first_cluster; cluster < first_cluster + kTilesPerSlice;
+           cluster += 4) {
+        const __m128 dist2 =
+            _mm_add_ps(_mm_add_ps(axis_dist2(&min_x_[cluster], &max_x_[cluster], cx),
+                                  axis_dist2(&min_y_[cluster], &max_y_[cluster], cy)),
+                       axis_dist2(&min_z_[cluster], &max_z_[cluster], cz));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, radius2));
+        while (mask) {
+          const int lane = std::countr_zero(static_cast<uint32_t>(mask));
+          hits_.emplace_back(cluster + lane, light_idx);
+          mask &= mask - 1;
+        }
+      }
+#else
+      for (uint32_t cluster = first_cluster; cluster < first_cluster + kTilesPerSlice; cluster++) {
+        const glm::vec3 min{min_x_[cluster], min_y_[cluster], min_z_[cluster]};
+        const glm::vec3 max{max_x_[cluster], max_y_[cluster], max_z_[cluster]};
+        const glm::vec3 dist = glm::max(glm::max(min - center, center - max), glm::vec3{0.f});
+        if (glm::dot(dist, dist) <= radius * radius) hits_.emplace_back(cluster, light_idx);
+      }
+#endif
+    }
+  }
+
+  // counting sort by cluster, lights stay in culled order within a cluster
+  std::ranges::fill(grid_, glm::uvec2{0});
+  for (const auto& [cluster, light_idx] : hits_) grid_[cluster].y++;
+  uint32_t offset = 0;
+  for (glm::uvec2& range : grid_) {
+    range.x = offset;
+    offset += range.y;
+    range.y = 0;
+  }
+  indices_.resize(hits_.size());
+  for (const auto& [cluster, light_idx] : hits_) {
+    indices_[grid_[cluster].x + grid_[cluster].y++] = light_idx;
+  }
+
+  grid_ssbo_.SubDataStart(grid_.size(), grid_.data());
+  if (indices_.size() > indices_capacity_) {
+    indices_capacity_ = std::max(static_cast<uint32_t>(indices_.size()), indices_capacity_ * 2);
+    indices_ssbo_.Init(indices_capacity_, GL_DYNAMIC_STORAGE_BIT, nullptr);
+  }
+  if (!indices_.empty()) indices_ssbo_.SubDataStart(indices_.size(), indices_.data());
+}
+
+void LightClusters::Bind(GLuint grid_slot, GLuint indices_slot) const {
+  grid_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, grid_slot);
+  indices_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, indices_slot);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "gl/Buffer.hpp"
+
+class LightManager;
+struct RenderInfo;
+
+// Clustered forward light assignment. The view frustum is split into screen tiles by exponential
+// depth slices, and each cluster lists the point lights whose spheres of influence overlap its
+// view space bounds. textured.fs.glsl shades a fragment with the lights of its cluster only.
+class LightClusters {
+ public:
+  // must match textured.fs.glsl
+  static constexpr uint32_t kTilesX = 16;
+  static constexpr uint32_t kTilesY = 9;
+  static constexpr uint32_t kDepthSlices = 24;
+  static constexpr uint32_t kNumClusters = kTilesX * kTilesY * kDepthSlices;
+
+  void Init();
+  // Assigns the lights to the clusters of the view and uploads the light lists. light_indices are
+  // the lights to consider, usually those culled against the view's frustum.
+  void Build(const LightManager& lights, const std::vector<uint32_t>& light_indices,
+             const RenderInfo& render_info);
+  // Binds the (offset, count) range of each cluster and the light indices the ranges point into.
+  void Bind(GLuint grid_slot, GLuint indices_slot) const;
+
+  // Scale and bias taking log(view depth) to the depth slice of the last built view.
+  [[nodiscard]] glm::vec2 DepthSliceParams() const { return depth_slice_params_; }
+  [[nodiscard]] size_t NumLightIndices() const { return indices_.size(); }
+
+ private:
+  void UpdateClusterBounds(const glm::mat4& projection);
+
+  // view space bounds of each cluster, slice by slice, with depth positive into the screen.
+  // Structure of arrays so lights are tested against four clusters at a time.
+  std::vector<float> min_x_, min_y_, min_z_, max_x_, max_y_, max_z_;
+  glm::mat4 bounds_projection_{0.f};
+  float near_{};
+  float far_{};
+  glm::vec2 depth_slice_params_{};
+
+  // (cluster, light) pairs of the build, counting sorted into grid_ and indices_
+  std::vector<std::pair<uint32_t, uint32_t>> hits_;
+  std::vector<glm::uvec2> grid_;
+  std::vector<uint32_t> indices_;
+  gl::Buffer<glm::uvec2> grid_ssbo_;
+  gl::Buffer<uint32_t> indices_ssbo_;
+  uint32_t indices_capacity_{};
+};
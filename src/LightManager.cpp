@@ -0,0 +1,193 @@
+#include "LightManager.hpp"
+
+#include <array>
+
+#include "Frustum.hpp"
+#include "pch.hpp"
+#include "util/Timer.hpp"
+
+namespace {
+
+constexpr uint32_t kInitialCapacity = 256;
+// lights are culled where their unshadowed radiance falls below this, see textured.fs.glsl
+constexpr float kPointLightCutoff = 0.005f;
+constexpr uint32_t kMaxLightsPerLeaf = 8;
+constexpr uint32_t kMortonBitsPerAxis = 10;
+
+// interleaves the low 10 bits of v with two zero bits between each
+uint32_t SpreadBits(uint32_t v) {
+  v = (v | (v << 16)) & 0x030000FF;
+  v = (v | (v << 8)) & 0x0300F00F;
+  v = (v | (v << 4)) & 0x030C30C3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+}  // namespace
+
+void LightManager::Init() {
+  capacity_ = kInitialCapacity;
+  ssbo_.Init(capacity_, GL_DYNAMIC_STORAGE_BIT, nullptr);
+}
+
+float LightManager::Radius(const PointLight& light) {
+  // inverse square falloff of the brightest channel reaches the cutoff
+  const float peak = light.intensity * std::max({light.color.r, light.color.g, light.color.b});
+  return std::sqrt(std::max(peak, 0.f) / kPointLightCutoff);
+}
+
+uint32_t LightManager::Add(const PointLight& light) {
+  const uint32_t idx = Size();
+  positions_.push_back(light.position);
+  radii_.push_back(Radius(light));
+  colors_.push_back(light.color);
+  intensities_.push_back(light.intensity);
+  casts_shadows_.push_back(false);
+  MarkDirty(idx);
+  return idx;
+}
+
+void LightManager::Set(uint32_t idx, const PointLight& light) {
+  positions_[idx] = light.position;
+  radii_[idx] = Radius(light);
+  colors_[idx] = light.color;
+  intensities_[idx] = light.intensity;
+  MarkDirty(idx);
+}
+
+void LightManager::SetPosition(uint32_t idx, const glm::vec3& position) {
+  positions_[idx] = position;
+  MarkDirty(idx);
+}
+
+void LightManager::Clear() {
+  positions_.clear();
+  radii_.clear();
+  colors_.clear();
+  intensities_.clear();
+  casts_shadows_.clear();
+  dirty_begin_ = UINT32_MAX;
+  dirty_end_ = 0;
+  bvh_dirty_ = true;
+}
+
+PointLight LightManager::Get(uint32_t idx) const {
+  return PointLight{.position = positions_[idx],
+                    .radius = radii_[idx],
+                    .color = colors_[idx],
+                    .intensity = intensities_[idx]};
+}
+
+void LightManager::MarkDirty(uint32_t idx) {
+  dirty_begin_ = std::min(dirty_begin_, idx);
+  dirty_end_ = std::max(dirty_end_, idx + 1);
+  bvh_dirty_ = true;
+}
+
+void LightManager::Update() {
+  ZoneScoped;
+  last_upload_count_ = 0;
+  if (Size() > capacity_) {
+    // the new buffer starts empty, upload every light
+    capacity_ = std::max(Size(), capacity_ * 2);
+    ssbo_.Init(capacity_, GL_DYNAMIC_STORAGE_BIT, nullptr);
+    dirty_begin_ = 0;
+    dirty_end_ = Size();
+  }
+  if (dirty_begin_ < dirty_end_) {
+    // edits are coalesced into one range, the untouched lights between them are cheaper to
+    // upload again than to split into separate calls
+    const uint32_t count = dirty_end_ - dirty_begin_;
+    staging_.resize(count);
+    for (uint32_t i = 0; i < count; i++) staging_[i] = Get(dirty_begin_ + i);
+    ssbo_.SubDataIndex(count, dirty_begin_, staging_.data());
+    last_upload_count_ = count;
+    dirty_begin_ = UINT32_MAX;
+    dirty_end_ = 0;
+  }
+  if (bvh_dirty_) {
+    RebuildBvh();
+    bvh_dirty_ = false;
+  }
+}
+
+void LightManager::Bind(GLuint slot) const { ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, slot); }
+
+void LightManager::RebuildBvh() {
+  ZoneScoped;
+  Timer timer;
+  bvh_nodes_.clear();
+  bvh_lights_.clear();
+  if (positions_.empty()) {
+    last_rebuild_ms_ = static_cast<float>(timer.ElapsedMS());
+    return;
+  }
+
+  // sorting along a Morton curve keeps nearby lights in the same leaves
+  AABB centers{.min = positions_[0], .max = positions_[0]};
+  for (const glm::vec3& position : positions_) centers |= AABB{position, position};
+  const glm::vec3 scale = static_cast<float>((1u << kMortonBitsPerAxis) - 1) /
+                          glm::max(centers.max - centers.min, glm::vec3{1e-6f});
+  morton_codes_.resize(positions_.size());
+  for (uint32_t i = 0; i < positions_.size(); i++) {
+    const glm::uvec3 cell = glm::uvec3((positions_[i] - centers.min) * scale);
+    const uint32_t code =
+        SpreadBits(cell.x) | (SpreadBits(cell.y) << 1) | (SpreadBits(cell.z) << 2);
+    morton_codes_[i] = {code, i};
+  }
+  std::ranges::sort(morton_codes_);
+  bvh_lights_.resize(positions_.size());
+  for (uint32_t i = 0; i < positions_.size(); i++) bvh_lights_[i] = morton_codes_[i].second;
+
+  bvh_nodes_.reserve(2 * (positions_.size() / kMaxLightsPerLeaf + 1));
+  bvh_nodes_.emplace_back();
+  BuildNode(0, 0, Size());
+  last_rebuild_ms_ = static_cast<float>(timer.ElapsedMS());
+}
+
+void LightManager::BuildNode(uint32_t node_idx, uint32_t begin, uint32_t end) {
+  if (end - begin <= kMaxLightsPerLeaf) {
+    const uint32_t first_light = bvh_lights_[begin];
+    AABB bounds{.min = positions_[first_light] - radii_[first_light],
+                .max = positions_[first_light] + radii_[first_light]};
+    for (uint32_t i = begin + 1; i < end; i++) {
+      const uint32_t light = bvh_lights_[i];
+      bounds |= AABB{positions_[light] - radii_[light], positions_[light] + radii_[light]};
+    }
+    bvh_nodes_[node_idx] = BvhNode{.bounds = bounds, .first = begin, .count = end - begin};
+    return;
+  }
+  // the halves of a Morton ordered range are spatially coherent. Children are allocated as a
+  // pair so first is enough to find both.
+  const auto left = static_cast<uint32_t>(bvh_nodes_.size());
+  bvh_nodes_.resize(bvh_nodes_.size() + 2);
+  const uint32_t mid = begin + (end - begin) / 2;
+  BuildNode(left, begin, mid);
+  BuildNode(left + 1, mid, end);
+  bvh_nodes_[node_idx] = BvhNode{.bounds = bvh_nodes_[left].bounds | bvh_nodes_[left + 1].bounds,
+                                 .first = left,
+                                 .count = 0};
+}
+
+void LightManager::Cull(const Frustum& frustum, std::vector<uint32_t>& result) const {
+  ZoneScoped;
+  if (bvh_nodes_.empty()) return;
+  std::array<uint32_t, 64> stack;
+  uint32_t stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    const BvhNode& node = bvh_nodes_[stack[--stack_size]];
+    if (!frustum.Intersects(node.bounds)) continue;
+    if (node.count == 0) {
+      stack[stack_size++] = node.first;
+      stack[stack_size++] = node.first + 1;
+      continue;
+    }
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+      const uint32_t light = bvh_lights_[i];
+      if (frustum.Intersects(Sphere{.center = positions_[light], .radius = radii_[light]})) {
+        result.push_back(light);
+      }
+    }
+  }
+}
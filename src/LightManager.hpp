@@ -0,0 +1,78 @@
+#pragma once
+
+#include "AABB.hpp"
+#include "gl/Buffer.hpp"
+#include "types.hpp"
+
+struct Frustum;
+
+// Point lights in structure of arrays form, mirrored to an SSBO of PointLight for
+// textured.fs.glsl. Edits only mark the range of lights they touch, and Update coalesces the
+// frame's edits into one upload. A BVH over the lights' spheres of influence is rebuilt when lights
+// change, for culling them against a view before cluster assignment.
+class LightManager {
+ public:
+  void Init();
+
+  uint32_t Add(const PointLight& light);
+  void Set(uint32_t idx, const PointLight& light);
+  void SetPosition(uint32_t idx, const glm::vec3& position);
+  void Clear();
+  // radius is derived from the color and intensity, see Radius
+  [[nodiscard]] PointLight Get(uint32_t idx) const;
+  [[nodiscard]] uint32_t Size() const { return static_cast<uint32_t>(positions_.size()); }
+  [[nodiscard]] const glm::vec3& Position(uint32_t idx) const { return positions_[idx]; }
+  [[nodiscard]] float Radius(uint32_t idx) const { return radii_[idx]; }
+  // Shadow casting lights compete for the slots of PointLightShadows, lights start without.
+  void SetCastsShadows(uint32_t idx, bool casts_shadows) { casts_shadows_[idx] = casts_shadows; }
+  [[nodiscard]] bool CastsShadows(uint32_t idx) const { return casts_shadows_[idx]; }
+
+  // Uploads the lights edited since the last call and rebuilds the BVH if any changed. Call
+  // before the frame's draws, later calls in the frame are free.
+  void Update();
+  void Bind(GLuint slot) const;
+  // Appends the indices of the lights whose spheres of influence may be in the frustum.
+  void Cull(const Frustum& frustum, std::vector<uint32_t>& result) const;
+
+  // Distance where the light's unshadowed radiance falls below the cutoff of textured.fs.glsl.
+  [[nodiscard]] static float Radius(const PointLight& light);
+
+  [[nodiscard]] float LastRebuildMs() const { return last_rebuild_ms_; }
+  [[nodiscard]] uint32_t LastUploadCount() const { return last_upload_count_; }
+
+ private:
+  struct BvhNode {
+    AABB bounds{};
+    // children when count is 0, else the first of count lights in bvh_lights_
+    uint32_t first{};
+    uint32_t count{};
+  };
+
+  void MarkDirty(uint32_t idx);
+  void RebuildBvh();
+  // builds the allocated node over bvh_lights_[begin, end)
+  void BuildNode(uint32_t node_idx, uint32_t begin, uint32_t end);
+
+  std::vector<glm::vec3> positions_;
+  std::vector<float> radii_;
+  std::vector<glm::vec3> colors_;
+  std::vector<float> intensities_;
+  // CPU only, the shader finds shadows through PointLightShadows' slot of each light
+  std::vector<uint8_t> casts_shadows_;
+  // lights in [dirty_begin_, dirty_end_) changed since the last upload
+  uint32_t dirty_begin_{UINT32_MAX};
+  uint32_t dirty_end_{0};
+  bool bvh_dirty_{false};
+
+  // packed from the SoA arrays for each upload
+  std::vector<PointLight> staging_;
+  gl::Buffer<PointLight> ssbo_;
+  uint32_t capacity_{};
+
+  std::vector<BvhNode> bvh_nodes_;
+  // light indices sorted along the Morton curve of their positions, leaves are ranges of it
+  std::vector<uint32_t> bvh_lights_;
+  std::vector<std::pair<uint32_t, uint32_t>> morton_codes_;
+  float last_rebuild_ms_{};
+  uint32_t last_upload_count_{};
+};
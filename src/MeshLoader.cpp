@@ -2,12 +2,19 @@
 
 #include <mikktspace.h>
 
+#include <fstream>
+
 #include <fastgltf/core.hpp>
 #include <fastgltf/glm_element_traits.hpp>
 #include <fastgltf/tools.hpp>
 #include <fastgltf/types.hpp>
 
+#include "BlockCompression.hpp"
 #include "Image.hpp"
+#include "ImageBufferPool.hpp"
+#include "Ktx2.hpp"
+#include "TextureCache.hpp"
+#include "TextureQuality.hpp"
 #include "pch.hpp"
 #include "util/ThreadPool.hpp"
 
@@ -20,10 +27,353 @@
 #include "ResourceManager.hpp"
 #include "gl/Texture.hpp"
 #include "types.hpp"
+#include "util/Hash.hpp"
 #include "util/Timer.hpp"
 
 namespace {
 
+struct LoadedImage {
+  Image image;
+  // KTX2 file contents, transcoded per role when the texture is cooked
+  std::vector<uint8_t> ktx2{};
+  util::ContentKey content{};
+};
+
+// Hashes decoded pixels on the worker thread so identical images can share a GPU texture.
+LoadedImage HashImage(Image image) {
+  ZoneScoped;
+  LoadedImage result{.image = std::move(image)};
+  const Image& img = result.image;
+  if (!img.data) return result;
+  result.content =
+      util::HashContent(img.data, static_cast<size_t>(img.width) * img.height * img.channels);
+  util::HashCombine(result.content, img.width);
+  util::HashCombine(result.content, img.height);
+  util::HashCombine(result.content, img.channels);
+  return result;
+}
+
+// KTX2 containers are kept encoded, stb_image decodes everything else.
+LoadedImage LoadImageBytes(std::span<const uint8_t> bytes, int channels) {
+  ZoneScoped;
+  if (!ktx2::IsKtx2(bytes)) {
+    return HashImage(Image{const_cast<unsigned char*>(bytes.data()), bytes.size(), channels});
+  }
+  LoadedImage result;
+  result.ktx2.assign(bytes.begin(), bytes.end());
+  result.content = util::HashContent(bytes.data(), bytes.size());
+  return result;
+}
+
+LoadedImage LoadImageFile(const std::filesystem::path& path, int channels) {
+  if (path.extension() != ".ktx2") return HashImage(Image{path.string(), channels, false});
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    spdlog::error("failed to open {}", path.string());
+    return LoadedImage{};
+  }
+  std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  if (!file) {
+    spdlog::error("failed to read {}", path.string());
+    return LoadedImage{};
+  }
+  return LoadImageBytes(bytes, channels);
+}
+
+// KHR_texture_basisu textures list the KTX2 image separately from the fallback image.
+auto TextureImageIndex(const fastgltf::Texture& texture) {
+  return texture.basisuImageIndex.has_value() ? texture.basisuImageIndex : texture.imageIndex;
+}
+
+GLenum ClientFormat(int channels) {
+  switch (channels) {
+    case 1:
+      return GL_RED;
+    case 2:
+      return GL_RG;
+    case 3:
+      return GL_RGB;
+    default:
+      return GL_RGBA;
+  }
+}
+
+struct TextureFormat {
+  GLenum internal_format;
+  GLenum format;
+  glm::ivec4 swizzle{GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+};
+
+// Keeps only the channels the shader reads for the role. GL drops the trailing channels of the
+// client data when uploading to the smaller internal formats.
+TextureFormat GetTextureFormat(TextureRole role, int channels) {
+  switch (role) {
+    case TextureRole::kBaseColor:
+      return {channels == 4 ? GLenum{GL_SRGB8_ALPHA8} : GLenum{GL_SRGB8}, ClientFormat(channels)};
+    case TextureRole::kEmissive:
+      return {GL_SRGB8, ClientFormat(channels)};
+    case TextureRole::kOcclusionRoughnessMetallic:
+      return {GL_RGB8, ClientFormat(channels)};
+    case TextureRole::kOcclusion:
+      return {GL_R8, ClientFormat(channels)};
+    case TextureRole::kNormal:
+      // Z is reconstructed in the shader
+      return {GL_RG8, ClientFormat(channels)};
+    case TextureRole::kMetallicRoughness:
+      // roughness (G) and metallic (B) are repacked into RG, swizzled back so the shader still
+      // reads .g and .b
+      return {GL_RG8, GL_RG, glm::ivec4{GL_ZERO, GL_RED, GL_GREEN, GL_ONE}};
+  }
+  return {GL_RGBA8, ClientFormat(channels)};
+}
+
+std::vector<uint8_t> RepackMetallicRoughness(const ImageView& img) {
+  ZoneScoped;
+  const size_t num_texels = static_cast<size_t>(img.width) * img.height;
+  const auto* src = static_cast<const uint8_t*>(img.data);
+  std::vector<uint8_t> result(num_texels * 2);
+  for (size_t i = 0; i < num_texels; i++) {
+    result[i * 2] = src[i * img.channels + 1];
+    result[i * 2 + 1] = src[i * img.channels + 2];
+  }
+  return result;
+}
+
+struct MaterialTexture {
+  fastgltf::TextureInfo* info;
+  TextureRole role;
+};
+
+// The textures a material samples and the role each is sampled as.
+std::vector<MaterialTexture> GetMaterialTextures(fastgltf::Material& gltf_mat) {
+  std::vector<MaterialTexture> result;
+  auto& pbr_data = gltf_mat.pbrData;
+  if (pbr_data.baseColorTexture.has_value()) {
+    result.push_back(MaterialTexture{&pbr_data.baseColorTexture.value(), TextureRole::kBaseColor});
+  }
+  // has metallic roughness and occlusion and indices are the same -> occlusionRoughnessMetallic
+  if (pbr_data.metallicRoughnessTexture.has_value() && gltf_mat.occlusionTexture.has_value() &&
+      pbr_data.metallicRoughnessTexture->textureIndex == gltf_mat.occlusionTexture->textureIndex) {
+    result.push_back(MaterialTexture{&pbr_data.metallicRoughnessTexture.value(),
+                                     TextureRole::kOcclusionRoughnessMetallic});
+  } else {
+    if (pbr_data.metallicRoughnessTexture.has_value()) {
+      result.push_back(MaterialTexture{&pbr_data.metallicRoughnessTexture.value(),
+                                       TextureRole::kMetallicRoughness});
+    }
+    if (gltf_mat.occlusionTexture.has_value()) {
+      result.push_back(
+          MaterialTexture{&gltf_mat.occlusionTexture.value(), TextureRole::kOcclusion});
+    }
+  }
+  if (gltf_mat.emissiveTexture.has_value()) {
+    result.push_back(MaterialTexture{&gltf_mat.emissiveTexture.value(), TextureRole::kEmissive});
+  }
+  if (gltf_mat.normalTexture.has_value()) {
+    result.push_back(MaterialTexture{&gltf_mat.normalTexture.value(), TextureRole::kNormal});
+  }
+  return result;
+}
+
+uint64_t& MaterialTextureHandle(Material& mat, TextureRole role) {
+  switch (role) {
+    case TextureRole::kBaseColor:
+      return mat.base_color_bindless_handle;
+    case TextureRole::kEmissive:
+      return mat.emissive_bindless_handle;
+    case TextureRole::kMetallicRoughness:
+    case TextureRole::kOcclusionRoughnessMetallic:
+      return mat.metallic_roughness_bindless_handle;
+    case TextureRole::kOcclusion:
+      return mat.occlusion_bindless_handle;
+    case TextureRole::kNormal:
+      return mat.normal_bindless_handle;
+  }
+  return mat.base_color_bindless_handle;
+}
+
+uint32_t MaterialTextureFlag(TextureRole role) {
+  switch (role) {
+    case TextureRole::kMetallicRoughness:
+      return MaterialFlags::kMetallicRoughness;
+    case TextureRole::kOcclusionRoughnessMetallic:
+      return MaterialFlags::kOcclusionRoughnessMetallic;
+    default:
+      return MaterialFlags::kNone;
+  }
+}
+
+uint64_t TextureCacheKey(size_t image_idx, TextureRole role) {
+  return (static_cast<uint64_t>(image_idx) << 32) | static_cast<uint64_t>(role);
+}
+
+bool IsSRGB(TextureRole role) {
+  return role == TextureRole::kBaseColor || role == TextureRole::kEmissive;
+}
+
+struct TextureCompressionSupport {
+  bool enabled;
+  bool bc7;
+};
+
+bc::Format GetBCFormat(TextureRole role, int channels, bool bc7_supported) {
+  switch (role) {
+    case TextureRole::kBaseColor:
+      if (channels == 4) return bc7_supported ? bc::Format::kBC7 : bc::Format::kBC3;
+      return bc::Format::kBC1;
+    case TextureRole::kEmissive:
+      return bc::Format::kBC1;
+    case TextureRole::kOcclusionRoughnessMetallic:
+      // channels are unrelated, BC1's shared 565 endpoints bleed between them
+      return bc7_supported ? bc::Format::kBC7 : bc::Format::kBC1;
+    case TextureRole::kOcclusion:
+      return bc::Format::kBC4;
+    case TextureRole::kMetallicRoughness:
+    case TextureRole::kNormal:
+      return bc::Format::kBC5;
+  }
+  return bc::Format::kBC7;
+}
+
+// A texture the model's materials sample, identified by its image and role.
+struct TextureRequest {
+  uint64_t cache_key;
+  size_t image_idx;
+  TextureRole role;
+  // cutoff of the alpha masked materials sampling it as base color
+  std::optional<float> alpha_cutoff;
+  // what the cooked texture is shared across models by
+  util::ContentKey content{};
+  // size of the image, and the top mip levels the quality tier drops from it
+  glm::ivec2 dims{};
+  int skipped_levels{};
+};
+
+// Texture data ready for upload, prepared on a worker thread.
+struct CookedTexture {
+  TextureFormat format{};
+  glm::ivec2 dims{};
+  // every mip level, tightly packed from level 0 down
+  std::vector<uint8_t> data{};
+  std::vector<size_t> level_sizes{};
+  bool compressed{};
+};
+
+template <typename LevelT>
+CookedTexture MakeCookedTexture(TextureFormat format, std::vector<uint8_t> data,
+                                const std::vector<LevelT>& levels, bool compressed) {
+  CookedTexture cooked{.format = format,
+                       .dims = glm::ivec2{levels[0].width, levels[0].height},
+                       .data = std::move(data),
+                       .level_sizes = {},
+                       .compressed = compressed};
+  for (const LevelT& level : levels) cooked.level_sizes.emplace_back(level.size_bytes);
+  return cooked;
+}
+
+// Mips are generated here instead of with glGenerateTextureMipmap, so they are filtered in linear
+// space, keep alpha tested coverage, and don't stall the GL thread.
+CookedTexture CookImage(const ImageView& img, const TextureRequest& request,
+                        TextureCompressionSupport compression) {
+  ZoneScoped;
+  TextureFormat format = GetTextureFormat(request.role, img.channels);
+  const auto* src = static_cast<const uint8_t*>(img.data);
+  int src_channels = img.channels;
+  std::vector<uint8_t> repacked;
+  if (request.role == TextureRole::kMetallicRoughness) {
+    repacked = RepackMetallicRoughness(img);
+    src = repacked.data();
+    src_channels = 2;
+  }
+  // images larger than the quality tier allows are shrunk before the mip and block compression
+  // passes, which would otherwise run on levels that are never uploaded
+  int width = img.width;
+  int height = img.height;
+  std::vector<uint8_t> downscaled;
+  const auto downscale = [&]() {
+    if (request.skipped_levels == 0) return;
+    downscaled = mip::Downscale(src, width, height, src_channels, request.skipped_levels,
+                                IsSRGB(request.role));
+    src = downscaled.data();
+    width = std::max(width >> request.skipped_levels, 1);
+    height = std::max(height >> request.skipped_levels, 1);
+  };
+  const mip::GenerateInfo mip_info{.filter = mip::Filter::kKaiser,
+                                   .srgb = IsSRGB(request.role),
+                                   .alpha_cutoff = request.alpha_cutoff};
+  if (!compression.enabled) {
+    downscale();
+    mip::Chain chain = mip::Generate(src, width, height, src_channels, mip_info);
+    return MakeCookedTexture(format, std::move(chain.data), chain.levels, false);
+  }
+
+  const bc::Format bc_format = GetBCFormat(request.role, img.channels, compression.bc7);
+  size_t cache_key = request.content.hash;
+  util::HashCombine(cache_key, static_cast<size_t>(bc_format));
+  std::optional<bc::CompressedImage> compressed = texture_cache::Load(cache_key);
+  if (!compressed) {
+    downscale();
+    const mip::Chain chain = mip::Generate(src, width, height, src_channels, mip_info);
+    compressed = bc::EncodeMipChain(bc_format, chain);
+    texture_cache::Store(cache_key, compressed.value());
+  }
+  format.internal_format = bc::GLInternalFormat(bc_format, IsSRGB(request.role));
+  return MakeCookedTexture(format, std::move(compressed->data), compressed->levels, true);
+}
+
+// The file's mip chain already holds the smaller levels, so the quality tier drops the top ones
+// in place of downscaling.
+void DropTopLevels(bc::CompressedImage& image, int levels) {
+  const size_t offset = image.levels[levels].offset;
+  image.data.erase(image.data.begin(), image.data.begin() + static_cast<ptrdiff_t>(offset));
+  image.levels.erase(image.levels.begin(), image.levels.begin() + levels);
+  for (bc::MipLevel& level : image.levels) level.offset -= offset;
+}
+
+// Basis Universal payloads are transcoded straight to the role's BCn format, and the file's mip
+// chain is uploaded as is. Metallic roughness can't be repacked before transcoding, so it keeps
+// all channels like ORM does.
+CookedTexture CookKtx2(const std::vector<uint8_t>& bytes, const TextureRequest& request,
+                       TextureCompressionSupport compression) {
+  ZoneScoped;
+  const TextureRole format_role = request.role == TextureRole::kMetallicRoughness
+                                      ? TextureRole::kOcclusionRoughnessMetallic
+                                      : request.role;
+  std::optional<bc::Format> transcode_target;
+  if (compression.enabled) transcode_target = GetBCFormat(format_role, 4, compression.bc7);
+  std::optional<ktx2::Texture> texture = ktx2::Load(bytes, transcode_target);
+  if (!texture) return CookedTexture{};
+
+  if (texture->compressed) {
+    if (!compression.enabled) {
+      spdlog::error("ktx2: block compressed texture without S3TC support");
+      return CookedTexture{};
+    }
+    const int skipped_levels =
+        std::min(request.skipped_levels, static_cast<int>(texture->compressed->levels.size()) - 1);
+    if (skipped_levels > 0) DropTopLevels(texture->compressed.value(), skipped_levels);
+    // blocks are uploaded as stored, so color roles decode them as the file says they're encoded.
+    // The other roles hold data that's never sRGB decoded, whatever the file is marked as.
+    const bool srgb = IsSRGB(request.role) && texture->srgb;
+    const TextureFormat format{
+        .internal_format = bc::GLInternalFormat(texture->compressed->format, srgb),
+        .format = GL_NONE};
+    return MakeCookedTexture(format, std::move(texture->compressed->data),
+                             texture->compressed->levels, true);
+  }
+  // RGBA8 texels take the same path as decoded images
+  const ImageView img{texture->rgba8.data(), texture->width, texture->height, 4};
+  return CookImage(img, request, compression);
+}
+
+CookedTexture CookTexture(const LoadedImage& loaded_image, const TextureRequest& request,
+                          TextureCompressionSupport compression) {
+  if (!loaded_image.ktx2.empty()) return CookKtx2(loaded_image.ktx2, request, compression);
+  return CookImage(loaded_image.image.View(), request, compression);
+}
+
 void UpdateNodeAndChildTransforms(Model& model, SceneNode& node) {
   ZoneScoped;
   std::stack<std::pair<SceneNode*, glm::mat4>> traversal_stack;
@@ -143,6 +493,7 @@ std::optional<fastgltf::Asset> LoadGLTFAsset(const std::filesystem::path& path)
 
   static constexpr auto kSupportedExtensions = fastgltf::Extensions::KHR_mesh_quantization |
                                                fastgltf::Extensions::KHR_texture_transform |
+                                               fastgltf::Extensions::KHR_texture_basisu |
                                                fastgltf::Extensions::KHR_materials_variants;
 
   constexpr auto kOptions =
@@ -175,164 +526,257 @@ std::optional<fastgltf::Asset> LoadGLTFAsset(const std::filesystem::path& path)
   return {};
 }
 
-}  // namespace
-
-namespace loader {
-
-Model LoadModel(ResourceManager& resource_manager, Renderer& renderer,
-                const std::filesystem::path& path, float camera_aspect_ratio) {
+// Decodes the images flagged in load_image on worker threads. KTX2 images are kept encoded and
+// transcoded per role when cooked.
+std::vector<LoadedImage> LoadImages(fastgltf::Asset& asset, const std::filesystem::path& path,
+                                    const std::vector<bool>& load_image) {
   ZoneScoped;
-  PrintTimer t;
-  if (!std::filesystem::exists(path)) {
-    spdlog::error("Failed to find {}", path.string());
-    return {};
-  }
-  auto load_gltf_result = LoadGLTFAsset(path);
-  if (!load_gltf_result) {
-    spdlog::error("Failed to load model: {}", path.string());
-    return {};
+  // Decode only the channels the image's roles need: alpha is only used by the base color of
+  // materials that aren't opaque.
+  std::vector<int> image_channels(asset.images.size(), 3);
+  for (fastgltf::Material& gltf_mat : asset.materials) {
+    if (gltf_mat.alphaMode == fastgltf::AlphaMode::Opaque ||
+        !gltf_mat.pbrData.baseColorTexture.has_value()) {
+      continue;
+    }
+    auto img_idx =
+        TextureImageIndex(asset.textures[gltf_mat.pbrData.baseColorTexture->textureIndex]);
+    if (img_idx.has_value()) image_channels[img_idx.value()] = 4;
   }
-  Model out_model;
-  fastgltf::Asset& asset = load_gltf_result.value();
 
-  // Load images using stb_image
-  // TODO: multithread
-  std::vector<Image> images;
-  images.reserve(asset.images.size());
-  std::vector<std::future<Image>> futures;
-  for (fastgltf::Image& image : asset.images) {
+  std::vector<LoadedImage> images(asset.images.size());
+  std::vector<std::future<LoadedImage>> futures(asset.images.size());
+  for (size_t image_idx = 0; image_idx < asset.images.size(); image_idx++) {
+    if (!load_image[image_idx]) continue;
     ZoneScopedN("Image load");
+    fastgltf::Image& image = asset.images[image_idx];
+    std::future<LoadedImage>& future = futures[image_idx];
+    const int channels = image_channels[image_idx];
     std::visit(
         fastgltf::visitor{
             [](auto&) {},
-            [&path, &futures](fastgltf::sources::URI& file_path) {
-              futures.emplace_back(
-                  ThreadPool::Get().thread_pool.submit_task([&file_path, &path]() -> Image {
+            [&path, &future, channels](fastgltf::sources::URI& file_path) {
+              future = ThreadPool::Get().thread_pool.submit_task(
+                  [&file_path, &path, channels]() -> LoadedImage {
                     const std::string image_file_name(file_path.uri.path().begin(),
                                                       file_path.uri.path().end());
                     const std::filesystem::path full_path = path.parent_path() / image_file_name;
                     if (!std::filesystem::exists(full_path)) {
                       spdlog::error("path does not exist {}", full_path.string());
-                      return Image{};
+                      return LoadedImage{};
                     }
-                    return Image{full_path.string(), 4, false};
-                  }));
+                    return LoadImageFile(full_path, channels);
+                  });
             },
-            [&futures](fastgltf::sources::Array& vector) {
-              futures.emplace_back(ThreadPool::Get().thread_pool.submit_task(
-                  [&vector]() { return Image{vector.bytes.data(), vector.bytes.size(), 4}; }));
+            [&future, channels](fastgltf::sources::Array& vector) {
+              future = ThreadPool::Get().thread_pool.submit_task([&vector, channels]() {
+                return LoadImageBytes(
+                    std::span<const uint8_t>(vector.bytes.data(), vector.bytes.size()), channels);
+              });
             },
-            [&asset, &futures](fastgltf::sources::BufferView& view) {
+            [&asset, &future, channels](fastgltf::sources::BufferView& view) {
               auto& buffer_view = asset.bufferViews[view.bufferViewIndex];
               auto& buffer = asset.buffers[buffer_view.bufferIndex];
               std::visit(fastgltf::visitor{
                              [](auto&) {},
-                             [&futures, &buffer_view](fastgltf::sources::Array& vector) {
-                               futures.emplace_back(ThreadPool::Get().thread_pool.submit_task(
-                                   [&vector, &buffer_view]() {
+                             [&future, &buffer_view, channels](fastgltf::sources::Array& vector) {
+                               future = ThreadPool::Get().thread_pool.submit_task(
+                                   [&vector, &buffer_view, channels]() {
                                      ZoneScopedN("Image Load from memory");
-                                     return Image{vector.bytes.data() + buffer_view.byteOffset,
-                                                  vector.bytes.size(), 4};
-                                   }));
+                                     return LoadImageBytes(
+                                         std::span<const uint8_t>(
+                                             vector.bytes.data() + buffer_view.byteOffset,
+                                             buffer_view.byteLength),
+                                         channels);
+                                   });
                              }},
                          buffer.data);
             }},
         image.data);
   }
 
-  for (auto& future : futures) {
-    images.emplace_back(future.get());
+  for (size_t image_idx = 0; image_idx < futures.size(); image_idx++) {
+    if (futures[image_idx].valid()) images[image_idx] = futures[image_idx].get();
   }
+  return images;
+}
 
-  // Load materials
-  out_model.material_handles.reserve(asset.materials.size());
+TextureCompressionSupport GetTextureCompressionSupport() {
+  return {.enabled = GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB,
+          .bc7 = GLEW_ARB_texture_compression_bptc != 0};
+}
 
-  out_model.texture_handles.resize(asset.textures.size());
-  int num_textures = 0;
-  auto load_texture_and_set_handle =
-      [&path, &asset, &num_textures, &out_model, &images, &resource_manager](
-          uint64_t& out_handle, fastgltf::TextureInfo& tex_info, GLuint internal_format) -> bool {
-    ZoneScopedN("Load tex and set handle");
-    size_t tex_idx = tex_info.textureIndex;
-    auto img_idx = asset.textures[tex_idx].imageIndex;
-    if (!img_idx.has_value()) {
-      spdlog::error("model loader: image not found for model at path {}", path.string());
-      return false;
+// Materials commonly reference the same texture, so textures are requested once per (image,
+// role), alpha tested with the cutoff of the first material that masks it.
+std::vector<TextureRequest> GetTextureRequests(fastgltf::Asset& asset) {
+  std::vector<TextureRequest> requests;
+  std::unordered_set<uint64_t> requested;
+  for (fastgltf::Material& gltf_mat : asset.materials) {
+    for (const MaterialTexture& material_texture : GetMaterialTextures(gltf_mat)) {
+      auto img_idx = TextureImageIndex(asset.textures[material_texture.info->textureIndex]);
+      if (!img_idx.has_value()) continue;
+      const uint64_t cache_key = TextureCacheKey(img_idx.value(), material_texture.role);
+      if (!requested.insert(cache_key).second) continue;
+      std::optional<float> alpha_cutoff;
+      if (material_texture.role == TextureRole::kBaseColor &&
+          gltf_mat.alphaMode == fastgltf::AlphaMode::Mask) {
+        alpha_cutoff = gltf_mat.alphaCutoff;
+      }
+      requests.push_back(TextureRequest{.cache_key = cache_key,
+                                        .image_idx = img_idx.value(),
+                                        .role = material_texture.role,
+                                        .alpha_cutoff = alpha_cutoff});
     }
-    // Load the texture with unique name and creation info
-    auto& img = images[img_idx.value()];
-    out_model.texture_handles[tex_idx] = resource_manager.Load<gl::Texture>(
-        path.string() + std::to_string(num_textures++),
-        // TODO: address texture repeat using sampler
-        gl::Tex2DCreateInfo{.dims = glm::ivec2{img.width, img.height},
-                            .wrap_s = GL_REPEAT,
-                            .wrap_t = GL_REPEAT,
-                            .internal_format = internal_format,
-                            .format = GL_RGBA,
-                            .type = GL_UNSIGNED_BYTE,
-                            .min_filter = GL_LINEAR,
-                            .mag_filter = GL_LINEAR,
-                            .data = static_cast<unsigned char*>(img.data),
-                            .bindless = true,
-                            .gen_mipmaps = true});
-
-    // get the texture and set the handle if it was made
-    auto* tex = resource_manager.Get<gl::Texture>(out_model.texture_handles[tex_idx]);
-    if (tex) {
-      out_handle = tex->BindlessHandle();
-      return true;
+  }
+  return requests;
+}
+
+// Picks the levels the quality tier skips and hashes everything that affects the cooked texture,
+// which textures are shared across models by. False if the image failed to load.
+bool PrepareTextureRequest(TextureRequest& request, const LoadedImage& loaded_image,
+                           TextureCompressionSupport compression, const TextureQuality& quality) {
+  if (!loaded_image.image.data && loaded_image.ktx2.empty()) return false;
+  request.dims = loaded_image.ktx2.empty()
+                     ? glm::ivec2{loaded_image.image.width, loaded_image.image.height}
+                     : ktx2::Dimensions(loaded_image.ktx2).value_or(glm::ivec2{});
+  request.skipped_levels = texture_quality::SkippedLevels(quality, request.dims);
+  util::ContentKey content = loaded_image.content;
+  util::HashCombine(content, static_cast<size_t>(request.role));
+  util::HashCombine(content, compression.enabled);
+  util::HashCombine(content, std::hash<float>{}(request.alpha_cutoff.value_or(-1.f)));
+  // full size textures keep the hash they had before quality tiers, and their cache entries
+  if (request.skipped_levels > 0) {
+    util::HashCombine(content, static_cast<size_t>(request.skipped_levels));
+  }
+  request.content = content;
+  return true;
+}
+
+StreamedTextureData ToStreamedTextureData(CookedTexture cooked) {
+  return StreamedTextureData{.dims = cooked.dims,
+                             .internal_format = cooked.format.internal_format,
+                             .format = cooked.format.format,
+                             .swizzle = cooked.format.swizzle,
+                             .compressed = cooked.compressed,
+                             .data = std::move(cooked.data),
+                             .level_sizes = std::move(cooked.level_sizes)};
+}
+
+}  // namespace
+
+namespace loader {
+
+Model LoadModel(ResourceManager& resource_manager, Renderer& renderer,
+                const std::filesystem::path& path, float camera_aspect_ratio) {
+  ZoneScoped;
+  PrintTimer t;
+  if (!std::filesystem::exists(path)) {
+    spdlog::error("Failed to find {}", path.string());
+    return {};
+  }
+  auto load_gltf_result = LoadGLTFAsset(path);
+  if (!load_gltf_result) {
+    spdlog::error("Failed to load model: {}", path.string());
+    return {};
+  }
+  Model out_model;
+  out_model.path = path.string();
+  fastgltf::Asset& asset = load_gltf_result.value();
+
+  const TextureQuality quality = resource_manager.GetTextureQuality();
+  std::vector<LoadedImage> images =
+      LoadImages(asset, path, std::vector<bool>(asset.images.size(), true));
+
+  const TextureCompressionSupport compression = GetTextureCompressionSupport();
+  std::vector<TextureRequest> texture_requests = GetTextureRequests(asset);
+  std::erase_if(texture_requests, [&](TextureRequest& request) {
+    if (PrepareTextureRequest(request, images[request.image_idx], compression, quality)) {
+      return false;
     }
-    return false;
+    spdlog::error("model loader: failed to decode image {} for model at path {}",
+                  request.image_idx, path.string());
+    return true;
+  });
+  // textures are created once per (image, role) within the model
+  std::unordered_map<uint64_t, AssetHandle> model_texture_cache;
+  const auto add_texture = [&model_texture_cache, &out_model](const TextureRequest& request,
+                                                              AssetHandle handle) {
+    model_texture_cache[request.cache_key] = handle;
+    out_model.texture_handles.emplace_back(handle);
+    if (handle == 0) return;
+    out_model.texture_sources.push_back(TextureSource{.handle = handle,
+                                                      .image_idx = request.image_idx,
+                                                      .role = request.role,
+                                                      .dims = request.dims,
+                                                      .skipped_levels = request.skipped_levels});
   };
 
+  // Textures another model already loaded are shared, the rest are repacked, mipmapped and block
+  // compressed on worker threads.
+  std::vector<std::future<CookedTexture>> cook_futures(texture_requests.size());
+  // cooks still reading each image, it is released once the last one is done
+  std::vector<uint32_t> image_cooks(images.size());
+  for (size_t i = 0; i < texture_requests.size(); i++) {
+    const TextureRequest& request = texture_requests[i];
+    if (auto existing = resource_manager.AcquireExistingTexture(request.content)) {
+      add_texture(request, existing.value());
+      continue;
+    }
+    image_cooks[request.image_idx]++;
+    cook_futures[i] =
+        ThreadPool::Get().thread_pool.submit_task([&images, &request, compression]() {
+          return CookTexture(images[request.image_idx], request, compression);
+        });
+  }
+  for (size_t image_idx = 0; image_idx < images.size(); image_idx++) {
+    if (image_cooks[image_idx] == 0) images[image_idx] = LoadedImage{};
+  }
+
+  size_t texture_bytes = 0;
+  size_t rgba8_texture_bytes = 0;
+  for (size_t i = 0; i < texture_requests.size(); i++) {
+    ZoneScopedN("Create texture");
+    if (!cook_futures[i].valid()) continue;
+    const TextureRequest& request = texture_requests[i];
+    CookedTexture cooked = cook_futures[i].get();
+    if (--image_cooks[request.image_idx] == 0) images[request.image_idx] = LoadedImage{};
+    if (cooked.dims.x == 0) continue;
+    texture_bytes += cooked.compressed
+                         ? cooked.data.size()
+                         : gl::TextureSizeBytes(cooked.format.internal_format, cooked.dims, true);
+    rgba8_texture_bytes += gl::TextureSizeBytes(GL_RGBA8, cooked.dims, true);
+    add_texture(request, resource_manager.AcquireStreamedTexture(
+                             request.content, ToStreamedTextureData(std::move(cooked))));
+  }
+
+  // Load materials
+  out_model.material_handles.reserve(asset.materials.size());
   for (fastgltf::Material& gltf_mat : asset.materials) {
     ZoneScopedN("Material process");
     Material out_mat{};
-    if (gltf_mat.pbrData.baseColorTexture.has_value()) {
-      auto& texture = gltf_mat.pbrData.baseColorTexture.value();
-      // TODO: see if it's possible to have different textures with diff uv scales?
-      if (gltf_mat.pbrData.baseColorTexture->transform) {
-        auto& transform = texture.transform;
-        out_mat.uv_scale = glm::make_vec2(transform->uvScale.data());
-        out_mat.uv_offset = glm::make_vec2(transform->uvOffset.data());
-        out_mat.uv_rotation = transform->rotation;
-      }
-      load_texture_and_set_handle(out_mat.base_color_bindless_handle, texture, GL_SRGB8_ALPHA8);
+    std::vector<std::pair<AssetHandle, TextureRole>> streamed_textures;
+    // TODO: see if it's possible to have different textures with diff uv scales?
+    if (gltf_mat.pbrData.baseColorTexture.has_value() &&
+        gltf_mat.pbrData.baseColorTexture->transform) {
+      auto& transform = gltf_mat.pbrData.baseColorTexture->transform;
+      out_mat.uv_scale = glm::make_vec2(transform->uvScale.data());
+      out_mat.uv_offset = glm::make_vec2(transform->uvOffset.data());
+      out_mat.uv_rotation = transform->rotation;
     }
-
-    // has metallic roughness and occlusion and indices are the same -> occlusionRoughnessMetallic
-    if (gltf_mat.pbrData.metallicRoughnessTexture.has_value() &&
-        gltf_mat.occlusionTexture.has_value() &&
-        gltf_mat.pbrData.metallicRoughnessTexture->textureIndex ==
-            gltf_mat.occlusionTexture->textureIndex) {
-      if (load_texture_and_set_handle(out_mat.metallic_roughness_bindless_handle,
-                                      gltf_mat.pbrData.metallicRoughnessTexture.value(),
-                                      GL_RGBA8)) {
-        out_mat.material_flags |= MaterialFlags::kOcclusionRoughnessMetallic;
-      }
-    } else {
-      // metallic roughness
-      if (gltf_mat.pbrData.metallicRoughnessTexture.has_value()) {
-        if (load_texture_and_set_handle(out_mat.metallic_roughness_bindless_handle,
-                                        gltf_mat.pbrData.metallicRoughnessTexture.value(),
-                                        GL_RGBA8)) {
-          out_mat.material_flags |= MaterialFlags::kMetallicRoughness;
-        }
-      }
-      // occlusion
-      if (gltf_mat.occlusionTexture.has_value()) {
-        load_texture_and_set_handle(out_mat.occlusion_bindless_handle,
-                                    gltf_mat.occlusionTexture.value(), GL_RGBA8);
+    for (const MaterialTexture& material_texture : GetMaterialTextures(gltf_mat)) {
+      auto img_idx = TextureImageIndex(asset.textures[material_texture.info->textureIndex]);
+      if (!img_idx.has_value()) {
+        spdlog::error("model loader: image not found for model at path {}", path.string());
+        continue;
       }
-    }
-
-    if (gltf_mat.emissiveTexture.has_value()) {
-      load_texture_and_set_handle(out_mat.emissive_bindless_handle,
-                                  gltf_mat.emissiveTexture.value(), GL_SRGB8_ALPHA8);
-    }
-    if (gltf_mat.normalTexture.has_value()) {
-      load_texture_and_set_handle(out_mat.normal_bindless_handle, gltf_mat.normalTexture.value(),
-                                  GL_RGBA8);
+      auto it = model_texture_cache.find(TextureCacheKey(img_idx.value(), material_texture.role));
+      if (it == model_texture_cache.end() || it->second == 0) continue;
+      // get the texture and set the handle if it was made
+      const uint64_t texture_handle = resource_manager.MaterialTextureHandle(it->second);
+      if (!texture_handle) continue;
+      MaterialTextureHandle(out_mat, material_texture.role) = texture_handle;
+      out_mat.material_flags |= MaterialTextureFlag(material_texture.role);
+      streamed_textures.emplace_back(it->second, material_texture.role);
     }
 
     auto& base_color = gltf_mat.pbrData.baseColorFactor;
@@ -356,13 +800,23 @@ Model LoadModel(ResourceManager& resource_manager, Renderer& renderer,
           return AlphaMode::kBlend;
       }
     };
-    out_model.material_handles.emplace_back(
-        renderer.AllocateMaterial(out_mat, convert_alpha_mode(gltf_mat.alphaMode)));
+    const AssetHandle material_handle =
+        renderer.AllocateMaterial(out_mat, convert_alpha_mode(gltf_mat.alphaMode));
+    out_model.material_handles.emplace_back(material_handle);
+    if (material_handle == 0) continue;
+    for (const auto& [texture_handle, role] : streamed_textures) {
+      resource_manager.GetTextureStreamer().AddMaterialUse(texture_handle, material_handle, role);
+    }
   }
 
-  for (auto& img : images) {
-    img.Free();
-  }
+  constexpr double kBytesToMiB = 1.0 / (1024.0 * 1024.0);
+  spdlog::info("{}: {} textures, {:.2f} MiB VRAM at full resolution, {:.2f} MiB saved vs RGBA8",
+               path.string(), out_model.texture_handles.size(), texture_bytes * kBytesToMiB,
+               (rgba8_texture_bytes - texture_bytes) * kBytesToMiB);
+  const image_pool::Stats pool_stats = image_pool::GetStats();
+  spdlog::info("image pool: {:.2f} MiB retained, {} of {} decode buffers reused",
+               pool_stats.retained_bytes * kBytesToMiB, pool_stats.reused_blocks,
+               pool_stats.reused_blocks + pool_stats.allocated_blocks);
 
   struct Data {
     std::vector<Vertex> vertices;
@@ -611,4 +1065,72 @@ Model LoadModel(ResourceManager& resource_manager, Renderer& renderer,
   return out_model;
 }
 
+void ReloadTextures(ResourceManager& resource_manager, Model& model,
+                    std::unordered_set<AssetHandle>& reloaded) {
+  ZoneScoped;
+  const TextureQuality quality = resource_manager.GetTextureQuality();
+  std::vector<TextureSource*> sources;
+  for (TextureSource& source : model.texture_sources) {
+    const int skipped_levels = texture_quality::SkippedLevels(quality, source.dims);
+    if (skipped_levels == source.skipped_levels) continue;
+    // shared textures were already cooked for a model reloaded before this one
+    if (reloaded.insert(source.handle).second) {
+      sources.push_back(&source);
+    } else {
+      source.skipped_levels = skipped_levels;
+    }
+  }
+  if (sources.empty()) return;
+
+  auto load_gltf_result = LoadGLTFAsset(model.path);
+  if (!load_gltf_result) {
+    spdlog::error("Failed to reload textures of model: {}", model.path);
+    return;
+  }
+  fastgltf::Asset& asset = load_gltf_result.value();
+  std::vector<bool> load_image(asset.images.size());
+  for (const TextureSource* source : sources) {
+    // the file may have changed since it was loaded
+    if (source->image_idx < load_image.size()) load_image[source->image_idx] = true;
+  }
+  const std::vector<LoadedImage> images = LoadImages(asset, model.path, load_image);
+
+  struct Reload {
+    TextureSource* source;
+    TextureRequest request;
+    std::future<CookedTexture> cooked;
+  };
+  const TextureCompressionSupport compression = GetTextureCompressionSupport();
+  const std::vector<TextureRequest> texture_requests = GetTextureRequests(asset);
+  std::vector<Reload> reloads;
+  for (TextureSource* source : sources) {
+    auto it = std::ranges::find_if(texture_requests, [source](const TextureRequest& request) {
+      return request.image_idx == source->image_idx && request.role == source->role;
+    });
+    if (it == texture_requests.end()) continue;
+    TextureRequest request = *it;
+    if (!PrepareTextureRequest(request, images[request.image_idx], compression, quality)) {
+      spdlog::error("model loader: failed to decode image {} for model at path {}",
+                    request.image_idx, model.path);
+      continue;
+    }
+    std::future<CookedTexture> cooked = ThreadPool::Get().thread_pool.submit_task(
+        [&images, request, compression]() {
+          return CookTexture(images[request.image_idx], request, compression);
+        });
+    reloads.push_back(
+        Reload{.source = source, .request = request, .cooked = std::move(cooked)});
+  }
+
+  for (Reload& reload : reloads) {
+    CookedTexture cooked = reload.cooked.get();
+    if (cooked.dims.x == 0) continue;
+    resource_manager.ReplaceStreamedTexture(reload.source->handle, reload.request.content,
+                                            ToStreamedTextureData(std::move(cooked)));
+    reload.source->skipped_levels = reload.request.skipped_levels;
+  }
+  spdlog::info("{}: reloaded {} of {} textures", model.path, reloads.size(),
+               model.texture_sources.size());
+}
+
 }  // namespace loader
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <unordered_set>
 
+using AssetHandle = uint32_t;
 class Renderer;
 class ResourceManager;
 struct Model;
@@ -14,4 +17,11 @@ namespace loader {
 
 [[nodiscard]] extern Model LoadModel(ResourceManager& resource_manager, Renderer& renderer,
                                      const std::filesystem::path& path, float camera_aspect_ratio);
+
+// Cooks the model's textures again from its file if their size changes under the resource
+// manager's texture quality tier, others are left as they are. Textures in reloaded were already
+// cooked for another model sharing them, and the ones cooked here are added to it.
+void ReloadTextures(ResourceManager& resource_manager, Model& model,
+                    std::unordered_set<AssetHandle>& reloaded);
+
 }  // namespace loader
@@ -0,0 +1,352 @@
+#include "MipChain.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#include "pch.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_CHAIN_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace mip {
+
+namespace {
+
+// Texels are RGBA floats while filtering, so each one fills a SIMD register.
+#ifdef MIP_CHAIN_SSE2
+using Vec4 = __m128;
+inline Vec4 Load4(const float* p) { return _mm_loadu_ps(p); }
+inline void Store4(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+inline Vec4 Zero4() { return _mm_setzero_ps(); }
+inline Vec4 Add4(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+inline Vec4 Mul4(Vec4 a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+inline Vec4 Saturate4(Vec4 a) {
+  return _mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), _mm_set1_ps(1.f));
+}
+#else
+struct Vec4 {
+  float v[4];
+};
+inline Vec4 Load4(const float* p) { return {p[0], p[1], p[2], p[3]}; }
+inline void Store4(float* p, Vec4 v) { std::memcpy(p, v.v, sizeof(v.v)); }
+inline Vec4 Zero4() { return {}; }
+inline Vec4 Add4(Vec4 a, Vec4 b) {
+  return {a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]};
+}
+inline Vec4 Mul4(Vec4 a, float s) { return {a.v[0] * s, a.v[1] * s, a.v[2] * s, a.v[3] * s}; }
+inline Vec4 Saturate4(Vec4 a) {
+  for (float& c : a.v) c = std::clamp(c, 0.f, 1.f);
+  return a;
+}
+#endif
+
+struct FloatImage {
+  int width;
+  int height;
+  std::vector<float> texels;  // RGBA
+};
+
+float SRGBToLinear(float c) {
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSRGB(float c) {
+  return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+}
+
+const std::array<float, 256>& SRGBToLinearTable() {
+  static const std::array<float, 256> table = [] {
+    std::array<float, 256> result{};
+    for (int i = 0; i < 256; i++) result[i] = SRGBToLinear(i / 255.f);
+    return result;
+  }();
+  return table;
+}
+
+// Fine enough that every 8 bit sRGB value is reachable: the curve's steepest step near black is
+// still under one output LSB.
+constexpr int kLinearToSRGBTableSize = 4096;
+const std::array<uint8_t, kLinearToSRGBTableSize>& LinearToSRGBTable() {
+  static const std::array<uint8_t, kLinearToSRGBTableSize> table = [] {
+    std::array<uint8_t, kLinearToSRGBTableSize> result{};
+    for (int i = 0; i < kLinearToSRGBTableSize; i++) {
+      const float srgb = LinearToSRGB(static_cast<float>(i) / (kLinearToSRGBTableSize - 1));
+      result[i] = static_cast<uint8_t>(srgb * 255.f + 0.5f);
+    }
+    return result;
+  }();
+  return table;
+}
+
+inline Vec4 LoadTexel(const uint8_t* src, int channels, bool srgb,
+                      const std::array<float, 256>& to_linear) {
+  float texel[4]{0.f, 0.f, 0.f, 1.f};
+  for (int c = 0; c < channels; c++) {
+    texel[c] = srgb && c < 3 ? to_linear[src[c]] : src[c] / 255.f;
+  }
+  return Load4(texel);
+}
+
+uint8_t QuantizeUnorm(float c) { return static_cast<uint8_t>(c * 255.f + 0.5f); }
+
+FloatImage ToFloat(const uint8_t* pixels, int width, int height, int channels, bool srgb) {
+  ZoneScoped;
+  const auto& to_linear = SRGBToLinearTable();
+  const size_t num_texels = static_cast<size_t>(width) * height;
+  FloatImage result{.width = width, .height = height, .texels = {}};
+  result.texels.resize(num_texels * 4);
+  for (size_t i = 0; i < num_texels; i++) {
+    const uint8_t* src = pixels + i * channels;
+    float* dst = &result.texels[i * 4];
+    for (int c = 0; c < 4; c++) {
+      if (c >= channels) {
+        dst[c] = c == 3 ? 1.f : 0.f;
+      } else {
+        dst[c] = srgb && c < 3 ? to_linear[src[c]] : src[c] / 255.f;
+      }
+    }
+  }
+  return result;
+}
+
+FloatImage DownsampleBox(const FloatImage& src) {
+  ZoneScoped;
+  FloatImage dst{
+      .width = std::max(src.width / 2, 1), .height = std::max(src.height / 2, 1), .texels = {}};
+  dst.texels.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+  for (int y = 0; y < dst.height; y++) {
+    const float* row0 = &src.texels[static_cast<size_t>(std::min(y * 2, src.height - 1)) *
+                                    src.width * 4];
+    const float* row1 = &src.texels[static_cast<size_t>(std::min(y * 2 + 1, src.height - 1)) *
+                                    src.width * 4];
+    float* out = &dst.texels[static_cast<size_t>(y) * dst.width * 4];
+    for (int x = 0; x < dst.width; x++) {
+      const int x0 = std::min(x * 2, src.width - 1) * 4;
+      const int x1 = std::min(x * 2 + 1, src.width - 1) * 4;
+      const Vec4 sum = Add4(Add4(Load4(row0 + x0), Load4(row0 + x1)),
+                            Add4(Load4(row1 + x0), Load4(row1 + x1)));
+      Store4(out + x * 4, Mul4(sum, 0.25f));
+    }
+  }
+  return dst;
+}
+
+constexpr int kKaiserTaps = 6;
+constexpr float kKaiserAlpha = 4.f;
+// half width of the window, in destination texels
+constexpr float kKaiserRadius = 1.5f;
+
+// zeroth order modified Bessel function of the first kind
+float BesselI0(float x) {
+  float sum = 1.f;
+  float term = 1.f;
+  for (int k = 1; k < 16; k++) {
+    term *= (x / (2.f * k)) * (x / (2.f * k));
+    sum += term;
+  }
+  return sum;
+}
+
+float KaiserSinc(float x) {
+  if (std::abs(x) >= kKaiserRadius) return 0.f;
+  const float t = x / kKaiserRadius;
+  const float window = BesselI0(kKaiserAlpha * std::sqrt(1.f - t * t)) / BesselI0(kKaiserAlpha);
+  const float px = std::numbers::pi_v<float> * x;
+  return (x == 0.f ? 1.f : std::sin(px) / px) * window;
+}
+
+// Source taps and normalized weights for each destination texel along one axis.
+struct Kernel {
+  std::vector<int> taps;
+  std::vector<float> weights;
+};
+
+Kernel BuildKaiserKernel(int src_size, int dst_size) {
+  Kernel kernel;
+  kernel.taps.resize(static_cast<size_t>(dst_size) * kKaiserTaps);
+  kernel.weights.resize(kernel.taps.size());
+  const float scale = static_cast<float>(src_size) / dst_size;
+  for (int i = 0; i < dst_size; i++) {
+    const float center = (i + 0.5f) * scale - 0.5f;
+    const int first = static_cast<int>(std::floor(center)) - kKaiserTaps / 2 + 1;
+    float total = 0.f;
+    for (int t = 0; t < kKaiserTaps; t++) {
+      const size_t idx = static_cast<size_t>(i) * kKaiserTaps + t;
+      const float weight = KaiserSinc((first + t - center) / scale);
+      kernel.taps[idx] = std::clamp(first + t, 0, src_size - 1);
+      kernel.weights[idx] = weight;
+      total += weight;
+    }
+    for (int t = 0; t < kKaiserTaps; t++) {
+      kernel.weights[static_cast<size_t>(i) * kKaiserTaps + t] /= total;
+    }
+  }
+  return kernel;
+}
+
+// Separable: filters rows into a half width image, then its columns.
+FloatImage DownsampleKaiser(const FloatImage& src) {
+  ZoneScoped;
+  const int dst_width = std::max(src.width / 2, 1);
+  const int dst_height = std::max(src.height / 2, 1);
+  const Kernel kernel_x = BuildKaiserKernel(src.width, dst_width);
+  const Kernel kernel_y = BuildKaiserKernel(src.height, dst_height);
+
+  std::vector<float> horizontal(static_cast<size_t>(dst_width) * src.height * 4);
+  for (int y = 0; y < src.height; y++) {
+    const float* row = &src.texels[static_cast<size_t>(y) * src.width * 4];
+    float* out = &horizontal[static_cast<size_t>(y) * dst_width * 4];
+    for (int x = 0; x < dst_width; x++) {
+      Vec4 sum = Zero4();
+      for (int t = 0; t < kKaiserTaps; t++) {
+        const size_t idx = static_cast<size_t>(x) * kKaiserTaps + t;
+        sum = Add4(sum, Mul4(Load4(row + kernel_x.taps[idx] * 4), kernel_x.weights[idx]));
+      }
+      Store4(out + x * 4, sum);
+    }
+  }
+
+  FloatImage dst{.width = dst_width, .height = dst_height, .texels = {}};
+  dst.texels.resize(static_cast<size_t>(dst_width) * dst_height * 4);
+  for (int y = 0; y < dst_height; y++) {
+    float* out = &dst.texels[static_cast<size_t>(y) * dst_width * 4];
+    for (int x = 0; x < dst_width; x++) {
+      Vec4 sum = Zero4();
+      for (int t = 0; t < kKaiserTaps; t++) {
+        const size_t idx = static_cast<size_t>(y) * kKaiserTaps + t;
+        const float* texel =
+            &horizontal[(static_cast<size_t>(kernel_y.taps[idx]) * dst_width + x) * 4];
+        sum = Add4(sum, Mul4(Load4(texel), kernel_y.weights[idx]));
+      }
+      // negative lobes ring past [0, 1] on hard edges
+      Store4(out + x * 4, Saturate4(sum));
+    }
+  }
+  return dst;
+}
+
+float AlphaCoverage(const FloatImage& img, float cutoff, float scale) {
+  size_t passed = 0;
+  // textured.fs.glsl discards alpha < cutoff, so texels at the cutoff are drawn
+  for (size_t i = 3; i < img.texels.size(); i += 4) {
+    if (std::min(img.texels[i] * scale, 1.f) >= cutoff) passed++;
+  }
+  return static_cast<float>(passed) / static_cast<float>(img.texels.size() / 4);
+}
+
+// Coverage only grows with the scale, so binary search the scale that matches the target.
+float FindAlphaScale(const FloatImage& img, float cutoff, float target_coverage) {
+  ZoneScoped;
+  float lo = 0.f;
+  float hi = 4.f;
+  for (int iter = 0; iter < 12; iter++) {
+    const float mid = (lo + hi) * 0.5f;
+    if (AlphaCoverage(img, cutoff, mid) < target_coverage) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  // coverage is a step function, take whichever side lands closer
+  const float lo_error = std::abs(AlphaCoverage(img, cutoff, lo) - target_coverage);
+  const float hi_error = std::abs(AlphaCoverage(img, cutoff, hi) - target_coverage);
+  return lo_error < hi_error ? lo : hi;
+}
+
+void Quantize(const FloatImage& img, int channels, bool srgb, float alpha_scale, uint8_t* out) {
+  ZoneScoped;
+  const auto& to_srgb = LinearToSRGBTable();
+  const size_t num_texels = static_cast<size_t>(img.width) * img.height;
+  for (size_t i = 0; i < num_texels; i++) {
+    const float* src = &img.texels[i * 4];
+    uint8_t* dst = out + i * channels;
+    for (int c = 0; c < channels; c++) {
+      const float value = std::clamp(c == 3 ? src[c] * alpha_scale : src[c], 0.f, 1.f);
+      dst[c] = srgb && c < 3
+                   ? to_srgb[static_cast<int>(value * (kLinearToSRGBTableSize - 1) + 0.5f)]
+                   : QuantizeUnorm(value);
+    }
+  }
+}
+
+}  // namespace
+
+int NumLevels(int width, int height) {
+  return 1 + static_cast<int>(std::floor(std::log2(std::max(width, height))));
+}
+
+std::vector<uint8_t> Downscale(const uint8_t* pixels, int width, int height, int channels,
+                               int levels, bool srgb) {
+  ZoneScoped;
+  const int factor = 1 << levels;
+  const int dst_width = std::max(width >> levels, 1);
+  const int dst_height = std::max(height >> levels, 1);
+  const auto& to_linear = SRGBToLinearTable();
+  std::vector<uint8_t> result(static_cast<size_t>(dst_width) * dst_height * channels);
+  // one destination row of sums, normalized in place before quantizing
+  FloatImage row{.width = dst_width, .height = 1, .texels = {}};
+  row.texels.resize(static_cast<size_t>(dst_width) * 4);
+  for (int y = 0; y < dst_height; y++) {
+    std::ranges::fill(row.texels, 0.f);
+    const int y0 = y * factor;
+    const int y1 = std::min(y0 + factor, height);
+    for (int src_y = y0; src_y < y1; src_y++) {
+      const uint8_t* src_row = pixels + static_cast<size_t>(src_y) * width * channels;
+      for (int x = 0; x < dst_width; x++) {
+        const int x1 = std::min((x + 1) * factor, width);
+        Vec4 sum = Load4(&row.texels[static_cast<size_t>(x) * 4]);
+        for (int src_x = x * factor; src_x < x1; src_x++) {
+          sum = Add4(sum, LoadTexel(src_row + static_cast<size_t>(src_x) * channels, channels,
+                                    srgb, to_linear));
+        }
+        Store4(&row.texels[static_cast<size_t>(x) * 4], sum);
+      }
+    }
+    for (int x = 0; x < dst_width; x++) {
+      const int num_texels = (std::min((x + 1) * factor, width) - x * factor) * (y1 - y0);
+      float* texel = &row.texels[static_cast<size_t>(x) * 4];
+      Store4(texel, Mul4(Load4(texel), 1.f / static_cast<float>(num_texels)));
+    }
+    Quantize(row, channels, srgb, 1.f,
+             result.data() + static_cast<size_t>(y) * dst_width * channels);
+  }
+  return result;
+}
+
+Chain Generate(const uint8_t* pixels, int width, int height, int channels,
+               const GenerateInfo& info) {
+  ZoneScoped;
+  Chain chain;
+  chain.channels = channels;
+  const int num_levels = NumLevels(width, height);
+  size_t total_size = 0;
+  for (int level = 0, w = width, h = height; level < num_levels; level++) {
+    const size_t size = static_cast<size_t>(w) * h * channels;
+    chain.levels.emplace_back(
+        Level{.width = w, .height = h, .offset = total_size, .size_bytes = size});
+    total_size += size;
+    w = std::max(w / 2, 1);
+    h = std::max(h / 2, 1);
+  }
+  chain.data.resize(total_size);
+  std::memcpy(chain.data.data(), pixels, chain.levels[0].size_bytes);
+  if (num_levels == 1) return chain;
+
+  const bool preserve_coverage = info.alpha_cutoff.has_value() && channels == 4;
+  FloatImage img = ToFloat(pixels, width, height, channels, info.srgb);
+  const float target_coverage =
+      preserve_coverage ? AlphaCoverage(img, info.alpha_cutoff.value(), 1.f) : 0.f;
+  for (size_t level = 1; level < chain.levels.size(); level++) {
+    img = info.filter == Filter::kKaiser ? DownsampleKaiser(img) : DownsampleBox(img);
+    const float alpha_scale =
+        preserve_coverage ? FindAlphaScale(img, info.alpha_cutoff.value(), target_coverage) : 1.f;
+    Quantize(img, channels, info.srgb, alpha_scale, chain.data.data() + chain.levels[level].offset);
+  }
+  return chain;
+}
+
+}  // namespace mip
@@ -0,0 +1,45 @@
+#pragma once
+
+namespace mip {
+
+enum class Filter : uint8_t {
+  kBox,     // 2x2 average
+  kKaiser,  // Kaiser windowed sinc, sharper with less aliasing
+};
+
+struct Level {
+  int width;
+  int height;
+  size_t offset;
+  size_t size_bytes;
+};
+
+// Every mip level of an image with 8 bit channels, stored contiguously from level 0 down.
+struct Chain {
+  int channels{};
+  std::vector<Level> levels;
+  std::vector<uint8_t> data;
+};
+
+struct GenerateInfo {
+  Filter filter{Filter::kKaiser};
+  // RGB is sRGB encoded and filtered in linear space, alpha is always linear
+  bool srgb{false};
+  // alpha tested textures: scales each level's alpha so the fraction of texels passing the test
+  // matches level 0, otherwise alpha tested geometry thins out in the distance
+  std::optional<float> alpha_cutoff{};
+};
+
+// Levels are filtered from the previous level in float, and only quantized for output.
+[[nodiscard]] Chain Generate(const uint8_t* pixels, int width, int height, int channels,
+                             const GenerateInfo& info);
+
+[[nodiscard]] int NumLevels(int width, int height);
+
+// Box filters an image with 8 bit channels down by 2^levels in one pass, for images larger than
+// they will ever be sampled. Rows are accumulated in place of converting the whole image to float,
+// so it costs a fraction of Generate on the full size image.
+[[nodiscard]] std::vector<uint8_t> Downscale(const uint8_t* pixels, int width, int height,
+                                             int channels, int levels, bool srgb);
+
+}  // namespace mip
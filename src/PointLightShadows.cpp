@@ -0,0 +1,227 @@
+#include "PointLightShadows.hpp"
+
+#include <imgui.h>
+
+#include <functional>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/trigonometric.hpp>
+
+#include "AABB.hpp"
+#include "CubeMapConverter.hpp"
+#include "Frustum.hpp"
+#include "LightManager.hpp"
+#include "Renderer.hpp"
+#include "gl/ShaderManager.hpp"
+#include "pch.hpp"
+
+namespace {
+
+// must match point_shadow_map and the light slot buffer in textured.fs.glsl
+constexpr GLuint kAtlasUnit = 15;
+constexpr GLuint kLightSlotsSlot = 7;
+// must match POINT_SHADOW_NEAR in textured.fs.glsl
+constexpr float kNearPlane = 0.05f;
+constexpr uint32_t kFacesPerLight = 6;
+constexpr uint32_t kInitialCapacity = 256;
+// lights holding a slot keep it until another covers this much more of the screen, so slots
+// don't change hands every frame between lights of about equal coverage
+constexpr float kHeldSlotBonus = 1.25f;
+
+AABB SphereBounds(const glm::vec3& center, float radius) {
+  return {center - glm::vec3{radius}, center + glm::vec3{radius}};
+}
+
+// Fraction of the screen the sphere's projection covers, clamped to 1.
+float ScreenCoverage(const glm::vec3& center, float radius, const RenderInfo& render_info) {
+  const float dist_sq = glm::dot(center - render_info.view_pos, center - render_info.view_pos);
+  if (dist_sq <= radius * radius) return 1.f;
+  // tangent of the sphere's angular radius, scaled to NDC by the projection
+  const float tan_radius = radius / std::sqrt(dist_sq - radius * radius);
+  const glm::mat4& proj = render_info.projection_matrix;
+  const float ndc_area = glm::pi<float>() * tan_radius * proj[0][0] * tan_radius * proj[1][1];
+  return std::min(ndc_area / 4.f, 1.f);
+}
+
+}  // namespace
+
+void PointLightShadows::Init() {
+  atlas_ = gl::CreateTexture(GL_TEXTURE_CUBE_MAP_ARRAY);
+  glTextureStorage3D(atlas_.Id(), 1, GL_DEPTH_COMPONENT32F, kFaceSize, kFaceSize,
+                     kMaxShadowedLights * kFacesPerLight);
+  glTextureParameteri(atlas_.Id(), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(atlas_.Id(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(atlas_.Id(), GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTextureParameteri(atlas_.Id(), GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glTextureParameteri(atlas_.Id(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(atlas_.Id(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(atlas_.Id(), GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  fbo_ = gl::CreateFramebuffer();
+  glNamedFramebufferDrawBuffer(fbo_.Id(), GL_NONE);
+  glNamedFramebufferReadBuffer(fbo_.Id(), GL_NONE);
+
+  light_slots_capacity_ = kInitialCapacity;
+  light_slots_ssbo_.Init(light_slots_capacity_, GL_DYNAMIC_STORAGE_BIT, nullptr);
+}
+
+void PointLightShadows::Update(Renderer& renderer, const RenderInfo& render_info) {
+  ZoneScoped;
+  faces_last_frame_ = 0;
+  stale_lights_last_frame_ = 0;
+  if (!settings.enabled) return;
+  const LightManager& lights = renderer.GetLightManager();
+
+  if (light_slots_.size() != lights.Size()) {
+    light_slots_.resize(lights.Size(), kNoSlot);
+    for (Slot& slot : slots_) {
+      if (slot.light != kNoLight && slot.light >= lights.Size()) slot = Slot{};
+    }
+    light_slots_dirty_ = true;
+  }
+
+  const Frustum frustum =
+      Frustum::FromViewProjection(render_info.projection_matrix * render_info.view_matrix);
+  candidates_.clear();
+  for (uint32_t i = 0; i < lights.Size(); i++) {
+    const float radius = lights.Radius(i);
+    if (!lights.CastsShadows(i) || radius <= kNearPlane) continue;
+    const glm::vec3& position = lights.Position(i);
+    if (!frustum.Intersects(SphereBounds(position, radius))) continue;
+    float coverage = ScreenCoverage(position, radius, render_info);
+    if (light_slots_[i] != kNoSlot) coverage *= kHeldSlotBonus;
+    candidates_.emplace_back(coverage, i);
+  }
+  const size_t num_shadowed = std::min<size_t>(candidates_.size(), kMaxShadowedLights);
+  std::partial_sort(candidates_.begin(), candidates_.begin() + num_shadowed, candidates_.end(),
+                    std::greater<>{});
+
+  // free the slots of lights that dropped out, then hand them to the lights that made it in
+  std::array<bool, kMaxShadowedLights> kept{};
+  for (size_t i = 0; i < num_shadowed; i++) {
+    const uint32_t slot_idx = light_slots_[candidates_[i].second];
+    if (slot_idx != kNoSlot) kept[slot_idx] = true;
+  }
+  for (uint32_t slot_idx = 0; slot_idx < kMaxShadowedLights; slot_idx++) {
+    Slot& slot = slots_[slot_idx];
+    if (slot.light == kNoLight || kept[slot_idx]) continue;
+    light_slots_[slot.light] = kNoSlot;
+    slot = Slot{};
+    light_slots_dirty_ = true;
+  }
+  uint32_t free_slot = 0;
+  for (size_t i = 0; i < num_shadowed; i++) {
+    const uint32_t light = candidates_[i].second;
+    if (light_slots_[light] != kNoSlot) continue;
+    while (slots_[free_slot].light != kNoLight) free_slot++;
+    slots_[free_slot] = Slot{.light = light};
+    light_slots_[light] = free_slot;
+    light_slots_dirty_ = true;
+  }
+  if (light_slots_dirty_) UploadLightSlots();
+
+  // the budget goes to the stale slots covering the most of the screen
+  uint32_t budget = std::max(settings.max_face_updates_per_frame, kFacesPerLight);
+  const uint64_t static_generation = renderer.StaticGeneration();
+  for (size_t i = 0; i < num_shadowed; i++) {
+    const uint32_t light = candidates_[i].second;
+    const uint32_t slot_idx = light_slots_[light];
+    Slot& slot = slots_[slot_idx];
+    const bool stale =
+        !slot.rendered || slot.position != lights.Position(light) ||
+        slot.radius != lights.Radius(light) ||
+        renderer.StaticChangedSince(slot.static_generation,
+                                    SphereBounds(slot.position, slot.radius));
+    if (!stale) continue;
+    if (budget < kFacesPerLight) {
+      stale_lights_last_frame_++;
+      continue;
+    }
+    budget -= kFacesPerLight;
+    slot.position = lights.Position(light);
+    slot.radius = lights.Radius(light);
+    slot.static_generation = static_generation;
+    slot.rendered = true;
+    RenderSlot(renderer, slot, slot_idx);
+    faces_last_frame_ += kFacesPerLight;
+  }
+}
+
+void PointLightShadows::UploadLightSlots() {
+  light_slots_dirty_ = false;
+  if (light_slots_.empty()) return;
+  if (light_slots_.size() > light_slots_capacity_) {
+    light_slots_capacity_ =
+        std::max(static_cast<uint32_t>(light_slots_.size()), light_slots_capacity_ * 2);
+    light_slots_ssbo_.Init(light_slots_capacity_, GL_DYNAMIC_STORAGE_BIT, nullptr);
+  }
+  light_slots_ssbo_.SubDataIndex(light_slots_.size(), 0, light_slots_.data());
+}
+
+void PointLightShadows::RenderSlot(Renderer& renderer, Slot& slot, uint32_t slot_idx) const {
+  ZoneScoped;
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_.Id());
+  glViewport(0, 0, kFaceSize, kFaceSize);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+  // open meshes cast shadows from both sides
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(settings.slope_bias, settings.constant_bias);
+  gl::Shader shader = gl::ShaderManager::Get().GetShader("shadow_depth").value();
+  shader.Bind();
+  // the far plane at the radius keeps depth precision where the light reaches
+  const glm::mat4 proj = glm::perspective(glm::radians(90.f), 1.f, kNearPlane, slot.radius);
+  slot.num_draws = 0;
+  for (uint32_t face = 0; face < kFacesPerLight; face++) {
+    glNamedFramebufferTextureLayer(fbo_.Id(), GL_DEPTH_ATTACHMENT, atlas_.Id(), 0,
+                                   static_cast<GLint>(slot_idx * kFacesPerLight + face));
+    glClear(GL_DEPTH_BUFFER_BIT);
+    const glm::mat4 view_proj =
+        proj * CubeMapConverter::CaptureView(static_cast<int>(face), slot.position);
+    shader.SetMat4("u_light_vp", view_proj);
+    slot.num_draws += renderer.DrawStaticDepth(view_proj);
+  }
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PointLightShadows::BindForShading(gl::Shader& shader) const {
+  shader.SetBool("u_point_shadows_enabled", settings.enabled);
+  if (!settings.enabled) return;
+  // a radius of 0 marks slots whose faces aren't rendered yet
+  std::array<glm::vec4, kMaxShadowedLights> params;
+  for (uint32_t i = 0; i < kMaxShadowedLights; i++) {
+    params[i] = slots_[i].rendered ? glm::vec4(slots_[i].position, slots_[i].radius) : glm::vec4{0};
+  }
+  shader.SetVec4Arr("u_point_shadow_params[0]", kMaxShadowedLights, params.data());
+  // texels at distance d are 2d / kFaceSize wide for the 90 degree faces
+  shader.SetFloat("u_point_shadow_normal_bias", settings.normal_bias * 2.f / kFaceSize);
+  light_slots_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, kLightSlotsSlot);
+  glBindTextureUnit(kAtlasUnit, atlas_.Id());
+}
+
+void PointLightShadows::OnImGui() {
+  ImGui::Begin("Point Light Shadows", nullptr,
+               ImGuiWindowFlags_NoNavFocus | ImGuiWindowFlags_NoFocusOnAppearing);
+  ImGui::Checkbox("Enabled", &settings.enabled);
+  int budget = static_cast<int>(settings.max_face_updates_per_frame);
+  if (ImGui::SliderInt("Face Updates Per Frame", &budget, kFacesPerLight, 96)) {
+    settings.max_face_updates_per_frame = budget;
+  }
+  ImGui::SliderFloat("Normal Bias (texels)", &settings.normal_bias, 0.f, 4.f);
+  bool changed = ImGui::SliderFloat("Slope Bias", &settings.slope_bias, 0.f, 8.f);
+  changed |= ImGui::SliderFloat("Constant Bias", &settings.constant_bias, 0.f, 16.f);
+  if (changed) {
+    for (Slot& slot : slots_) slot.rendered = false;
+  }
+  ImGui::Text("Casting lights in view: %zu", candidates_.size());
+  ImGui::Text("Faces rendered last frame: %u, stale lights waiting: %u", faces_last_frame_,
+              stale_lights_last_frame_);
+  for (uint32_t i = 0; i < kMaxShadowedLights; i++) {
+    if (slots_[i].light == kNoLight) continue;
+    ImGui::Text("Slot %u: light %u, %u draws%s", i, slots_[i].light, slots_[i].num_draws,
+                slots_[i].rendered ? "" : " (pending)");
+  }
+  ImGui::End();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+
+#include "gl/Buffer.hpp"
+#include "gl/Handle.hpp"
+
+class Renderer;
+struct RenderInfo;
+namespace gl {
+class Shader;
+}  // namespace gl
+
+struct PointLightShadowSettings {
+  bool enabled{true};
+  // Cube faces rendered per frame. A light's six faces are always rendered together so they agree
+  // on its position, so at least one light is updated per frame.
+  uint32_t max_face_updates_per_frame{12};
+  // offset of the shaded position along the normal, in shadow texels at its distance
+  float normal_bias{1.5f};
+  float slope_bias{2.f};
+  float constant_bias{4.f};
+};
+
+// Shadows of the point lights marked with LightManager::SetCastsShadows, in a cube map array
+// shared by every shadowed light. The casting lights in view are ranked by how much of the screen
+// their spheres of influence cover, and the highest ranked hold the atlas slots. A slot's faces are
+// only rendered again when its light moves or static geometry inside its sphere changes, and the
+// stale slots are updated highest ranked first within a budget of faces per frame.
+class PointLightShadows {
+ public:
+  // must match textured.fs.glsl
+  static constexpr uint32_t kMaxShadowedLights = 16;
+  static constexpr int kFaceSize = 512;
+
+  PointLightShadows() = default;
+  PointLightShadows(const PointLightShadows& other) = delete;
+  PointLightShadows& operator=(const PointLightShadows& other) = delete;
+
+  void Init();
+  // Assigns the slots for the view and renders the stale ones within the budget. Call before the
+  // frame's passes, which must set their own framebuffer, viewport and cull state.
+  void Update(Renderer& renderer, const RenderInfo& render_info);
+  // Binds the atlas and each light's slot for textured.fs.glsl.
+  void BindForShading(gl::Shader& shader) const;
+  void OnImGui();
+
+  PointLightShadowSettings settings;
+
+ private:
+  static constexpr uint32_t kNoLight = UINT32_MAX;
+  static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+  struct Slot {
+    uint32_t light{kNoLight};
+    // what the faces were last rendered with, shading uses these rather than the light's current
+    // position so a moving light's shadows stay consistent until its update comes up
+    glm::vec3 position{0.f};
+    float radius{};
+    uint64_t static_generation{};
+    bool rendered{false};
+    uint32_t num_draws{};
+  };
+
+  void RenderSlot(Renderer& renderer, Slot& slot, uint32_t slot_idx) const;
+  void UploadLightSlots();
+
+  std::array<Slot, kMaxShadowedLights> slots_{};
+  // (screen coverage, light) of the shadow casting lights in view
+  std::vector<std::pair<float, uint32_t>> candidates_;
+  // slot of each light, by light index
+  std::vector<uint32_t> light_slots_;
+  bool light_slots_dirty_{true};
+  gl::Buffer<uint32_t> light_slots_ssbo_;
+  uint32_t light_slots_capacity_{};
+  gl::TextureHandle atlas_;
+  gl::FramebufferHandle fbo_;
+  uint32_t faces_last_frame_{};
+  uint32_t stale_lights_last_frame_{};
+};
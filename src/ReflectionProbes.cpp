@@ -0,0 +1,237 @@
+#include "ReflectionProbes.hpp"
+
+#include <imgui.h>
+
+#include "CubeMapConverter.hpp"
+#include "IblParams.hpp"
+#include "gl/Shader.hpp"
+#include "pch.hpp"
+
+namespace {
+
+using ibl::kPrefilterMipLevels;
+
+// must match probe_map in textured.fs.glsl
+constexpr GLuint kProbeMapUnit = 13;
+constexpr GLuint kProbeSSBOSlot = 3;
+constexpr float kCaptureNear = 0.05f;
+constexpr float kCaptureFar = 100.f;
+
+// bounds that overlap nothing, for probes that aren't baked yet
+const AABB kEmptyBounds{.min = glm::vec3{std::numeric_limits<float>::max()},
+                        .max = glm::vec3{std::numeric_limits<float>::lowest()}};
+
+}  // namespace
+
+ReflectionProbes::ReflectionProbes(Renderer& renderer) : renderer_(renderer) {}
+
+void ReflectionProbes::Init() {
+  ZoneScoped;
+  // written as images by the prefilter compute shader, which can't store RGB formats
+  probe_array_ = gl::CreateTexture(GL_TEXTURE_CUBE_MAP_ARRAY);
+  glTextureStorage3D(probe_array_.Id(), kPrefilterMipLevels, GL_RGBA16F, kProbeSize, kProbeSize,
+                     6 * kMaxProbes);
+  glTextureParameteri(probe_array_.Id(), GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTextureParameteri(probe_array_.Id(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(probe_array_.Id(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(probe_array_.Id(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(probe_array_.Id(), GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  // views must be generated, not created, since glTextureView sets their target
+  for (uint32_t i = 0; i < kMaxProbes; i++) {
+    probe_views_[i] = gl::GenTexture();
+    glTextureView(probe_views_[i].Id(), GL_TEXTURE_CUBE_MAP, probe_array_.Id(), GL_RGBA16F, 0,
+                  kPrefilterMipLevels, i * 6, 6);
+  }
+
+  // mipmapped for the prefilter's PDF based sampling
+  const GLsizei capture_levels = static_cast<GLsizei>(std::log2(kProbeSize)) + 1;
+  capture_cube_ = gl::CreateTexture(GL_TEXTURE_CUBE_MAP);
+  glTextureStorage2D(capture_cube_.Id(), capture_levels, GL_RGBA16F, kProbeSize, kProbeSize);
+  glTextureParameteri(capture_cube_.Id(), GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTextureParameteri(capture_cube_.Id(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(capture_cube_.Id(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(capture_cube_.Id(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(capture_cube_.Id(), GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  capture_fbo_ = gl::CreateFramebuffer();
+  capture_rbo_ = gl::CreateRenderbuffer();
+  glNamedRenderbufferStorage(capture_rbo_.Id(), GL_DEPTH_COMPONENT24, kProbeSize, kProbeSize);
+  glNamedFramebufferRenderbuffer(capture_fbo_.Id(), GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                                 capture_rbo_.Id());
+
+  probe_ssbo_.Init(kMaxProbes, GL_DYNAMIC_STORAGE_BIT, nullptr);
+}
+
+std::optional<uint32_t> ReflectionProbes::Add(const ReflectionProbe& probe) {
+  if (probes_.size() >= kMaxProbes) {
+    spdlog::error("reflection probes: limit of {} reached", kMaxProbes);
+    return std::nullopt;
+  }
+  const auto idx = static_cast<uint32_t>(probes_.size());
+  probes_.push_back(probe);
+  baked_.push_back(false);
+  UploadProbe(idx);
+  Refresh(idx);
+  return idx;
+}
+
+void ReflectionProbes::Set(uint32_t idx, const ReflectionProbe& probe) {
+  probes_[idx] = probe;
+  UploadProbe(idx);
+  // the box changes which draws the probe is assigned to, the old map stays until the rebake
+  UpdateRendererBounds();
+  std::erase_if(steps_, [idx](const BakeStep& step) { return step.probe == idx; });
+  Refresh(idx);
+}
+
+void ReflectionProbes::Clear() {
+  probes_.clear();
+  baked_.clear();
+  steps_.clear();
+  next_refresh_ = 0;
+  UpdateRendererBounds();
+}
+
+void ReflectionProbes::Refresh(uint32_t idx) {
+  // a probe already queued is baked from its next captured face on
+  if (std::ranges::any_of(steps_, [idx](const BakeStep& step) { return step.probe == idx; })) {
+    return;
+  }
+  for (int step = 0; step <= kFilterStep; step++) steps_.push_back({idx, step});
+}
+
+void ReflectionProbes::RefreshAll() {
+  for (uint32_t i = 0; i < probes_.size(); i++) Refresh(i);
+}
+
+RenderInfo ReflectionProbes::CaptureRenderInfo(const BakeStep& step) const {
+  const glm::vec3& position = probes_[step.probe].position;
+  return RenderInfo{
+      .view_matrix = CubeMapConverter::CaptureView(step.step, position),
+      .projection_matrix = glm::perspective(glm::radians(90.f), 1.f, kCaptureNear, kCaptureFar),
+      .view_pos = position,
+      .viewport_size = glm::vec2{kProbeSize},
+      .main_view = false,
+  };
+}
+
+std::vector<RenderInfo> ReflectionProbes::UpcomingCaptures() const {
+  std::vector<RenderInfo> captures;
+  if (!settings.enabled) return captures;
+  const size_t num_steps = std::min<size_t>(settings.steps_per_frame, steps_.size());
+  for (size_t i = 0; i < num_steps; i++) {
+    if (steps_[i].step != kFilterStep) captures.push_back(CaptureRenderInfo(steps_[i]));
+  }
+  return captures;
+}
+
+void ReflectionProbes::Update(const DrawScene& draw_scene) {
+  ZoneScoped;
+  if (!settings.enabled) return;
+  if (steps_.empty() && settings.continuous_refresh && !probes_.empty()) {
+    Refresh(next_refresh_++ % probes_.size());
+  }
+  // the budget is in steps rather than measured time, every capture draws the same scene at the
+  // same size so their cost is about even
+  for (uint32_t i = 0; i < settings.steps_per_frame && !steps_.empty(); i++) {
+    const BakeStep step = steps_.front();
+    steps_.pop_front();
+    if (step.step == kFilterStep) {
+      Filter(step.probe);
+    } else {
+      Capture(step, draw_scene);
+    }
+  }
+}
+
+void ReflectionProbes::Capture(const BakeStep& step, const DrawScene& draw_scene) {
+  ZoneScoped;
+  glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo_.Id());
+  glNamedFramebufferTextureLayer(capture_fbo_.Id(), GL_COLOR_ATTACHMENT0, capture_cube_.Id(), 0,
+                                 step.step);
+  glViewport(0, 0, kProbeSize, kProbeSize);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+  glCullFace(GL_BACK);
+  glClearColor(0.f, 0.f, 0.f, 1.f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  capturing_ = true;
+  draw_scene(CaptureRenderInfo(step));
+  capturing_ = false;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ReflectionProbes::Filter(uint32_t probe) {
+  ZoneScoped;
+  glGenerateTextureMipmap(capture_cube_.Id());
+  for (uint32_t mip = 0; mip < kPrefilterMipLevels; mip++) {
+    CubeMapConverter::PrefilterFaces(capture_cube_.Id(), kProbeSize, probe_views_[probe].Id(),
+                                     kProbeSize, mip, 0, 6);
+  }
+  // the probe's layers are sampled by the frame's draws
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  if (!baked_[probe]) {
+    baked_[probe] = true;
+    UpdateRendererBounds();
+  }
+}
+
+void ReflectionProbes::UploadProbe(uint32_t idx) {
+  const ReflectionProbe& probe = probes_[idx];
+  const ProbeData data{.position = glm::vec4(probe.position, probe.blend_distance),
+                       .box_min = glm::vec4(probe.box.min, 0.f),
+                       .box_max = glm::vec4(probe.box.max, 0.f)};
+  probe_ssbo_.SubDataIndex(1, idx, &data);
+}
+
+void ReflectionProbes::UpdateRendererBounds() {
+  std::vector<AABB> bounds;
+  bounds.reserve(probes_.size());
+  for (size_t i = 0; i < probes_.size(); i++) {
+    bounds.push_back(baked_[i] ? probes_[i].box : kEmptyBounds);
+  }
+  renderer_.SetReflectionProbeBounds(std::move(bounds));
+}
+
+void ReflectionProbes::BindForShading(gl::Shader& shader) const {
+  const bool enabled = settings.enabled && !capturing_ && !probes_.empty();
+  shader.SetBool("u_reflection_probes_enabled", enabled);
+  if (!enabled) return;
+  glBindTextureUnit(kProbeMapUnit, probe_array_.Id());
+  probe_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, kProbeSSBOSlot);
+}
+
+void ReflectionProbes::OnImGui(const glm::vec3& camera_pos) {
+  ImGui::Begin("Reflection Probes", nullptr,
+               ImGuiWindowFlags_NoNavFocus | ImGuiWindowFlags_NoFocusOnAppearing);
+  ImGui::Checkbox("Enabled", &settings.enabled);
+  int steps_per_frame = static_cast<int>(settings.steps_per_frame);
+  if (ImGui::SliderInt("Bake Steps Per Frame", &steps_per_frame, 1, 7)) {
+    settings.steps_per_frame = steps_per_frame;
+  }
+  ImGui::Checkbox("Continuous Refresh", &settings.continuous_refresh);
+  static float half_extent = 2.f;
+  ImGui::SliderFloat("New Probe Half Extent", &half_extent, 0.25f, 20.f);
+  if (ImGui::Button("Add Probe At Camera")) {
+    Add(ReflectionProbe{.position = camera_pos,
+                        .box = {.min = camera_pos - half_extent, .max = camera_pos + half_extent}});
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Refresh All")) RefreshAll();
+  ImGui::SameLine();
+  if (ImGui::Button("Clear")) Clear();
+  ImGui::Text("%zu/%u probes, %zu bake steps queued", probes_.size(), kMaxProbes, steps_.size());
+  for (uint32_t i = 0; i < probes_.size(); i++) {
+    ImGui::PushID(static_cast<int>(i));
+    ReflectionProbe probe = probes_[i];
+    ImGui::Text("Probe %u%s", i, baked_[i] ? "" : " (baking)");
+    bool changed = ImGui::DragFloat3("Position", &probe.position.x, 0.05f);
+    changed |= ImGui::DragFloat3("Box Min", &probe.box.min.x, 0.05f);
+    changed |= ImGui::DragFloat3("Box Max", &probe.box.max.x, 0.05f);
+    changed |= ImGui::SliderFloat("Blend Distance", &probe.blend_distance, 0.f, 5.f);
+    if (changed) Set(i, probe);
+    if (ImGui::Button("Refresh")) Refresh(i);
+    ImGui::PopID();
+  }
+  ImGui::End();
+}
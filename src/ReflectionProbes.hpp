@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+
+#include "AABB.hpp"
+#include "Renderer.hpp"
+#include "gl/Buffer.hpp"
+#include "gl/Handle.hpp"
+
+namespace gl {
+class Shader;
+}  // namespace gl
+
+// A local environment captured from position. Reflections of surfaces in the box are parallax
+// corrected against it.
+struct ReflectionProbe {
+  glm::vec3 position{0.f};
+  AABB box{.min = glm::vec3{-2.f}, .max = glm::vec3{2.f}};
+  // distance inside the box over which the probe fades out to the global environment
+  float blend_distance{0.5f};
+};
+
+struct ReflectionProbeSettings {
+  // steps of the bake queue run per frame, each a scene draw into one cube face or the
+  // prefilter of a captured probe
+  uint32_t steps_per_frame{2};
+  // re-bake the probes round robin once the queue is empty, for scenes that change
+  bool continuous_refresh{false};
+  bool enabled{true};
+};
+
+// Placeable reflection probes prefiltered into a cube map array. Probes are baked a few cube faces
+// per frame into a shared capture cube, then prefiltered into their layers of the array with the
+// environment's prefilter pipeline, so the array only ever holds complete probes. The renderer
+// assigns each static draw the probes whose boxes overlap it, see
+// Renderer::SetReflectionProbeBounds.
+class ReflectionProbes {
+ public:
+  // draws the scene into the bound framebuffer, probes aren't sampled while capturing
+  using DrawScene = std::function<void(const RenderInfo&)>;
+  // must match the probe indices packed in Renderer::DrawCmdUniforms
+  static constexpr uint32_t kMaxProbes = 16;
+  static constexpr int kProbeSize = 128;
+
+  explicit ReflectionProbes(Renderer& renderer);
+  ReflectionProbes(const ReflectionProbes& other) = delete;
+  ReflectionProbes& operator=(const ReflectionProbes& other) = delete;
+
+  void Init();
+  // Index of the new probe, queued for baking. nullopt if there are kMaxProbes already.
+  std::optional<uint32_t> Add(const ReflectionProbe& probe);
+  // Moves or resizes a probe and queues it for baking again.
+  void Set(uint32_t idx, const ReflectionProbe& probe);
+  void Clear();
+  // Queues the probe to be baked again, keeping its current map until the bake finishes.
+  void Refresh(uint32_t idx);
+  void RefreshAll();
+
+  // Views of the capture steps the next Update will run, to make the textures they sample
+  // resident before drawing.
+  [[nodiscard]] std::vector<RenderInfo> UpcomingCaptures() const;
+  // Runs this frame's share of the bake queue. Call before the frame's passes, which must set
+  // their own framebuffer, viewport and cull state.
+  void Update(const DrawScene& draw_scene);
+  // Binds the probe map and data for textured.fs.glsl, disabled while capturing.
+  void BindForShading(gl::Shader& shader) const;
+  void OnImGui(const glm::vec3& camera_pos);
+
+  [[nodiscard]] const std::vector<ReflectionProbe>& Probes() const { return probes_; }
+
+  ReflectionProbeSettings settings;
+
+ private:
+  // faces 0-5 capture the face, kFilterStep prefilters the captured cube into the probe's layers
+  static constexpr int kFilterStep = 6;
+  struct BakeStep {
+    uint32_t probe{};
+    int step{};
+  };
+  // std430 layout of ReflectionProbe in textured.fs.glsl
+  struct ProbeData {
+    glm::vec4 position;
+    glm::vec4 box_min;
+    glm::vec4 box_max;
+  };
+
+  [[nodiscard]] RenderInfo CaptureRenderInfo(const BakeStep& step) const;
+  void Capture(const BakeStep& step, const DrawScene& draw_scene);
+  void Filter(uint32_t probe);
+  void UploadProbe(uint32_t idx);
+  void UpdateRendererBounds();
+
+  Renderer& renderer_;
+  std::vector<ReflectionProbe> probes_;
+  // whether each probe's layers hold a finished bake
+  std::vector<bool> baked_;
+  std::deque<BakeStep> steps_;
+  uint32_t next_refresh_{};
+  bool capturing_{false};
+
+  gl::TextureHandle probe_array_;
+  // cube map views of each probe's layers of probe_array_, the prefilter's image target
+  std::array<gl::TextureHandle, kMaxProbes> probe_views_;
+  gl::TextureHandle capture_cube_;
+  gl::FramebufferHandle capture_fbo_;
+  gl::RenderbufferHandle capture_rbo_;
+  gl::Buffer<ProbeData> probe_ssbo_;
+};
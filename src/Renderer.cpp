@@ -3,25 +3,59 @@
 #include "gl/VertexArray.hpp"
 #include "pch.hpp"
 
+#include <array>
+
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include "Frustum.hpp"
 #include "gl/OpenGLDebug.hpp"
 #include "types.hpp"
 
 namespace {
 
+constexpr uint32_t kMaxMaterials = 3000;
+// units 0-2 hold the IBL textures
+constexpr GLuint kFirstTextureArrayUnit = 3;
+// must match textured.fs.glsl
+constexpr uint32_t kNoReflectionProbe = 0xFFFF;
+constexpr GLuint kPointLightsSlot = 4;
+constexpr GLuint kLightGridSlot = 5;
+constexpr GLuint kLightIndicesSlot = 6;
+
 const std::vector<float> kQuadVertices = {
     -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
     1.0f,  1.0f, 0.0f, 1.0f, 1.0f, 1.0f,  -1.0f, 0.0f, 1.0f, 0.0f,
 };
 
+size_t MaterialTextureHandleOffset(TextureRole role) {
+  switch (role) {
+    case TextureRole::kBaseColor:
+      return offsetof(Material, base_color_bindless_handle);
+    case TextureRole::kEmissive:
+      return offsetof(Material, emissive_bindless_handle);
+    case TextureRole::kMetallicRoughness:
+    case TextureRole::kOcclusionRoughnessMetallic:
+      return offsetof(Material, metallic_roughness_bindless_handle);
+    case TextureRole::kOcclusion:
+      return offsetof(Material, occlusion_bindless_handle);
+    case TextureRole::kNormal:
+      return offsetof(Material, normal_bindless_handle);
+  }
+  return offsetof(Material, base_color_bindless_handle);
+}
+
 }  // namespace
 
 void Renderer::Init() {
   glEnable(GL_DEBUG_OUTPUT);
   glDebugMessageCallback(gl::MessageCallback, nullptr);
+  bindless_textures_ = GLEW_ARB_bindless_texture;
+  if (!bindless_textures_) {
+    spdlog::warn("GL_ARB_bindless_texture unsupported, packing material textures into arrays");
+    texture_arrays_.Init();
+  }
 
   uniform_ubo_.Init(1, GL_DYNAMIC_STORAGE_BIT, nullptr);
   pos_tex_vbo_.Init(10000000, sizeof(Vertex));
@@ -34,11 +68,19 @@ void Renderer::Init() {
   pos_tex_vao_.AttachVertexBuffer(pos_tex_vbo_.Id(), 0, 0, sizeof(Vertex));
   index_buffer_.Init(10000000, sizeof(uint32_t));
   pos_tex_vao_.AttachElementBuffer(index_buffer_.Id());
+  // depth only passes fetch positions alone from the same buffers
+  depth_vao_.Init();
+  depth_vao_.EnableAttribute<float>(0, 3, offsetof(Vertex, position));
+  depth_vao_.AttachVertexBuffer(pos_tex_vbo_.Id(), 0, 0, sizeof(Vertex));
+  depth_vao_.AttachElementBuffer(index_buffer_.Id());
 
-  material_ssbo_.Init(3000, sizeof(Material));
+  material_ssbo_.Init(kMaxMaterials, sizeof(Material));
+  texture_feedback_.Init(kMaxMaterials);
   static_dei_cmds_buffer_.Init(2000, GL_DYNAMIC_STORAGE_BIT, nullptr);
   static_uniforms_ssbo_.Init(2000, GL_DYNAMIC_STORAGE_BIT, nullptr);
-  point_lights_ssbo_.Init(200, GL_DYNAMIC_STORAGE_BIT, nullptr);
+  depth_dei_cmds_buffer_.Init(2000, GL_DYNAMIC_STORAGE_BIT, nullptr);
+  light_manager_.Init();
+  light_clusters_.Init();
 }
 
 AssetHandle Renderer::AllocateMaterial(const Material& material, AlphaMode) {
@@ -56,7 +98,10 @@ AssetHandle Renderer::AllocateMaterial(const Material& material, AlphaMode) {
   return mat_handle;
 }
 
-void Renderer::Shutdown() {}
+void Renderer::Shutdown() {
+  texture_feedback_.Shutdown();
+  texture_arrays_.Shutdown();
+}
 
 void Renderer::FreeMesh(AssetHandle& handle) {
   if (handle == 0) return;
@@ -89,6 +134,18 @@ void Renderer::FreeMaterial(AssetHandle& handle) {
   handle = 0;
 }
 
+void Renderer::SetMaterialTextureHandle(AssetHandle material_handle, TextureRole role,
+                                        uint64_t bindless_handle) {
+  auto it = material_allocs_map_.find(material_handle);
+  if (it == material_allocs_map_.end()) {
+    spdlog::error("Material handle not found");
+    return;
+  }
+  glNamedBufferSubData(material_ssbo_.Id(),
+                       it->second * sizeof(Material) + MaterialTextureHandleOffset(role),
+                       sizeof(uint64_t), &bindless_handle);
+}
+
 namespace {
 size_t static_base_instance = 0;
 }  // namespace
@@ -106,14 +163,21 @@ void Renderer::SubmitStaticInstancedModel(const Mesh& mesh,
       spdlog::error("material not found");
       continue;
     }
+    static_generation_++;
     std::vector<DrawCmdUniforms> uniforms;
     uniforms.reserve(model_matrices.size());
     for (const auto& model_matrix : model_matrices) {
       glm::mat4 normal_matrix = glm::transpose(glm::inverse(glm::mat3(model_matrix)));
+      const AABB& bounds =
+          static_draw_bounds_.emplace_back(TransformedAABB(primitive.aabb, model_matrix));
+      static_draw_materials_.push_back(primitive.material_handle);
+      static_draw_generations_.push_back(static_generation_);
+      static_bounds_ = static_bounds_ ? *static_bounds_ | bounds : bounds;
       uniforms.emplace_back(DrawCmdUniforms{
           .model = model_matrix,
           .normal_matrix = normal_matrix,
           .material_index = mat_it->second,
+          .reflection_probes = SelectReflectionProbes(bounds),
       });
     }
     // static_16_bit_idx_uniforms_ssbo_.SubData(uniforms.size(), uniforms.data());
@@ -125,6 +189,12 @@ void Renderer::SubmitStaticInstancedModel(const Mesh& mesh,
     static_base_instance += mesh_dei_cmd.instance_count;
     static_uniforms_ssbo_.SubData(uniforms.size(), uniforms.data());
     static_dei_cmds_buffer_.SubData(1, &mesh_dei_cmd);
+    for (uint32_t i = 0; i < mesh_dei_cmd.instance_count; i++) {
+      DrawElementsIndirectCommand instance_cmd = mesh_dei_cmd;
+      instance_cmd.instance_count = 1;
+      instance_cmd.base_instance = mesh_dei_cmd.base_instance + i;
+      static_instance_cmds_.push_back(instance_cmd);
+    }
 
     static_allocs_dirty_ = true;
   }
@@ -134,6 +204,13 @@ void Renderer::ResetStaticDrawCommands() {
   static_dei_cmds_buffer_.ResetOffset();
   static_uniforms_ssbo_.ResetOffset();
   static_base_instance = 0;
+  static_draw_bounds_.clear();
+  static_draw_materials_.clear();
+  static_instance_cmds_.clear();
+  static_draw_generations_.clear();
+  static_bounds_.reset();
+  static_generation_++;
+  static_reset_generation_ = static_generation_;
 }
 
 void Renderer::SubmitStaticModel(Model& model, const glm::mat4& model_matrix) {
@@ -151,11 +228,18 @@ void Renderer::SubmitStaticModel(Model& model, const glm::mat4& model_matrix) {
         spdlog::error("material not found");
         continue;
       }
+      static_generation_++;
       glm::mat4 transformed_model_matrix = model_matrix * node.model_matrix;
       glm::mat4 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transformed_model_matrix)));
+      const AABB& bounds = static_draw_bounds_.emplace_back(
+          TransformedAABB(primitive.aabb, transformed_model_matrix));
+      static_draw_materials_.push_back(primitive.material_handle);
+      static_draw_generations_.push_back(static_generation_);
+      static_bounds_ = static_bounds_ ? *static_bounds_ | bounds : bounds;
       DrawCmdUniforms uniform{.model = transformed_model_matrix,
                               .normal_matrix = normal_matrix,
-                              .material_index = mat_it->second};
+                              .material_index = mat_it->second,
+                              .reflection_probes = SelectReflectionProbes(bounds)};
       DrawElementsIndirectCommand mesh_dei_cmd = dei_cmds_map_.at(primitive.mesh_handle);
       mesh_dei_cmd.instance_count = 1;
 
@@ -163,39 +247,104 @@ void Renderer::SubmitStaticModel(Model& model, const glm::mat4& model_matrix) {
       static_base_instance++;
       static_uniforms_ssbo_.SubData(1, &uniform);
       static_dei_cmds_buffer_.SubData(1, &mesh_dei_cmd);
+      static_instance_cmds_.push_back(mesh_dei_cmd);
       static_allocs_dirty_ = true;
     }
   }
 }
 
 void Renderer::DrawStaticOpaque(const RenderInfo& render_info) {
-  UBOUniforms uniform_data{.vp_matrix = render_info.projection_matrix * render_info.view_matrix,
+  const glm::mat4 vp_matrix = render_info.projection_matrix * render_info.view_matrix;
+  light_manager_.Update();
+  visible_lights_.clear();
+  light_manager_.Cull(Frustum::FromViewProjection(vp_matrix), visible_lights_);
+  light_clusters_.Build(light_manager_, visible_lights_, render_info);
+  UBOUniforms uniform_data{.vp_matrix = vp_matrix,
                            .view_matrix = render_info.view_matrix,
                            .proj_matrix = render_info.projection_matrix,
-                           .view_pos = render_info.view_pos};
+                           .view_pos = render_info.view_pos,
+                           ._pad1 = 0.f,
+                           .viewport_size = render_info.viewport_size,
+                           .cluster_depth_params = light_clusters_.DepthSliceParams()};
   uniform_ubo_.SubDataStart(1, &uniform_data);
   uniform_ubo_.BindBase(GL_UNIFORM_BUFFER, 0);
   material_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, 1);
-  point_lights_ssbo_.BindBase(GL_UNIFORM_BUFFER, 1);
+  light_manager_.Bind(kPointLightsSlot);
+  light_clusters_.Bind(kLightGridSlot, kLightIndicesSlot);
+  texture_feedback_.Bind(2);
+  if (!bindless_textures_) texture_arrays_.Bind(kFirstTextureArrayUnit);
 
   pos_tex_vao_.Bind();
   static_uniforms_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, 0);
   static_dei_cmds_buffer_.Bind(GL_DRAW_INDIRECT_BUFFER);
   glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
                               static_dei_cmds_buffer_.NumAllocs(), 0);
+  if (render_info.main_view) texture_feedback_.EndFrame();
 }
 
-uint32_t Renderer::NumMaterials() const { return material_allocs_map_.size(); }
+uint32_t Renderer::DrawStaticDepth(const glm::mat4& cull_vp_matrix) {
+  ZoneScoped;
+  // instances are culled one by one, unlike the main pass which draws every instance
+  const Frustum frustum = Frustum::FromViewProjection(cull_vp_matrix);
+  depth_cmds_.clear();
+  for (size_t i = 0; i < static_instance_cmds_.size(); i++) {
+    if (frustum.Intersects(static_draw_bounds_[i])) depth_cmds_.push_back(static_instance_cmds_[i]);
+  }
+  if (depth_cmds_.empty()) return 0;
 
-uint32_t Renderer::NumMeshes() const { return mesh_allocs_map_.size(); }
+  depth_dei_cmds_buffer_.SubDataStart(depth_cmds_.size(), depth_cmds_.data());
+  depth_vao_.Bind();
+  static_uniforms_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, 0);
+  depth_dei_cmds_buffer_.Bind(GL_DRAW_INDIRECT_BUFFER);
+  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, depth_cmds_.size(), 0);
+  return depth_cmds_.size();
+}
 
-void Renderer::SubmitPointLights(const std::vector<PointLight>& lights) {
-  point_lights_ssbo_.SubDataStart(lights.size(), lights.data());
+bool Renderer::StaticChangedSince(uint64_t generation, const AABB& bounds) const {
+  // a reset may have removed anything
+  if (generation < static_reset_generation_) return true;
+  // draws are appended in submission order, so their generations are sorted
+  const auto first = std::upper_bound(static_draw_generations_.begin(),
+                                      static_draw_generations_.end(), generation);
+  for (size_t i = first - static_draw_generations_.begin(); i < static_draw_bounds_.size(); i++) {
+    if (static_draw_bounds_[i].Intersects(bounds)) return true;
+  }
+  return false;
+}
+
+void Renderer::SetReflectionProbeBounds(std::vector<AABB> bounds) {
+  ZoneScoped;
+  reflection_probe_bounds_ = std::move(bounds);
+  for (size_t i = 0; i < static_draw_bounds_.size(); i++) {
+    const uint32_t reflection_probes = SelectReflectionProbes(static_draw_bounds_[i]);
+    glNamedBufferSubData(static_uniforms_ssbo_.Id(),
+                         i * sizeof(DrawCmdUniforms) + offsetof(DrawCmdUniforms, reflection_probes),
+                         sizeof(uint32_t), &reflection_probes);
+  }
 }
 
-void Renderer::EditPointLight(const PointLight& light, size_t idx) {
-  if (idx >= point_lights_ssbo_.NumAllocs()) {
-    spdlog::error("Cannot edit light, out of bounds");
+uint32_t Renderer::SelectReflectionProbes(const AABB& bounds) const {
+  const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+  std::array<std::pair<float, uint32_t>, 2> nearest;
+  nearest.fill({std::numeric_limits<float>::max(), kNoReflectionProbe});
+  for (uint32_t i = 0; i < reflection_probe_bounds_.size(); i++) {
+    const AABB& probe_bounds = reflection_probe_bounds_[i];
+    if (!probe_bounds.Intersects(bounds)) continue;
+    const glm::vec3 offset = (probe_bounds.min + probe_bounds.max) * 0.5f - center;
+    const std::pair<float, uint32_t> candidate{glm::dot(offset, offset), i};
+    if (candidate < nearest[1]) nearest[1] = candidate;
+    if (nearest[1] < nearest[0]) std::swap(nearest[0], nearest[1]);
   }
-  point_lights_ssbo_.SubDataIndex(1, idx, &light);
+  return nearest[0].second | (nearest[1].second << 16);
+}
+
+uint32_t Renderer::NumMaterials() const { return material_allocs_map_.size(); }
+
+std::optional<uint32_t> Renderer::MaterialIndex(AssetHandle material_handle) const {
+  auto it = material_allocs_map_.find(material_handle);
+  if (it == material_allocs_map_.end()) return std::nullopt;
+  return it->second;
 }
+
+uint32_t Renderer::NumMeshes() const { return mesh_allocs_map_.size(); }
+
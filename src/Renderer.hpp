@@ -1,5 +1,9 @@
 #pragma once
 
+#include "LightClusters.hpp"
+#include "LightManager.hpp"
+#include "TextureArrays.hpp"
+#include "TextureFeedback.hpp"
 #include "gl/Buffer.hpp"
 #include "gl/DynamicBuffer.hpp"
 #include "gl/VertexArray.hpp"
@@ -9,6 +13,10 @@ struct RenderInfo {
   glm::mat4 view_matrix;
   glm::mat4 projection_matrix;
   glm::vec3 view_pos;
+  // size of the target in pixels, for finding the light cluster of a fragment
+  glm::vec2 viewport_size{1.f};
+  // false for secondary views like reflection probe captures, which don't record texture feedback
+  bool main_view{true};
 };
 
 class Renderer {
@@ -56,13 +64,42 @@ class Renderer {
   [[nodiscard]] AssetHandle AllocateMaterial(const Material& material, AlphaMode alpha_mode);
   void FreeMesh(AssetHandle& handle);
   void FreeMaterial(AssetHandle& handle);
+  // Points an allocated material at a different texture, e.g. when a streamed texture changes.
+  void SetMaterialTextureHandle(AssetHandle material_handle, TextureRole role,
+                                uint64_t bindless_handle);
   void SubmitStaticModel(Model& model, const glm::mat4& model_matrix);
   void SubmitStaticInstancedModel(const Mesh& mesh, const std::vector<glm::mat4>& model_matrices);
   void ResetStaticDrawCommands();
-  void SubmitPointLights(const std::vector<PointLight>& lights);
-  void EditPointLight(const PointLight& light, size_t idx);
+  // Influence boxes of the reflection probes, by probe index. Each static draw is assigned the
+  // probes whose boxes overlap its bounds, nearest first.
+  void SetReflectionProbeBounds(std::vector<AABB> bounds);
+  // Edits are uploaded by the next DrawStaticOpaque.
+  LightManager& GetLightManager() { return light_manager_; }
+  [[nodiscard]] const LightClusters& GetLightClusters() const { return light_clusters_; }
   void DrawStaticOpaque(const RenderInfo& render_info);
+  // Draws the static instances in the frustum of cull_vp_matrix with positions only, for depth
+  // passes. The caller binds the shader, framebuffer and state. Returns the number of instances
+  // drawn.
+  uint32_t DrawStaticDepth(const glm::mat4& cull_vp_matrix);
+  // Changes whenever static draws are submitted or reset, for caching passes over them.
+  [[nodiscard]] uint64_t StaticGeneration() const { return static_generation_; }
+  // Whether static draws overlapping bounds were submitted, or the static draws were reset, after
+  // the given generation.
+  [[nodiscard]] bool StaticChangedSince(uint64_t generation, const AABB& bounds) const;
+  // World bounds of every static draw, nullopt if there are none.
+  [[nodiscard]] const std::optional<AABB>& StaticBounds() const { return static_bounds_; }
+  // World bounds and material of each static draw instance, by base instance.
+  [[nodiscard]] const std::vector<AABB>& StaticDrawBounds() const { return static_draw_bounds_; }
+  [[nodiscard]] const std::vector<AssetHandle>& StaticDrawMaterials() const {
+    return static_draw_materials_;
+  }
   uint32_t NumMaterials() const;
+  // Index of the material in the material SSBO, nullopt if it isn't allocated.
+  [[nodiscard]] std::optional<uint32_t> MaterialIndex(AssetHandle material_handle) const;
+  TextureFeedback& GetTextureFeedback() { return texture_feedback_; }
+  // Whether materials reference textures by bindless handle or by layer in texture_arrays_.
+  [[nodiscard]] bool BindlessTextures() const { return bindless_textures_; }
+  TextureArrays& GetTextureArrays() { return texture_arrays_; }
   uint32_t NumMeshes() const;
 
  private:
@@ -79,6 +116,10 @@ class Renderer {
     glm::mat4 view_matrix;
     glm::mat4 proj_matrix;
     glm::vec3 view_pos;
+    float _pad1;
+    glm::vec2 viewport_size;
+    // see LightClusters::DepthSliceParams
+    glm::vec2 cluster_depth_params;
   };
 
   gl::Buffer<UBOUniforms> uniform_ubo_;
@@ -86,7 +127,13 @@ class Renderer {
   gl::VertexArray pos_tex_vao_;
   gl::DynamicBuffer<uint32_t> index_buffer_;
   gl::DynamicBuffer<Material> material_ssbo_;
-  gl::Buffer<PointLight> point_lights_ssbo_;
+  LightManager light_manager_;
+  LightClusters light_clusters_;
+  // lights in the frustum of the view being drawn
+  std::vector<uint32_t> visible_lights_;
+  TextureFeedback texture_feedback_;
+  TextureArrays texture_arrays_;
+  bool bindless_textures_{true};
 
   struct VertexIndexAlloc {
     uint32_t vertex_handle{};
@@ -98,11 +145,30 @@ class Renderer {
     glm::mat4 model;
     glm::mat4 normal_matrix;
     uint32_t material_index;
+    // two probe indices in the low and high 16 bits, kNoReflectionProbe when unused
+    uint32_t reflection_probes;
   };
+  // Indices of the up to two reflection probes nearest to the bounds, packed for DrawCmdUniforms.
+  [[nodiscard]] uint32_t SelectReflectionProbes(const AABB& bounds) const;
 
   gl::Buffer<DrawCmdUniforms> static_uniforms_ssbo_;
   gl::Buffer<DrawElementsIndirectCommand> static_dei_cmds_buffer_;
   bool static_allocs_dirty_{true};
+  // world bounds of each static draw instance, by base instance
+  std::vector<AABB> static_draw_bounds_;
+  // material of each static draw instance, by base instance
+  std::vector<AssetHandle> static_draw_materials_;
+  // single instance command of each static draw instance, by base instance
+  std::vector<DrawElementsIndirectCommand> static_instance_cmds_;
+  // generation each static draw instance was submitted in, by base instance
+  std::vector<uint64_t> static_draw_generations_;
+  uint64_t static_generation_{};
+  uint64_t static_reset_generation_{};
+  std::optional<AABB> static_bounds_;
+  gl::VertexArray depth_vao_;
+  gl::Buffer<DrawElementsIndirectCommand> depth_dei_cmds_buffer_;
+  std::vector<DrawElementsIndirectCommand> depth_cmds_;
+  std::vector<AABB> reflection_probe_bounds_;
 
   std::unordered_map<AssetHandle, uint32_t> material_allocs_map_;
   std::unordered_map<AssetHandle, VertexIndexAlloc> mesh_allocs_map_;
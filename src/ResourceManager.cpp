@@ -4,6 +4,7 @@
 
 void ResourceManager::FreeModel(Model& model) {
   for (auto& mat : model.material_handles) {
+    texture_streamer_.RemoveMaterial(mat);
     renderer_.FreeMaterial(mat);
   }
   for (auto& tex : model.texture_handles) {
@@ -16,10 +17,107 @@ void ResourceManager::FreeModel(Model& model) {
   }
 }
 
+std::optional<AssetHandle> ResourceManager::AcquireExistingTexture(
+    const util::ContentKey& content) {
+  auto it = shared_textures_.find(content);
+  if (it == shared_textures_.end()) return std::nullopt;
+  it->second.ref_count++;
+  return it->second.handle;
+}
+
+AssetHandle ResourceManager::AcquireStreamedTexture(const util::ContentKey& content,
+                                                    StreamedTextureData data) {
+  if (auto existing = AcquireExistingTexture(content)) return existing.value();
+  if (!renderer_.BindlessTextures()) {
+    std::optional<uint64_t> array_handle = renderer_.GetTextureArrays().Allocate(data);
+    if (!array_handle) return 0;
+    AssetHandle handle = AddSharedTexture(content);
+    array_textures_.emplace(handle, array_handle.value());
+    return handle;
+  }
+  AssetHandle handle = AddSharedTexture(content);
+  texture_map_.try_emplace(handle, texture_streamer_.Add(handle, std::move(data)));
+  texture_residency_.Add(handle);
+  return handle;
+}
+
+void ResourceManager::ReplaceStreamedTexture(AssetHandle handle, const util::ContentKey& content,
+                                             StreamedTextureData data) {
+  if (array_textures_.contains(handle)) {
+    if (!logged_array_replace_) {
+      spdlog::info("texture arrays keep the sizes textures were loaded with, reload the model to "
+                   "apply the texture quality tier");
+      logged_array_replace_ = true;
+    }
+    return;
+  }
+  if (!texture_map_.contains(handle)) return;
+  auto content_it = shared_texture_contents_.find(handle);
+  if (content_it != shared_texture_contents_.end() && content_it->second != content &&
+      !shared_textures_.contains(content)) {
+    auto node = shared_textures_.extract(content_it->second);
+    node.key() = content;
+    shared_textures_.insert(std::move(node));
+    content_it->second = content;
+  }
+  texture_streamer_.Replace(handle, std::move(data));
+}
+
+void ResourceManager::SetTextureQualityTier(TextureQualityTier tier) {
+  ZoneScoped;
+  if (tier == texture_quality_tier_) return;
+  texture_quality_tier_ = tier;
+  std::unordered_set<AssetHandle> reloaded;
+  for (auto& [handle, model] : model_map_) loader::ReloadTextures(*this, model, reloaded);
+}
+
+uint64_t ResourceManager::MaterialTextureHandle(AssetHandle handle) {
+  if (auto it = array_textures_.find(handle); it != array_textures_.end()) return it->second;
+  gl::Texture* texture = Get<gl::Texture>(handle);
+  return texture ? texture->BindlessHandle() : 0;
+}
+
+void ResourceManager::FreeArrayTexture(AssetHandle handle) {
+  auto it = array_textures_.find(handle);
+  if (it == array_textures_.end()) return;
+  renderer_.GetTextureArrays().Free(it->second);
+  array_textures_.erase(it);
+}
+
+AssetHandle ResourceManager::AddSharedTexture(const util::ContentKey& content) {
+  // handles are 32 bit, so probe past collisions with textures already loaded by name. Sharing
+  // only ever compares the full content key, never the handle.
+  auto handle = static_cast<AssetHandle>(content.hash);
+  while (handle == 0 || texture_map_.contains(handle) || array_textures_.contains(handle)) {
+    handle++;
+  }
+  shared_textures_.emplace(content, SharedTexture{.handle = handle, .ref_count = 1});
+  shared_texture_contents_.emplace(handle, content);
+  return handle;
+}
+
+bool ResourceManager::ReleaseSharedTexture(AssetHandle handle) {
+  auto content_it = shared_texture_contents_.find(handle);
+  if (content_it == shared_texture_contents_.end()) return true;
+  auto it = shared_textures_.find(content_it->second);
+  EASSERT(it != shared_textures_.end());
+  if (--it->second.ref_count > 0) return false;
+  shared_textures_.erase(it);
+  shared_texture_contents_.erase(content_it);
+  return true;
+}
+
+void ResourceManager::Init() { texture_streamer_.Init(); }
+
 void ResourceManager::Shutdown() {
   for (auto& [handle, model] : model_map_) {
     FreeModel(model);
   }
   model_map_.clear();
+  texture_streamer_.Shutdown();
+  texture_residency_.Clear();
   texture_map_.clear();
+  array_textures_.clear();
+  shared_textures_.clear();
+  shared_texture_contents_.clear();
 }
@@ -3,8 +3,12 @@
 #include <concepts>
 
 #include "MeshLoader.hpp"
+#include "TextureQuality.hpp"
+#include "TextureResidency.hpp"
+#include "TextureStreamer.hpp"
 #include "gl/Texture.hpp"
 #include "types.hpp"
+#include "util/Hash.hpp"
 
 using AssetHandle = uint32_t;
 class Renderer;
@@ -14,7 +18,10 @@ concept SupportedResource = std::same_as<T, gl::Texture> || std::same_as<T, Mode
 
 class ResourceManager {
  public:
-  explicit ResourceManager(Renderer& renderer) : renderer_(renderer){};
+  explicit ResourceManager(Renderer& renderer)
+      : renderer_(renderer), texture_streamer_(*this, renderer),
+        texture_residency_(*this, texture_streamer_){};
+  void Init();
   void Shutdown();
 
   template <SupportedResource T, typename ParamT>
@@ -38,10 +45,50 @@ class ResourceManager {
     return handle;
   }
 
+  // Returns a texture shared by every caller that uploads the same content, so identical images
+  // across models live on the GPU once. Each acquire must be matched by a Free<gl::Texture>.
+  template <typename ParamT>
+  [[nodiscard]] AssetHandle AcquireTexture(const util::ContentKey& content, const ParamT& params) {
+    if (auto existing = AcquireExistingTexture(content)) return existing.value();
+    AssetHandle handle = AddSharedTexture(content);
+    texture_map_.try_emplace(handle, params);
+    return handle;
+  }
+
+  // Shared like AcquireTexture, but only the low mips are uploaded until the texture streamer
+  // raises them.
+  [[nodiscard]] AssetHandle AcquireStreamedTexture(const util::ContentKey& content,
+                                                   StreamedTextureData data);
+  // Bindless handle of the texture, or its texture array layer when bindless textures are
+  // unsupported. 0 if the texture doesn't exist.
+  [[nodiscard]] uint64_t MaterialTextureHandle(AssetHandle handle);
+
+  // Swaps in the texture cooked again from the same source, keeping its handle and the materials
+  // sampling it. content is what later loads share it by. Textures in texture arrays keep their
+  // load-time size.
+  void ReplaceStreamedTexture(AssetHandle handle, const util::ContentKey& content,
+                              StreamedTextureData data);
+
+  [[nodiscard]] TextureQualityTier GetTextureQualityTier() const { return texture_quality_tier_; }
+  [[nodiscard]] TextureQuality GetTextureQuality() const {
+    return texture_quality::Get(texture_quality_tier_);
+  }
+  // Applies to models loaded from now on, and cooks again the textures of loaded models whose
+  // size changes under the new tier.
+  void SetTextureQualityTier(TextureQualityTier tier);
+
+  // Adds a reference to the texture with this content if it is already loaded, letting callers
+  // skip preparing its data.
+  [[nodiscard]] std::optional<AssetHandle> AcquireExistingTexture(const util::ContentKey& content);
+
   template <SupportedResource T>
   void Free(AssetHandle handle) {
     if (handle == 0) return;
     if constexpr (std::is_same_v<T, gl::Texture>) {
+      if (!ReleaseSharedTexture(handle)) return;
+      FreeArrayTexture(handle);
+      texture_streamer_.Remove(handle);
+      texture_residency_.Remove(handle);
       texture_map_.erase(handle);
     } else if constexpr (std::is_same_v<T, Model>) {
       auto it = model_map_.find(handle);
@@ -65,10 +112,31 @@ class ResourceManager {
 
   uint32_t NumTextures() const { return texture_map_.size(); }
   uint32_t NumModels() const { return model_map_.size(); }
+  uint32_t NumSharedTextures() const { return shared_textures_.size(); }
+  TextureStreamer& GetTextureStreamer() { return texture_streamer_; }
+  TextureResidency& GetTextureResidency() { return texture_residency_; }
 
  private:
   void FreeModel(Model& model);
+  void FreeArrayTexture(AssetHandle handle);
+  AssetHandle AddSharedTexture(const util::ContentKey& content);
+  // Returns true if the texture has no remaining references and should be destroyed.
+  bool ReleaseSharedTexture(AssetHandle handle);
   Renderer& renderer_;
+  TextureStreamer texture_streamer_;
+  TextureResidency texture_residency_;
   std::unordered_map<AssetHandle, gl::Texture> texture_map_;
+  // textures packed into the renderer's texture arrays
+  std::unordered_map<AssetHandle, uint64_t> array_textures_;
   std::unordered_map<AssetHandle, Model> model_map_;
+  TextureQualityTier texture_quality_tier_{TextureQualityTier::kHigh};
+  // texture array layers aren't replaced, which is logged once
+  bool logged_array_replace_{false};
+
+  struct SharedTexture {
+    AssetHandle handle;
+    uint32_t ref_count;
+  };
+  std::unordered_map<util::ContentKey, SharedTexture, util::ContentKeyHash> shared_textures_;
+  std::unordered_map<AssetHandle, util::ContentKey> shared_texture_contents_;
 };
@@ -0,0 +1,152 @@
+#include "SphericalHarmonics.hpp"
+
+#include <cmath>
+#include <numbers>
+
+#include "HalfFloat.hpp"
+#include "HdrImage.hpp"
+#include "pch.hpp"
+#include "util/ParallelFor.hpp"
+#include "util/ThreadPool.hpp"
+
+namespace sh {
+
+namespace {
+
+constexpr double kPi = std::numbers::pi;
+// basis normalization constants, must match IrradianceSH in textured.fs.glsl
+constexpr double kY0 = 0.282095;
+constexpr double kY1 = 0.488603;
+constexpr double kY2 = 1.092548;
+constexpr double kY20 = 0.315392;
+constexpr double kY22 = 0.546274;
+// cosine lobe convolution of each band over PI
+constexpr std::array<float, 9> kIrradianceScale = {
+    1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+
+constexpr int kRowsPerBlock = 16;
+// floats summed per iteration, 4 interleaved RGB texels fill three SIMD registers
+constexpr size_t kLanes = 12;
+
+// Within a row of constant elevation the basis reduces to these azimuthal terms, so each texel
+// costs five multiply-adds per channel.
+struct AzimuthTables {
+  // per float of an interleaved RGB row, the term of its texel's azimuth
+  std::vector<float> cos1, sin1, cos2, sin2;
+};
+
+struct RowSums {
+  glm::dvec3 s0{}, c1{}, s1{}, c2{}, s2{};
+};
+
+using Coeffs = std::array<glm::dvec3, 9>;
+
+AzimuthTables MakeAzimuthTables(int width) {
+  AzimuthTables tables;
+  for (std::vector<float>* table : {&tables.cos1, &tables.sin1, &tables.cos2, &tables.sin2}) {
+    table->resize(static_cast<size_t>(width) * 3);
+  }
+  for (int i = 0; i < width; i++) {
+    // u = phi / 2PI + 0.5
+    const double phi = ((i + 0.5) / width - 0.5) * 2 * kPi;
+    for (size_t c = 0; c < 3; c++) {
+      const size_t k = static_cast<size_t>(i) * 3 + c;
+      tables.cos1[k] = static_cast<float>(std::cos(phi));
+      tables.sin1[k] = static_cast<float>(std::sin(phi));
+      tables.cos2[k] = static_cast<float>(std::cos(2 * phi));
+      tables.sin2[k] = static_cast<float>(std::sin(2 * phi));
+    }
+  }
+  return tables;
+}
+
+RowSums SumRow(const float* rgb, size_t num_floats, const AzimuthTables& tables) {
+  // the channel of lane l is l % 3, the fixed width inner loop vectorizes
+  float s0[kLanes]{}, c1[kLanes]{}, s1[kLanes]{}, c2[kLanes]{}, s2[kLanes]{};
+  size_t k = 0;
+  for (; k + kLanes <= num_floats; k += kLanes) {
+    for (size_t l = 0; l < kLanes; l++) {
+      const float value = rgb[k + l];
+      s0[l] += value;
+      c1[l] += value * tables.cos1[k + l];
+      s1[l] += value * tables.sin1[k + l];
+      c2[l] += value * tables.cos2[k + l];
+      s2[l] += value * tables.sin2[k + l];
+    }
+  }
+  RowSums sums;
+  for (size_t l = 0; l < kLanes; l++) {
+    sums.s0[l % 3] += s0[l];
+    sums.c1[l % 3] += c1[l];
+    sums.s1[l % 3] += s1[l];
+    sums.c2[l % 3] += c2[l];
+    sums.s2[l % 3] += s2[l];
+  }
+  for (; k < num_floats; k++) {
+    const float value = rgb[k];
+    sums.s0[k % 3] += value;
+    sums.c1[k % 3] += value * tables.cos1[k];
+    sums.s1[k % 3] += value * tables.sin1[k];
+    sums.c2[k % 3] += value * tables.cos2[k];
+    sums.s2[k % 3] += value * tables.sin2[k];
+  }
+  return sums;
+}
+
+Coeffs ProjectRows(const HalfImage& equirect, const AzimuthTables& tables, int begin, int end) {
+  Coeffs coeffs{};
+  const size_t row_floats = static_cast<size_t>(equirect.width) * 3;
+  std::vector<float> row(row_floats);
+  for (int j = begin; j < end; j++) {
+    half::ToFloats(equirect.rgb.data() + j * row_floats, row.data(), row_floats);
+    const RowSums sums = SumRow(row.data(), row_floats, tables);
+    // rows are flipped on load, so v = elevation / PI + 0.5 increases with j
+    const double elevation = ((j + 0.5) / equirect.height - 0.5) * kPi;
+    const double y = std::sin(elevation);
+    const double c = std::cos(elevation);
+    const double solid_angle = (2 * kPi / equirect.width) * (kPi / equirect.height) * c;
+    // x = c cos(phi), z = c sin(phi)
+    coeffs[0] += solid_angle * kY0 * sums.s0;
+    coeffs[1] += solid_angle * kY1 * y * sums.s0;
+    coeffs[2] += solid_angle * kY1 * c * sums.s1;
+    coeffs[3] += solid_angle * kY1 * c * sums.c1;
+    coeffs[4] += solid_angle * kY2 * c * y * sums.c1;
+    coeffs[5] += solid_angle * kY2 * y * c * sums.s1;
+    coeffs[6] += solid_angle * kY20 * (1.5 * c * c * (sums.s0 - sums.c2) - sums.s0);
+    coeffs[7] += solid_angle * kY2 * 0.5 * c * c * sums.s2;
+    coeffs[8] += solid_angle * kY22 * (0.5 * c * c * (sums.s0 + sums.c2) - y * y * sums.s0);
+  }
+  return coeffs;
+}
+
+}  // namespace
+
+SH9 ProjectIrradiance(const HalfImage& equirect) {
+  ZoneScoped;
+  SH9 result;
+  if (equirect.width <= 0 || equirect.height <= 0) return result;
+  const AzimuthTables tables = MakeAzimuthTables(equirect.width);
+  const size_t num_blocks = (equirect.height + kRowsPerBlock - 1) / kRowsPerBlock;
+
+  // summed in block order afterwards so the result doesn't depend on scheduling
+  std::vector<Coeffs> block_coeffs(num_blocks);
+  const auto project_blocks = [&equirect, &tables, &block_coeffs](size_t begin, size_t end) {
+    for (size_t block = begin; block < end; block++) {
+      const int row = static_cast<int>(block) * kRowsPerBlock;
+      block_coeffs[block] =
+          ProjectRows(equirect, tables, row, std::min(row + kRowsPerBlock, equirect.height));
+    }
+  };
+  util::ParallelFor(ThreadPool::Get().thread_pool, num_blocks, 1, project_blocks);
+
+  Coeffs coeffs{};
+  for (const Coeffs& block : block_coeffs) {
+    for (size_t i = 0; i < coeffs.size(); i++) coeffs[i] += block[i];
+  }
+  for (size_t i = 0; i < coeffs.size(); i++) {
+    result.coeffs[i] = glm::vec3(coeffs[i]) * kIrradianceScale[i];
+  }
+  return result;
+}
+
+}  // namespace sh
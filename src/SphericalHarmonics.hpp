@@ -0,0 +1,21 @@
+#pragma once
+
+#include <array>
+
+struct HalfImage;
+
+// Irradiance as bands 0-2 of real spherical harmonics in world space. The cosine lobe convolution
+// and 1/PI are folded into the coefficients, so evaluating the basis at a normal gives the
+// irradiance / PI that the diffuse IBL term multiplies with albedo.
+struct SH9 {
+  std::array<glm::vec3, 9> coeffs{};
+};
+
+namespace sh {
+
+// Projects an equirectangular environment, laid out as equirectangular_to_cube.fs.glsl samples
+// it, in blocks of rows shared with the thread pool. The caller projects blocks too, so it can be
+// called from a pool task without waiting on queued work.
+[[nodiscard]] SH9 ProjectIrradiance(const HalfImage& equirect);
+
+}  // namespace sh
@@ -0,0 +1,122 @@
+#include "TextureArrays.hpp"
+
+#include "gl/Texture.hpp"
+#include "pch.hpp"
+
+namespace {
+
+constexpr GLsizei kInitialLayers = 4;
+
+uint64_t EncodeHandle(uint32_t array_index, GLsizei layer) {
+  return (static_cast<uint64_t>(array_index + 1) << 32) | static_cast<uint32_t>(layer);
+}
+
+uint32_t CreateArray(GLenum internal_format, glm::ivec2 dims, GLsizei num_levels,
+                     const glm::ivec4& swizzle, GLsizei layers) {
+  uint32_t id;
+  glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &id);
+  glTextureStorage3D(id, num_levels, internal_format, dims.x, dims.y, layers);
+  // TODO: address texture repeat using sampler
+  glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteriv(id, GL_TEXTURE_SWIZZLE_RGBA, &swizzle[0]);
+  return id;
+}
+
+}  // namespace
+
+void TextureArrays::Init() { glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers_); }
+
+void TextureArrays::Shutdown() {
+  for (Array& array : arrays_) {
+    glDeleteTextures(1, &array.id);
+  }
+  arrays_.clear();
+}
+
+std::optional<uint64_t> TextureArrays::Allocate(const StreamedTextureData& data) {
+  ZoneScoped;
+  const auto num_levels = static_cast<GLsizei>(data.level_sizes.size());
+  auto it = std::ranges::find_if(arrays_, [&data, num_levels](const Array& array) {
+    return array.internal_format == data.internal_format && array.dims == data.dims &&
+           array.num_levels == num_levels && array.swizzle == data.swizzle;
+  });
+  if (it == arrays_.end()) {
+    if (arrays_.size() == kMaxArrays) {
+      spdlog::error("texture arrays: out of arrays for {}x{} textures of format {:#x}",
+                    data.dims.x, data.dims.y, data.internal_format);
+      return std::nullopt;
+    }
+    arrays_.push_back(Array{.internal_format = data.internal_format,
+                            .dims = data.dims,
+                            .num_levels = num_levels,
+                            .swizzle = data.swizzle});
+    it = arrays_.end() - 1;
+  }
+  Array& array = *it;
+
+  GLsizei layer;
+  if (!array.free_layers.empty()) {
+    layer = array.free_layers.back();
+    array.free_layers.pop_back();
+  } else {
+    if (array.num_layers == array.capacity && !Grow(array)) return std::nullopt;
+    layer = array.num_layers++;
+  }
+
+  // rows of RGB, RG and R data are tightly packed
+  const gl::ScopedUnpackAlignment unpack_alignment{1};
+  const uint8_t* level_data = data.data.data();
+  for (GLsizei level = 0; level < num_levels; level++) {
+    const GLsizei width = std::max(data.dims.x >> level, 1);
+    const GLsizei height = std::max(data.dims.y >> level, 1);
+    const auto level_size = static_cast<GLsizei>(data.level_sizes[level]);
+    if (data.compressed) {
+      glCompressedTextureSubImage3D(array.id, level, 0, 0, layer, width, height, 1,
+                                    data.internal_format, level_size, level_data);
+    } else {
+      glTextureSubImage3D(array.id, level, 0, 0, layer, width, height, 1, data.format,
+                          GL_UNSIGNED_BYTE, level_data);
+    }
+    level_data += level_size;
+  }
+  return EncodeHandle(static_cast<uint32_t>(it - arrays_.begin()), layer);
+}
+
+void TextureArrays::Free(uint64_t handle) {
+  const uint32_t array_index = static_cast<uint32_t>(handle >> 32) - 1;
+  if (array_index >= arrays_.size()) return;
+  arrays_[array_index].free_layers.push_back(static_cast<GLsizei>(handle & 0xFFFFFFFF));
+}
+
+bool TextureArrays::Grow(Array& array) const {
+  ZoneScoped;
+  const GLsizei capacity =
+      std::min(std::max(array.capacity * 2, kInitialLayers), static_cast<GLsizei>(max_layers_));
+  if (capacity <= array.capacity) {
+    spdlog::error("texture arrays: out of layers for {}x{} textures of format {:#x}",
+                  array.dims.x, array.dims.y, array.internal_format);
+    return false;
+  }
+  const uint32_t id =
+      CreateArray(array.internal_format, array.dims, array.num_levels, array.swizzle, capacity);
+  if (array.id) {
+    for (GLsizei level = 0; level < array.num_levels; level++) {
+      glCopyImageSubData(array.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, id, GL_TEXTURE_2D_ARRAY,
+                         level, 0, 0, 0, std::max(array.dims.x >> level, 1),
+                         std::max(array.dims.y >> level, 1), array.num_layers);
+    }
+    glDeleteTextures(1, &array.id);
+  }
+  array.id = id;
+  array.capacity = capacity;
+  return true;
+}
+
+void TextureArrays::Bind(GLuint first_unit) const {
+  for (uint32_t i = 0; i < arrays_.size(); i++) {
+    glBindTextureUnit(first_unit + i, arrays_[i].id);
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "TextureStreamer.hpp"
+
+// Fallback for drivers without ARB_bindless_texture, e.g. Mesa llvmpipe. Material textures are
+// packed into 2D array textures, one per format, size and level count, bound to consecutive
+// texture units. In place of a bindless handle, materials store ((array index + 1) << 32) | layer,
+// so every material can still be drawn with one multi-draw.
+class TextureArrays {
+ public:
+  // must match MAX_TEXTURE_ARRAYS in textured.fs.glsl. Units 0-2 hold the IBL textures and 13-15
+  // the probe and shadow maps, so the arrays fill the rest of the 16 units GL guarantees.
+  static constexpr uint32_t kMaxArrays = 10;
+
+  void Init();
+  void Shutdown();
+
+  // Uploads every level of the texture to a free layer and returns the handle to store in
+  // materials, nullopt if its format and size need an array past kMaxArrays.
+  [[nodiscard]] std::optional<uint64_t> Allocate(const StreamedTextureData& data);
+  void Free(uint64_t handle);
+  void Bind(GLuint first_unit) const;
+
+  [[nodiscard]] uint32_t NumArrays() const { return arrays_.size(); }
+
+ private:
+  struct Array {
+    GLenum internal_format;
+    glm::ivec2 dims;
+    GLsizei num_levels;
+    glm::ivec4 swizzle;
+    uint32_t id{};
+    GLsizei capacity{};
+    // layers below this have been allocated at some point
+    GLsizei num_layers{};
+    std::vector<GLsizei> free_layers{};
+  };
+
+  // Reallocates the array with more layers and copies the used ones over.
+  [[nodiscard]] bool Grow(Array& array) const;
+
+  std::vector<Array> arrays_;
+  GLint max_layers_{};
+};
@@ -0,0 +1,126 @@
+#include "TextureCache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "Path.hpp"
+#include "pch.hpp"
+
+namespace texture_cache {
+
+namespace {
+
+// bump when the encoder output or the file layout changes to invalidate old entries
+constexpr uint32_t kVersion = 2;
+constexpr uint32_t kMagic = 0x43424350;  // "PCBC"
+// more than the levels of the largest int dimensions
+constexpr uint32_t kMaxLevels = 32;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t num_levels;
+  uint64_t data_size;
+};
+
+std::filesystem::path CachePath(size_t key) {
+  return std::filesystem::path(GET_PATH(".cache/textures")) / fmt::format("{:016x}.bc", key);
+}
+
+}  // namespace
+
+std::optional<bc::CompressedImage> Load(size_t key) {
+  ZoneScoped;
+  const std::filesystem::path path = CachePath(key);
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) return std::nullopt;
+  // corrupt entries would be read every launch, so they're removed for Store to replace
+  const auto reject = [&file, &path](const char* reason) -> std::optional<bc::CompressedImage> {
+    spdlog::warn("texture cache: {} entry {}, removing it", reason, path.string());
+    file.close();
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return std::nullopt;
+  };
+  Header header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file) return reject("truncated");
+  if (header.magic != kMagic || header.version != kVersion) return std::nullopt;
+  if (header.format > static_cast<uint32_t>(bc::Format::kBC1A)) return reject("invalid format in");
+  if (header.num_levels == 0 || header.num_levels > kMaxLevels) {
+    return reject("invalid level count in");
+  }
+  // checked before allocating, so a corrupt data_size can't request a huge buffer
+  std::error_code ec;
+  const uintmax_t file_size = std::filesystem::file_size(path, ec);
+  const uint64_t levels_size = header.num_levels * sizeof(bc::MipLevel);
+  if (ec || file_size < sizeof(Header) + levels_size ||
+      file_size - sizeof(Header) - levels_size != header.data_size) {
+    return reject("truncated");
+  }
+
+  bc::CompressedImage image;
+  image.format = static_cast<bc::Format>(header.format);
+  image.levels.resize(header.num_levels);
+  file.read(reinterpret_cast<char*>(image.levels.data()),
+            static_cast<std::streamsize>(levels_size));
+  if (!file) return reject("truncated");
+  const bc::MipLevel& base = image.levels[0];
+  if (base.width <= 0 || base.height <= 0 ||
+      header.num_levels > static_cast<uint32_t>(mip::NumLevels(base.width, base.height))) {
+    return reject("invalid levels in");
+  }
+  for (size_t i = 0; i < image.levels.size(); i++) {
+    const bc::MipLevel& level = image.levels[i];
+    const int width = std::max(base.width >> i, 1);
+    const int height = std::max(base.height >> i, 1);
+    if (level.width != width || level.height != height ||
+        level.size_bytes != bc::CompressedSizeBytes(image.format, width, height) ||
+        level.offset > header.data_size || level.size_bytes > header.data_size - level.offset) {
+      return reject("invalid levels in");
+    }
+  }
+  image.data.resize(header.data_size);
+  file.read(reinterpret_cast<char*>(image.data.data()),
+            static_cast<std::streamsize>(image.data.size()));
+  if (!file) return reject("truncated");
+  return image;
+}
+
+void Store(size_t key, const bc::CompressedImage& image) {
+  ZoneScoped;
+  const std::filesystem::path path = CachePath(key);
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  if (ec) {
+    spdlog::error("texture cache: failed to create {}: {}", path.parent_path().string(),
+                  ec.message());
+    return;
+  }
+  // write then rename so concurrent loaders never read a partial entry
+  std::filesystem::path tmp_path = path;
+  tmp_path += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream file(tmp_path, std::ios::binary);
+    const Header header{.magic = kMagic,
+                        .version = kVersion,
+                        .format = static_cast<uint32_t>(image.format),
+                        .num_levels = static_cast<uint32_t>(image.levels.size()),
+                        .data_size = image.data.size()};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(image.levels.data()),
+               static_cast<std::streamsize>(image.levels.size() * sizeof(bc::MipLevel)));
+    file.write(reinterpret_cast<const char*>(image.data.data()),
+               static_cast<std::streamsize>(image.data.size()));
+    if (!file) {
+      spdlog::error("texture cache: failed to write {}", tmp_path.string());
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) std::filesystem::remove(tmp_path, ec);
+}
+
+}  // namespace texture_cache
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "BlockCompression.hpp"
+
+// Block compressed textures persisted on disk, so encoding is paid once per asset. Keys are the
+// content hash of the source image combined with everything that affects the encoded result.
+namespace texture_cache {
+
+[[nodiscard]] std::optional<bc::CompressedImage> Load(size_t key);
+void Store(size_t key, const bc::CompressedImage& image);
+
+}  // namespace texture_cache
@@ -0,0 +1,78 @@
+#include "TextureFeedback.hpp"
+
+#include "pch.hpp"
+
+namespace {
+
+// must match textured.fs.glsl
+constexpr uint32_t kNotSampled = 0xFFFFFFFF;
+constexpr float kFootprintBias = 32.f;
+constexpr float kFootprintScale = 16.f;
+
+}  // namespace
+
+void TextureFeedback::Init(uint32_t max_materials) {
+  max_materials_ = max_materials;
+  feedback_.assign(max_materials, kNotSampled);
+  feedback_ssbo_.Init(max_materials, 0, feedback_.data());
+  for (Readback& readback : readbacks_) {
+    readback.buffer.Init(max_materials, GL_CLIENT_STORAGE_BIT, nullptr);
+  }
+}
+
+void TextureFeedback::Shutdown() {
+  for (Readback& readback : readbacks_) {
+    if (readback.fence) glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+  }
+}
+
+void TextureFeedback::Bind(GLuint slot) const {
+  feedback_ssbo_.BindBase(GL_SHADER_STORAGE_BUFFER, slot);
+}
+
+void TextureFeedback::EndFrame() {
+  ZoneScoped;
+  if (!enabled) {
+    readback_frame_ = 0;
+    return;
+  }
+
+  // oldest first, so the newest finished frame ends up in feedback_
+  std::array<Readback*, kNumReadbacks> pending{};
+  for (uint32_t i = 0; i < kNumReadbacks; i++) pending[i] = &readbacks_[i];
+  std::ranges::sort(pending, [](const Readback* a, const Readback* b) {
+    return a->frame < b->frame;
+  });
+  for (Readback* readback : pending) {
+    if (!readback->fence) continue;
+    const GLenum result = glClientWaitSync(readback->fence, 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+    glDeleteSync(readback->fence);
+    readback->fence = nullptr;
+    glGetNamedBufferSubData(readback->buffer.Id(), 0, max_materials_ * sizeof(uint32_t),
+                            feedback_.data());
+    readback_frame_ = readback->frame;
+  }
+
+  // if the GPU is more than kNumReadbacks frames behind, skip this frame's feedback and keep
+  // accumulating into the next
+  Readback& readback = readbacks_[frame_ % kNumReadbacks];
+  if (!readback.fence) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(feedback_ssbo_.Id(), readback.buffer.Id(), 0, 0,
+                             max_materials_ * sizeof(uint32_t));
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.frame = frame_;
+    glClearNamedBufferData(feedback_ssbo_.Id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                           &kNotSampled);
+  }
+  frame_++;
+}
+
+std::optional<float> TextureFeedback::MaterialUVFootprint(uint32_t material_index) const {
+  if (material_index >= feedback_.size() || feedback_[material_index] == kNotSampled) {
+    return std::nullopt;
+  }
+  return static_cast<float>(feedback_[material_index]) / kFootprintScale - kFootprintBias;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+
+#include "gl/Buffer.hpp"
+
+// Emulates sampler feedback: the fragment shader records, per material, the finest UV footprint
+// its textures were sampled at with atomicMin into an SSBO. Each frame's feedback is copied to a
+// readback buffer and read on the CPU once its fence signals a few frames later, so reading it
+// never stalls the pipeline.
+class TextureFeedback {
+ public:
+  void Init(uint32_t max_materials);
+  void Shutdown();
+
+  // Binds the feedback buffer for this frame's draws.
+  void Bind(GLuint slot) const;
+  // Reads back finished frames, then queues a readback of this frame's feedback and resets it.
+  // Call after this frame's draws.
+  void EndFrame();
+
+  // log2 of the finest UV distance per pixel the material's textures were sampled at in the
+  // latest read back frame, nullopt if it wasn't sampled. The finest mip level a texture of
+  // size texels needs is log2(size) plus this.
+  [[nodiscard]] std::optional<float> MaterialUVFootprint(uint32_t material_index) const;
+  [[nodiscard]] bool HasData() const { return enabled && readback_frame_ != 0; }
+
+  bool enabled{false};
+
+ private:
+  struct Readback {
+    gl::Buffer<uint32_t> buffer;
+    GLsync fence{};
+    uint64_t frame{};
+  };
+  static constexpr uint32_t kNumReadbacks = 3;
+
+  gl::Buffer<uint32_t> feedback_ssbo_;
+  std::array<Readback, kNumReadbacks> readbacks_;
+  // values of the latest read back frame
+  std::vector<uint32_t> feedback_;
+  uint32_t max_materials_{};
+  uint64_t frame_{1};
+  uint64_t readback_frame_{};
+};
@@ -0,0 +1,44 @@
+#include "TextureQuality.hpp"
+
+#include "MipChain.hpp"
+#include "pch.hpp"
+
+namespace texture_quality {
+
+TextureQuality Get(TextureQualityTier tier) {
+  switch (tier) {
+    case TextureQualityTier::kLow:
+      return {.max_dimension = 1024, .mip_bias = 1};
+    case TextureQualityTier::kMedium:
+      return {.max_dimension = 2048, .mip_bias = 0};
+    case TextureQualityTier::kHigh:
+      return {.max_dimension = 4096, .mip_bias = 0};
+    case TextureQualityTier::kUltra:
+      break;
+  }
+  return {.max_dimension = 16384, .mip_bias = 0};
+}
+
+const char* Name(TextureQualityTier tier) {
+  switch (tier) {
+    case TextureQualityTier::kLow:
+      return "Low";
+    case TextureQualityTier::kMedium:
+      return "Medium";
+    case TextureQualityTier::kHigh:
+      return "High";
+    case TextureQualityTier::kUltra:
+      break;
+  }
+  return "Ultra";
+}
+
+int SkippedLevels(const TextureQuality& quality, glm::ivec2 dims) {
+  if (dims.x <= 0 || dims.y <= 0) return 0;
+  const int size = std::max(dims.x, dims.y);
+  int skipped = quality.mip_bias;
+  while ((size >> skipped) > quality.max_dimension) skipped++;
+  return std::clamp(skipped, 0, mip::NumLevels(dims.x, dims.y) - 1);
+}
+
+}  // namespace texture_quality
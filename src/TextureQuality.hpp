@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+
+enum class TextureQualityTier : uint8_t {
+  kLow,
+  kMedium,
+  kHigh,
+  kUltra,
+};
+inline constexpr int kNumTextureQualityTiers = 4;
+
+// Caps material textures at load: mip_bias top levels are dropped from every texture, and more
+// until it fits max_dimension.
+struct TextureQuality {
+  int max_dimension;
+  int mip_bias;
+};
+
+namespace texture_quality {
+
+[[nodiscard]] TextureQuality Get(TextureQualityTier tier);
+[[nodiscard]] const char* Name(TextureQualityTier tier);
+// Top mip levels a texture of dims drops under quality, always leaving at least one.
+[[nodiscard]] int SkippedLevels(const TextureQuality& quality, glm::ivec2 dims);
+
+}  // namespace texture_quality
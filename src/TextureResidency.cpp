@@ -0,0 +1,100 @@
+#include "TextureResidency.hpp"
+
+#include <imgui.h>
+
+#include "Frustum.hpp"
+#include "Renderer.hpp"
+#include "ResourceManager.hpp"
+#include "TextureStreamer.hpp"
+#include "pch.hpp"
+
+TextureResidency::TextureResidency(ResourceManager& resource_manager,
+                                   TextureStreamer& texture_streamer)
+    : resource_manager_(resource_manager), texture_streamer_(texture_streamer) {}
+
+void TextureResidency::Add(AssetHandle texture_handle) {
+  // new textures are resident, give them time to be drawn before evicting
+  last_used_frames_.insert_or_assign(texture_handle, frame_);
+}
+
+void TextureResidency::Remove(AssetHandle texture_handle) {
+  last_used_frames_.erase(texture_handle);
+}
+
+void TextureResidency::Clear() { last_used_frames_.clear(); }
+
+void TextureResidency::MarkStaticDraws(const Renderer& renderer, const RenderInfo& render_info) {
+  ZoneScoped;
+  const Frustum frustum =
+      Frustum::FromViewProjection(render_info.projection_matrix * render_info.view_matrix);
+  const std::vector<AABB>& bounds = renderer.StaticDrawBounds();
+  const std::vector<AssetHandle>& materials = renderer.StaticDrawMaterials();
+  for (size_t i = 0; i < bounds.size(); i++) {
+    if (frustum.Intersects(bounds[i])) MarkMaterial(materials[i]);
+  }
+}
+
+void TextureResidency::MarkMaterial(AssetHandle material_handle) {
+  const std::vector<AssetHandle>* texture_handles =
+      texture_streamer_.MaterialTextures(material_handle);
+  if (!texture_handles) return;
+  for (AssetHandle texture_handle : *texture_handles) {
+    auto it = last_used_frames_.find(texture_handle);
+    if (it != last_used_frames_.end()) it->second = frame_;
+  }
+}
+
+void TextureResidency::Update() {
+  ZoneScoped;
+  struct Candidate {
+    gl::Texture* texture;
+    uint64_t last_used_frame;
+  };
+  std::vector<Candidate> evictions;
+  made_resident_last_frame_ = 0;
+  resident_bytes_ = 0;
+  num_resident_ = 0;
+  for (const auto& [handle, last_used_frame] : last_used_frames_) {
+    // the streamer may have replaced the texture since last frame, so look it up each time
+    gl::Texture* texture = resource_manager_.Get<gl::Texture>(handle);
+    if (!texture || !texture->BindlessHandle()) continue;
+    if (last_used_frame == frame_) {
+      if (!texture->IsResident()) {
+        texture->MakeResident();
+        made_resident_last_frame_++;
+      }
+    } else if (texture->IsResident() &&
+               frame_ - last_used_frame > settings.frames_until_non_resident) {
+      evictions.push_back(Candidate{.texture = texture, .last_used_frame = last_used_frame});
+    }
+    if (texture->IsResident()) {
+      resident_bytes_ += texture->SizeBytes();
+      num_resident_++;
+    }
+  }
+
+  // batched, least recently used first
+  std::ranges::sort(evictions, [](const Candidate& a, const Candidate& b) {
+    return a.last_used_frame < b.last_used_frame;
+  });
+  made_non_resident_last_frame_ =
+      std::min(static_cast<uint32_t>(evictions.size()), settings.max_evictions_per_frame);
+  for (uint32_t i = 0; i < made_non_resident_last_frame_; i++) {
+    evictions[i].texture->MakeNonResident();
+    resident_bytes_ -= evictions[i].texture->SizeBytes();
+    num_resident_--;
+  }
+  frame_++;
+}
+
+void TextureResidency::OnImGui() {
+  if (!ImGui::CollapsingHeader("Texture Residency")) return;
+  int frames = static_cast<int>(settings.frames_until_non_resident);
+  if (ImGui::SliderInt("Frames Until Non-Resident", &frames, 1, 1000)) {
+    settings.frames_until_non_resident = frames;
+  }
+  ImGui::Text("Resident: %u / %zu textures, %.2f MiB", num_resident_, last_used_frames_.size(),
+              resident_bytes_ / (1024.0 * 1024.0));
+  ImGui::Text("Last frame: %u made resident, %u made non-resident", made_resident_last_frame_,
+              made_non_resident_last_frame_);
+}
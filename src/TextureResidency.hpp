@@ -0,0 +1,53 @@
+#pragma once
+
+#include "types.hpp"
+
+class Renderer;
+class ResourceManager;
+class TextureStreamer;
+struct RenderInfo;
+
+struct TextureResidencySettings {
+  // frames a texture can go without being sampled before it is made non-resident
+  uint64_t frames_until_non_resident{120};
+  // evictions applied per frame, textures that become visible are always made resident at once
+  uint32_t max_evictions_per_frame{32};
+};
+
+// Keeps only the bindless handles of recently sampled material textures resident. Materials of
+// static draws in the view frustum are marked each frame, and Update makes their textures resident
+// before drawing. Textures that haven't been sampled for a while are made non-resident, which is
+// safe since culled primitives generate no fragments to sample them.
+class TextureResidency {
+ public:
+  TextureResidency(ResourceManager& resource_manager, TextureStreamer& texture_streamer);
+
+  void Add(AssetHandle texture_handle);
+  void Remove(AssetHandle texture_handle);
+  void Clear();
+
+  // Marks the textures of the renderer's static draws in the frustum as sampled this frame. These
+  // are everything drawn, whichever model submitted it, so textures shared between models stay
+  // resident while any of them is in view.
+  void MarkStaticDraws(const Renderer& renderer, const RenderInfo& render_info);
+  void MarkMaterial(AssetHandle material_handle);
+  // Applies this frame's residency changes, call after marking and before drawing.
+  void Update();
+  void OnImGui();
+
+  [[nodiscard]] size_t ResidentBytes() const { return resident_bytes_; }
+  [[nodiscard]] uint32_t NumResident() const { return num_resident_; }
+
+  TextureResidencySettings settings;
+
+ private:
+  ResourceManager& resource_manager_;
+  TextureStreamer& texture_streamer_;
+  // texture handle -> frame it was last sampled in
+  std::unordered_map<AssetHandle, uint64_t> last_used_frames_;
+  size_t resident_bytes_{};
+  uint32_t num_resident_{};
+  uint32_t made_resident_last_frame_{};
+  uint32_t made_non_resident_last_frame_{};
+  uint64_t frame_{1};
+};
@@ -0,0 +1,457 @@
+#include "TextureStreamer.hpp"
+
+#include <imgui.h>
+
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#include "Frustum.hpp"
+#include "Renderer.hpp"
+#include "ResourceManager.hpp"
+#include "pch.hpp"
+#include "util/ThreadPool.hpp"
+
+namespace {
+
+// frames a replaced texture is kept alive for, so in flight frames can still sample it
+constexpr uint64_t kRetireFrames = 3;
+constexpr double kBytesToMiB = 1.0 / (1024.0 * 1024.0);
+
+}  // namespace
+
+TextureStreamer::TextureStreamer(ResourceManager& resource_manager, Renderer& renderer)
+    : resource_manager_(resource_manager), renderer_(renderer) {}
+
+void TextureStreamer::Init() { upload_ring_.Init(settings.upload_ring_bytes); }
+
+void TextureStreamer::Shutdown() {
+  Clear();
+  upload_ring_.Shutdown();
+}
+
+gl::Texture TextureStreamer::Add(AssetHandle handle, StreamedTextureData data) {
+  ZoneScoped;
+  const int num_levels = static_cast<int>(data.level_sizes.size());
+  int min_resident_level = 0;
+  while (min_resident_level < num_levels - 1 &&
+         std::max(data.dims.x, data.dims.y) >> min_resident_level > settings.min_resident_size) {
+    min_resident_level++;
+  }
+  auto [it, inserted] =
+      textures_.insert_or_assign(handle, StreamedTexture{.data = std::move(data),
+                                                         .num_levels = num_levels,
+                                                         .min_resident_level = min_resident_level,
+                                                         .resident_level = min_resident_level,
+                                                         .requested_level = min_resident_level,
+                                                         .last_requested_frame = 0,
+                                                         .material_uses = {},
+                                                         .upload_pending = false});
+  resident_bytes_ += ResidentBytes(it->second, min_resident_level);
+  return CreateTexture(it->second, min_resident_level, LevelData(it->second, min_resident_level),
+                       nullptr);
+}
+
+void TextureStreamer::Remove(AssetHandle handle) {
+  auto it = textures_.find(handle);
+  if (it == textures_.end()) return;
+  StreamedTexture& texture = it->second;
+  // the copy reads the texture's data, wait for it and have IssueUploads skip the upload
+  for (PendingUpload& upload : pending_uploads_) {
+    if (upload.handle != handle) continue;
+    upload.copy.wait();
+    pending_bytes_ -= ResidentBytes(texture, upload.level) -
+                      ResidentBytes(texture, texture.resident_level);
+    // the handle may be reused before the upload is issued
+    upload.handle = 0;
+  }
+  resident_bytes_ -= ResidentBytes(texture, texture.resident_level);
+  textures_.erase(it);
+}
+
+void TextureStreamer::Replace(AssetHandle handle, StreamedTextureData data) {
+  ZoneScoped;
+  auto it = textures_.find(handle);
+  gl::Texture* current = resource_manager_.Get<gl::Texture>(handle);
+  if (it == textures_.end() || !current) return;
+  std::vector<MaterialUse> material_uses = std::move(it->second.material_uses);
+  Remove(handle);
+  gl::Texture replacement = Add(handle, std::move(data));
+  for (const MaterialUse& use : material_uses) {
+    renderer_.SetMaterialTextureHandle(use.material_handle, use.role,
+                                       replacement.BindlessHandle());
+  }
+  textures_.at(handle).material_uses = std::move(material_uses);
+  retired_textures_.push_back(RetiredTexture{.texture = std::move(*current), .frame = frame_});
+  *current = std::move(replacement);
+}
+
+void TextureStreamer::AddMaterialUse(AssetHandle texture_handle, AssetHandle material_handle,
+                                     TextureRole role) {
+  auto it = textures_.find(texture_handle);
+  if (it == textures_.end()) return;
+  it->second.material_uses.push_back(
+      MaterialUse{.material_handle = material_handle, .role = role});
+  material_textures_[material_handle].emplace_back(texture_handle);
+}
+
+void TextureStreamer::RemoveMaterial(AssetHandle material_handle) {
+  auto it = material_textures_.find(material_handle);
+  if (it == material_textures_.end()) return;
+  for (AssetHandle texture_handle : it->second) {
+    auto texture_it = textures_.find(texture_handle);
+    if (texture_it == textures_.end()) continue;
+    std::erase_if(texture_it->second.material_uses, [material_handle](const MaterialUse& use) {
+      return use.material_handle == material_handle;
+    });
+  }
+  material_textures_.erase(it);
+}
+
+void TextureStreamer::Clear() {
+  for (PendingUpload& upload : pending_uploads_) upload.copy.wait();
+  if (!pending_uploads_.empty()) upload_ring_.Fence(pending_uploads_.back().allocation.end);
+  pending_uploads_.clear();
+  pending_bytes_ = 0;
+  textures_.clear();
+  material_textures_.clear();
+  retired_textures_.clear();
+  resident_bytes_ = 0;
+}
+
+const std::vector<AssetHandle>* TextureStreamer::MaterialTextures(
+    AssetHandle material_handle) const {
+  auto it = material_textures_.find(material_handle);
+  return it == material_textures_.end() ? nullptr : &it->second;
+}
+
+void TextureStreamer::RequestModel(const Model& model, const glm::mat4& model_matrix,
+                                   const RenderInfo& render_info, float viewport_height) {
+  ZoneScoped;
+  const bool orthographic = render_info.projection_matrix[3][3] == 1.f;
+  const float pixels_per_unit = render_info.projection_matrix[1][1] * viewport_height * 0.5f;
+  const Frustum frustum =
+      Frustum::FromViewProjection(render_info.projection_matrix * render_info.view_matrix);
+  for (const SceneNode& node : model.nodes) {
+    const glm::mat4 world_matrix = model_matrix * node.model_matrix;
+    for (const Primitive& primitive : model.meshes[node.mesh_idx].primitives) {
+      auto material_it = material_textures_.find(primitive.material_handle);
+      if (material_it == material_textures_.end()) continue;
+      const Sphere sphere = TransformedBoundingSphere(primitive.aabb, world_matrix);
+      if (!frustum.Intersects(sphere)) continue;
+
+      // projected diameter of the primitive's bounding sphere
+      const float distance =
+          orthographic ? 1.f : glm::distance(render_info.view_pos, sphere.center);
+      const float screen_size = !orthographic && distance <= sphere.radius
+                                    ? std::numeric_limits<float>::max()
+                                    : 2.f * sphere.radius * pixels_per_unit / distance;
+
+      for (AssetHandle texture_handle : material_it->second) {
+        auto texture_it = textures_.find(texture_handle);
+        if (texture_it == textures_.end()) continue;
+        StreamedTexture& texture = texture_it->second;
+        // assumes the primitive's UVs span the texture once
+        const int texture_size = std::max(texture.data.dims.x, texture.data.dims.y);
+        int level = 0;
+        while (level < texture.min_resident_level &&
+               static_cast<float>(texture_size >> (level + 1)) >= screen_size) {
+          level++;
+        }
+        Request(texture, level);
+      }
+    }
+  }
+}
+
+void TextureStreamer::RequestFromFeedback(const TextureFeedback& feedback) {
+  ZoneScoped;
+  for (const auto& [material_handle, texture_handles] : material_textures_) {
+    const std::optional<uint32_t> material_index = renderer_.MaterialIndex(material_handle);
+    if (!material_index) continue;
+    // unsampled materials request nothing, leaving their textures first in line for eviction
+    const std::optional<float> footprint = feedback.MaterialUVFootprint(*material_index);
+    if (!footprint) continue;
+    for (AssetHandle texture_handle : texture_handles) {
+      auto texture_it = textures_.find(texture_handle);
+      if (texture_it == textures_.end()) continue;
+      StreamedTexture& texture = texture_it->second;
+      const int texture_size = std::max(texture.data.dims.x, texture.data.dims.y);
+      const float level = std::log2(static_cast<float>(texture_size)) + *footprint;
+      Request(texture, std::clamp(static_cast<int>(std::floor(level)), 0,
+                                  texture.min_resident_level));
+    }
+  }
+}
+
+void TextureStreamer::Request(StreamedTexture& texture, int level) {
+  if (texture.last_requested_frame != frame_) {
+    texture.last_requested_frame = frame_;
+    texture.requested_level = level;
+  } else {
+    texture.requested_level = std::min(texture.requested_level, level);
+  }
+}
+
+void TextureStreamer::Update() {
+  ZoneScoped;
+  std::erase_if(retired_textures_, [this](const RetiredTexture& retired) {
+    return frame_ - retired.frame >= kRetireFrames;
+  });
+  frame_bytes_ = 0;
+  IssueUploads();
+
+  // a lowered budget evicts over as many frames as the frame budget needs
+  if (resident_bytes_ > settings.vram_budget_bytes) {
+    Evict(resident_bytes_ - settings.vram_budget_bytes, true);
+  }
+
+  // biggest shortfall in detail first
+  std::vector<std::pair<AssetHandle, StreamedTexture*>> upgrades;
+  for (auto& [handle, texture] : textures_) {
+    if (texture.last_requested_frame == frame_ && !texture.upload_pending &&
+        texture.requested_level < texture.resident_level) {
+      upgrades.emplace_back(handle, &texture);
+    }
+  }
+  std::ranges::sort(upgrades, [](const auto& a, const auto& b) {
+    return a.second->resident_level - a.second->requested_level >
+           b.second->resident_level - b.second->requested_level;
+  });
+
+  for (auto& [handle, texture] : upgrades) {
+    // spent, skip evicting for upgrades that couldn't be uploaded anyway
+    if (frame_bytes_ >= settings.max_upload_bytes_per_frame) break;
+    const size_t current_bytes = ResidentBytes(*texture, texture->resident_level);
+    // settle for less detail when the requested level can't fit the budget
+    int level = texture->requested_level;
+    for (; level < texture->resident_level; level++) {
+      const size_t needed =
+          resident_bytes_ + pending_bytes_ + ResidentBytes(*texture, level) - current_bytes;
+      if (needed <= settings.vram_budget_bytes ||
+          Evict(needed - settings.vram_budget_bytes, false)) {
+        break;
+      }
+    }
+    if (level == texture->resident_level) continue;
+    // the whole texture is written, uploading the new levels and copying the kept ones
+    const size_t upload_bytes = ResidentBytes(*texture, level);
+    if (!FitsFrameBudget(upload_bytes)) break;
+    frame_bytes_ += upload_bytes;
+    if (!StageUpload(handle, *texture, level)) {
+      SetResidentLevel(handle, *texture, level, LevelData(*texture, level));
+    }
+  }
+  uploaded_bytes_last_frame_ = frame_bytes_;
+  frame_++;
+}
+
+bool TextureStreamer::FitsFrameBudget(size_t bytes) const {
+  return frame_bytes_ == 0 || frame_bytes_ + bytes <= settings.max_upload_bytes_per_frame;
+}
+
+bool TextureStreamer::Evict(size_t bytes, bool partial) {
+  ZoneScoped;
+  struct Victim {
+    AssetHandle handle;
+    StreamedTexture* texture;
+    int level;
+    size_t freed_bytes;
+  };
+  // textures not requested this frame fall back to their low mips, requested ones with more
+  // detail than they need to the requested level
+  std::vector<Victim> victims;
+  size_t freeable_bytes = 0;
+  for (auto& [handle, texture] : textures_) {
+    if (texture.upload_pending) continue;
+    const int level = texture.last_requested_frame == frame_
+                          ? std::min(texture.requested_level, texture.min_resident_level)
+                          : texture.min_resident_level;
+    if (level <= texture.resident_level) continue;
+    const size_t freed_bytes =
+        ResidentBytes(texture, texture.resident_level) - ResidentBytes(texture, level);
+    victims.push_back(
+        Victim{.handle = handle, .texture = &texture, .level = level, .freed_bytes = freed_bytes});
+    freeable_bytes += freed_bytes;
+  }
+  if (freeable_bytes < bytes && !partial) return false;
+
+  std::ranges::sort(victims, [](const Victim& a, const Victim& b) {
+    return a.texture->last_requested_frame < b.texture->last_requested_frame;
+  });
+  // the kept levels of each victim are copied into its new texture, which counts against the
+  // frame's budget like an upload
+  size_t num_victims = 0;
+  size_t freed_bytes = 0;
+  size_t copy_bytes = 0;
+  for (; num_victims < victims.size() && freed_bytes < bytes; num_victims++) {
+    const Victim& victim = victims[num_victims];
+    const size_t victim_copy_bytes = ResidentBytes(*victim.texture, victim.level);
+    // at least one texture changes per frame, as with uploads
+    if (frame_bytes_ + copy_bytes > 0 &&
+        frame_bytes_ + copy_bytes + victim_copy_bytes > settings.max_upload_bytes_per_frame) {
+      break;
+    }
+    copy_bytes += victim_copy_bytes;
+    freed_bytes += victim.freed_bytes;
+  }
+  if (freed_bytes < bytes && !partial) return false;
+
+  for (size_t i = 0; i < num_victims; i++) {
+    SetResidentLevel(victims[i].handle, *victims[i].texture, victims[i].level, nullptr);
+  }
+  frame_bytes_ += copy_bytes;
+  return freed_bytes >= bytes;
+}
+
+void TextureStreamer::SetResidentLevel(AssetHandle handle, StreamedTexture& texture, int level,
+                                       const uint8_t* level_data) {
+  ZoneScoped;
+  gl::Texture* current = resource_manager_.Get<gl::Texture>(handle);
+  if (!current) return;
+  gl::Texture replacement = CreateTexture(texture, level, level_data, current);
+  for (const MaterialUse& use : texture.material_uses) {
+    renderer_.SetMaterialTextureHandle(use.material_handle, use.role,
+                                       replacement.BindlessHandle());
+  }
+  retired_textures_.push_back(RetiredTexture{.texture = std::move(*current), .frame = frame_});
+  *current = std::move(replacement);
+  resident_bytes_ -= ResidentBytes(texture, texture.resident_level);
+  resident_bytes_ += ResidentBytes(texture, level);
+  texture.resident_level = level;
+}
+
+bool TextureStreamer::StageUpload(AssetHandle handle, StreamedTexture& texture, int level) {
+  // only the new levels, the resident ones are copied on the GPU
+  const uint8_t* level_data = LevelData(texture, level);
+  const auto size =
+      static_cast<size_t>(LevelData(texture, texture.resident_level) - level_data);
+  std::optional<gl::PixelUploadRing::Allocation> allocation = upload_ring_.Allocate(size);
+  if (!allocation) return false;
+  std::future<void> copy = ThreadPool::Get().thread_pool.submit_task(
+      [dst = allocation->data, level_data, size]() { std::memcpy(dst, level_data, size); });
+  pending_bytes_ += ResidentBytes(texture, level) - ResidentBytes(texture, texture.resident_level);
+  texture.upload_pending = true;
+  pending_uploads_.push_back(PendingUpload{.handle = handle,
+                                           .level = level,
+                                           .allocation = allocation.value(),
+                                           .copy = std::move(copy)});
+  return true;
+}
+
+void TextureStreamer::IssueUploads() {
+  ZoneScoped;
+  if (pending_uploads_.empty()) return;
+  // in order, so the ring is fenced in the order it was allocated
+  std::optional<uint64_t> fence_end;
+  while (!pending_uploads_.empty() &&
+         pending_uploads_.front().copy.wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready) {
+    PendingUpload upload = std::move(pending_uploads_.front());
+    pending_uploads_.pop_front();
+    if (!fence_end) upload_ring_.Bind();
+    fence_end = upload.allocation.end;
+    auto it = textures_.find(upload.handle);
+    if (it == textures_.end()) continue;
+    StreamedTexture& texture = it->second;
+    texture.upload_pending = false;
+    pending_bytes_ -= ResidentBytes(texture, upload.level) -
+                      ResidentBytes(texture, texture.resident_level);
+    // with the ring bound, the pixel pointer is an offset into it
+    SetResidentLevel(upload.handle, texture, upload.level,
+                     reinterpret_cast<const uint8_t*>(upload.allocation.offset));
+  }
+  if (fence_end) {
+    gl::PixelUploadRing::Unbind();
+    upload_ring_.Fence(fence_end.value());
+  }
+}
+
+const uint8_t* TextureStreamer::LevelData(const StreamedTexture& texture, int level) const {
+  size_t offset = 0;
+  for (int i = 0; i < level; i++) offset += texture.data.level_sizes[i];
+  return texture.data.data.data() + offset;
+}
+
+gl::Texture TextureStreamer::CreateTexture(const StreamedTexture& texture, int first_level,
+                                           const uint8_t* level_data,
+                                           const gl::Texture* resident) const {
+  const StreamedTextureData& data = texture.data;
+  const glm::ivec2 dims{std::max(data.dims.x >> first_level, 1),
+                        std::max(data.dims.y >> first_level, 1)};
+  std::vector<size_t> level_sizes(data.level_sizes.begin() + first_level, data.level_sizes.end());
+  // levels from here down come from the resident texture
+  const int first_copied_level =
+      resident ? std::max(texture.resident_level, first_level) : texture.num_levels;
+  const auto num_data_levels = static_cast<size_t>(first_copied_level - first_level);
+  gl::Texture result;
+  // TODO: address texture repeat using sampler
+  if (data.compressed) {
+    result = gl::Texture{gl::Tex2DCompressedCreateInfo{.dims = dims,
+                                                       .wrap_s = GL_REPEAT,
+                                                       .wrap_t = GL_REPEAT,
+                                                       .internal_format = data.internal_format,
+                                                       .min_filter = GL_LINEAR_MIPMAP_LINEAR,
+                                                       .mag_filter = GL_LINEAR,
+                                                       .data = level_data,
+                                                       .level_sizes = std::move(level_sizes),
+                                                       .bindless = true,
+                                                       .swizzle = data.swizzle,
+                                                       .num_data_levels = num_data_levels}};
+  } else {
+    result = gl::Texture{gl::Tex2DCreateInfo{.dims = dims,
+                                             .wrap_s = GL_REPEAT,
+                                             .wrap_t = GL_REPEAT,
+                                             .internal_format = data.internal_format,
+                                             .format = data.format,
+                                             .type = GL_UNSIGNED_BYTE,
+                                             .min_filter = GL_LINEAR_MIPMAP_LINEAR,
+                                             .mag_filter = GL_LINEAR,
+                                             .data = const_cast<unsigned char*>(level_data),
+                                             .bindless = true,
+                                             .gen_mipmaps = false,
+                                             .swizzle = data.swizzle,
+                                             .level_sizes = std::move(level_sizes),
+                                             .num_data_levels = num_data_levels}};
+  }
+  for (int level = first_copied_level; level < texture.num_levels; level++) {
+    glCopyImageSubData(resident->Id(), GL_TEXTURE_2D, level - texture.resident_level, 0, 0, 0,
+                       result.Id(), GL_TEXTURE_2D, level - first_level, 0, 0, 0,
+                       std::max(data.dims.x >> level, 1), std::max(data.dims.y >> level, 1), 1);
+  }
+  return result;
+}
+
+size_t TextureStreamer::ResidentBytes(const StreamedTexture& texture, int first_level) const {
+  const StreamedTextureData& data = texture.data;
+  if (data.compressed) {
+    size_t size = 0;
+    for (int level = first_level; level < texture.num_levels; level++) {
+      size += data.level_sizes[level];
+    }
+    return size;
+  }
+  return gl::TextureSizeBytes(
+      data.internal_format,
+      glm::ivec2{std::max(data.dims.x >> first_level, 1), std::max(data.dims.y >> first_level, 1)},
+      true);
+}
+
+void TextureStreamer::OnImGui() {
+  if (!ImGui::CollapsingHeader("Texture Streaming")) return;
+  int budget_mib = static_cast<int>(settings.vram_budget_bytes >> 20);
+  if (ImGui::SliderInt("VRAM Budget (MiB)", &budget_mib, 16, 8192)) {
+    settings.vram_budget_bytes = static_cast<size_t>(budget_mib) << 20;
+  }
+  int upload_mib = static_cast<int>(settings.max_upload_bytes_per_frame >> 20);
+  if (ImGui::SliderInt("Max Upload Per Frame (MiB)", &upload_mib, 1, 256)) {
+    settings.max_upload_bytes_per_frame = static_cast<size_t>(upload_mib) << 20;
+  }
+  ImGui::Checkbox("GPU Mip Feedback", &renderer_.GetTextureFeedback().enabled);
+  ImGui::Text("Resident: %.2f / %.2f MiB, %zu textures", resident_bytes_ * kBytesToMiB,
+              settings.vram_budget_bytes * kBytesToMiB, textures_.size());
+  ImGui::Text("Uploaded or copied last frame: %.2f MiB",
+              uploaded_bytes_last_frame_ * kBytesToMiB);
+  ImGui::Text("Upload ring: %.2f / %.2f MiB, %zu staged", upload_ring_.UsedBytes() * kBytesToMiB,
+              upload_ring_.Size() * kBytesToMiB, pending_uploads_.size());
+}
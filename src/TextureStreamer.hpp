@@ -0,0 +1,150 @@
+#pragma once
+
+#include <deque>
+#include <future>
+
+#include "gl/PixelUploadRing.hpp"
+#include "gl/Texture.hpp"
+#include "types.hpp"
+
+class Renderer;
+class ResourceManager;
+class TextureFeedback;
+struct RenderInfo;
+
+// Every mip level of a texture, kept in system memory so levels can be uploaded on demand.
+struct StreamedTextureData {
+  glm::ivec2 dims;
+  GLenum internal_format;
+  // client format of uncompressed data, unused when compressed
+  GLenum format;
+  glm::ivec4 swizzle{GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  bool compressed;
+  // every level, tightly packed from level 0 down
+  std::vector<uint8_t> data;
+  std::vector<size_t> level_sizes;
+};
+
+struct TextureStreamerSettings {
+  size_t vram_budget_bytes{512ull * 1024 * 1024};
+  // Spreads level changes over several frames, counting the bytes written to recreated textures
+  // whether uploaded or copied on the GPU. At least one texture is changed per frame.
+  size_t max_upload_bytes_per_frame{32ull * 1024 * 1024};
+  // mips at or below this size stay resident regardless of the budget
+  int min_resident_size{128};
+  size_t upload_ring_bytes{64ull * 1024 * 1024};
+};
+
+// Streams the mip levels of material textures. Textures start with only their low mips resident
+// and are raised to the level their primitives need for their size on screen. When that doesn't
+// fit the VRAM budget, the high mips of the least recently requested textures are evicted.
+// Changing the levels of a texture recreates it, so the new bindless handle is written to every
+// material sampling it. Only the levels a texture gains are uploaded, the ones it keeps are copied
+// from the old texture on the GPU, so evictions upload nothing. Upgrades are staged: worker threads
+// copy the new levels into a persistently mapped pixel buffer, and the texture is created from it
+// on a later frame once the copy is done.
+class TextureStreamer {
+ public:
+  TextureStreamer(ResourceManager& resource_manager, Renderer& renderer);
+  void Init();
+  void Shutdown();
+
+  // Returns the texture with its low mips, to be stored under handle in the resource manager.
+  [[nodiscard]] gl::Texture Add(AssetHandle handle, StreamedTextureData data);
+  void Remove(AssetHandle handle);
+  // Restarts the texture from the low mips of new data, keeping the materials that sample it.
+  void Replace(AssetHandle handle, StreamedTextureData data);
+  void AddMaterialUse(AssetHandle texture_handle, AssetHandle material_handle, TextureRole role);
+  void RemoveMaterial(AssetHandle material_handle);
+  void Clear();
+
+  // Requests mips for the textures of each primitive based on its projected size, call before
+  // Update each frame.
+  void RequestModel(const Model& model, const glm::mat4& model_matrix,
+                    const RenderInfo& render_info, float viewport_height);
+  // Requests the mips the fragment shader asked for in the latest read back feedback, in place
+  // of RequestModel's estimate.
+  void RequestFromFeedback(const TextureFeedback& feedback);
+  // Applies this frame's requests within the budget.
+  void Update();
+  void OnImGui();
+
+  [[nodiscard]] size_t ResidentBytes() const { return resident_bytes_; }
+  // Streamed textures used by the material, nullptr if it has none.
+  [[nodiscard]] const std::vector<AssetHandle>* MaterialTextures(AssetHandle material_handle) const;
+
+  TextureStreamerSettings settings;
+
+ private:
+  struct MaterialUse {
+    AssetHandle material_handle;
+    TextureRole role;
+  };
+
+  struct StreamedTexture {
+    StreamedTextureData data;
+    int num_levels;
+    // levels from here down are always resident
+    int min_resident_level;
+    // most detailed level on the GPU
+    int resident_level;
+    // most detailed level asked for in the last requested frame
+    int requested_level;
+    uint64_t last_requested_frame;
+    std::vector<MaterialUse> material_uses;
+    // an upgrade is being copied to the upload ring, the levels stay as they are until it's done
+    bool upload_pending;
+  };
+
+  struct PendingUpload {
+    AssetHandle handle;
+    int level;
+    gl::PixelUploadRing::Allocation allocation;
+    std::future<void> copy;
+  };
+
+  // Replaced textures may still be sampled by frames in flight.
+  struct RetiredTexture {
+    gl::Texture texture;
+    uint64_t frame;
+  };
+
+  void Request(StreamedTexture& texture, int level);
+  // Creates the texture with levels from first_level down. The levels it shares with resident,
+  // which holds the levels from the texture's resident level down, are copied from it on the GPU.
+  // level_data holds the others, in client memory or as an offset into the bound upload ring.
+  [[nodiscard]] gl::Texture CreateTexture(const StreamedTexture& texture, int first_level,
+                                          const uint8_t* level_data,
+                                          const gl::Texture* resident) const;
+  [[nodiscard]] const uint8_t* LevelData(const StreamedTexture& texture, int level) const;
+  // VRAM used by the texture with first_level as its most detailed level
+  [[nodiscard]] size_t ResidentBytes(const StreamedTexture& texture, int first_level) const;
+  // level_data holds the levels above the resident level that the texture gains, if any
+  void SetResidentLevel(AssetHandle handle, StreamedTexture& texture, int level,
+                        const uint8_t* level_data);
+  // Whether bytes more can be written to recreated textures this frame.
+  [[nodiscard]] bool FitsFrameBudget(size_t bytes) const;
+  // Starts copying the levels into the upload ring, false if it is out of space.
+  bool StageUpload(AssetHandle handle, StreamedTexture& texture, int level);
+  // Creates the textures of staged uploads whose copies are done.
+  void IssueUploads();
+  // Drops high mips of least recently requested textures until bytes are freed, within the
+  // frame's budget. Evicts nothing and returns false if that isn't possible, unless partial is
+  // set, in which case it frees what the budget allows and leaves the rest to later frames.
+  bool Evict(size_t bytes, bool partial);
+
+  ResourceManager& resource_manager_;
+  Renderer& renderer_;
+  std::unordered_map<AssetHandle, StreamedTexture> textures_;
+  std::unordered_map<AssetHandle, std::vector<AssetHandle>> material_textures_;
+  std::vector<RetiredTexture> retired_textures_;
+  gl::PixelUploadRing upload_ring_;
+  std::deque<PendingUpload> pending_uploads_;
+  // VRAM the pending uploads will add once issued
+  size_t pending_bytes_{};
+  size_t resident_bytes_{};
+  // bytes written to recreated textures this frame
+  size_t frame_bytes_{};
+  size_t uploaded_bytes_last_frame_{};
+  uint64_t frame_{1};
+};
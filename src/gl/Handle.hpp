@@ -0,0 +1,78 @@
+#pragma once
+
+#include <utility>
+
+namespace gl {
+
+namespace detail {
+
+struct DeleteTexture {
+  void operator()(GLuint id) const { glDeleteTextures(1, &id); }
+};
+struct DeleteFramebuffer {
+  void operator()(GLuint id) const { glDeleteFramebuffers(1, &id); }
+};
+struct DeleteRenderbuffer {
+  void operator()(GLuint id) const { glDeleteRenderbuffers(1, &id); }
+};
+
+}  // namespace detail
+
+// Owns one GL object name and deletes it with the handle, for objects that need no more state
+// than their name. Move-only like gl::Texture.
+template <typename Deleter>
+class Handle {
+ public:
+  Handle() = default;
+  explicit Handle(GLuint id) : id_(id) {}
+  Handle(const Handle& other) = delete;
+  Handle& operator=(const Handle& other) = delete;
+  Handle(Handle&& other) noexcept : id_(std::exchange(other.id_, 0)) {}
+  Handle& operator=(Handle&& other) noexcept {
+    if (&other == this) return *this;
+    Reset();
+    id_ = std::exchange(other.id_, 0);
+    return *this;
+  }
+  ~Handle() { Reset(); }
+
+  [[nodiscard]] GLuint Id() const { return id_; }
+  void Reset() {
+    if (id_) Deleter{}(id_);
+    id_ = 0;
+  }
+
+ private:
+  GLuint id_{0};
+};
+
+using TextureHandle = Handle<detail::DeleteTexture>;
+using FramebufferHandle = Handle<detail::DeleteFramebuffer>;
+using RenderbufferHandle = Handle<detail::DeleteRenderbuffer>;
+
+[[nodiscard]] inline TextureHandle CreateTexture(GLenum target) {
+  GLuint id;
+  glCreateTextures(target, 1, &id);
+  return TextureHandle{id};
+}
+
+// An unbound name with no target yet, for glTextureView.
+[[nodiscard]] inline TextureHandle GenTexture() {
+  GLuint id;
+  glGenTextures(1, &id);
+  return TextureHandle{id};
+}
+
+[[nodiscard]] inline FramebufferHandle CreateFramebuffer() {
+  GLuint id;
+  glCreateFramebuffers(1, &id);
+  return FramebufferHandle{id};
+}
+
+[[nodiscard]] inline RenderbufferHandle CreateRenderbuffer() {
+  GLuint id;
+  glCreateRenderbuffers(1, &id);
+  return RenderbufferHandle{id};
+}
+
+}  // namespace gl
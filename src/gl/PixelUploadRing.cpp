@@ -0,0 +1,68 @@
+#include "PixelUploadRing.hpp"
+
+namespace gl {
+
+namespace {
+
+// satisfies the offset alignment of every pixel and block format
+constexpr size_t kAlignment = 256;
+
+}  // namespace
+
+PixelUploadRing::~PixelUploadRing() { Shutdown(); }
+
+void PixelUploadRing::Init(size_t size_bytes) {
+  size_ = size_bytes;
+  constexpr GLbitfield kFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glCreateBuffers(1, &id_);
+  glNamedBufferStorage(id_, static_cast<GLsizeiptr>(size_), nullptr, kFlags);
+  mapped_ = static_cast<uint8_t*>(
+      glMapNamedBufferRange(id_, 0, static_cast<GLsizeiptr>(size_), kFlags));
+}
+
+void PixelUploadRing::Shutdown() {
+  for (const FencedRegion& region : fenced_regions_) glDeleteSync(region.fence);
+  fenced_regions_.clear();
+  if (id_) {
+    glUnmapNamedBuffer(id_);
+    glDeleteBuffers(1, &id_);
+  }
+  id_ = 0;
+  mapped_ = nullptr;
+}
+
+std::optional<PixelUploadRing::Allocation> PixelUploadRing::Allocate(size_t size_bytes) {
+  if (!mapped_) return std::nullopt;
+  size_bytes = (size_bytes + kAlignment - 1) & ~(kAlignment - 1);
+  if (size_bytes > size_) return std::nullopt;
+  Retire();
+  uint64_t begin = head_;
+  // allocations don't wrap, skip the rest of the buffer instead
+  if (begin % size_ + size_bytes > size_) begin += size_ - begin % size_;
+  if (begin + size_bytes - tail_ > size_) return std::nullopt;
+  head_ = begin + size_bytes;
+  const size_t offset = begin % size_;
+  return Allocation{.data = mapped_ + offset, .offset = offset, .end = head_};
+}
+
+void PixelUploadRing::Fence(uint64_t end) {
+  fenced_regions_.push_back(
+      FencedRegion{.end = end, .fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+}
+
+void PixelUploadRing::Retire() {
+  while (!fenced_regions_.empty()) {
+    const FencedRegion& region = fenced_regions_.front();
+    const GLenum result = glClientWaitSync(region.fence, 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+    glDeleteSync(region.fence);
+    tail_ = region.end;
+    fenced_regions_.pop_front();
+  }
+}
+
+void PixelUploadRing::Bind() const { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, id_); }
+
+void PixelUploadRing::Unbind() { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+
+}  // namespace gl
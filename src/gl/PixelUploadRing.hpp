@@ -0,0 +1,57 @@
+#pragma once
+
+#include <deque>
+
+namespace gl {
+
+// A persistently mapped pixel unpack buffer used as a ring. Any thread can write pixels into an
+// allocation, after which texture uploads read them from the buffer with the GL call returning
+// right away, instead of copying from client memory on the GL thread. Space is reclaimed once the
+// fence placed after the uploads reading it signals. Allocating never waits on the GPU.
+class PixelUploadRing {
+ public:
+  struct Allocation {
+    uint8_t* data;
+    // pass as the pixel pointer of upload calls while the ring is bound
+    size_t offset;
+    // position in the ring past the allocation, for Fence
+    uint64_t end;
+  };
+
+  PixelUploadRing() = default;
+  ~PixelUploadRing();
+  PixelUploadRing(const PixelUploadRing& other) = delete;
+  PixelUploadRing& operator=(const PixelUploadRing& other) = delete;
+
+  void Init(size_t size_bytes);
+  void Shutdown();
+
+  // nullopt if the space is still read by in flight uploads or the size exceeds the ring.
+  [[nodiscard]] std::optional<Allocation> Allocate(size_t size_bytes);
+  // Marks allocations up to end as free once the GL commands issued so far complete.
+  void Fence(uint64_t end);
+
+  void Bind() const;
+  static void Unbind();
+
+  [[nodiscard]] size_t Size() const { return size_; }
+  [[nodiscard]] size_t UsedBytes() const { return head_ - tail_; }
+
+ private:
+  struct FencedRegion {
+    uint64_t end;
+    GLsync fence;
+  };
+  // Frees regions whose uploads finished.
+  void Retire();
+
+  uint32_t id_{};
+  uint8_t* mapped_{};
+  size_t size_{};
+  // monotonic positions, offsets in the buffer are these modulo size_
+  uint64_t head_{};
+  uint64_t tail_{};
+  std::deque<FencedRegion> fenced_regions_;
+};
+
+}  // namespace gl
@@ -110,6 +110,33 @@ void Shader::SetFloatArr(const std::string& name, GLuint count, const GLfloat* v
   }
 }
 
+void Shader::SetVec3Arr(const std::string& name, GLuint count, const glm::vec3* value) {
+  auto it = uniform_locations_.find(name);
+  if (it != uniform_locations_.end()) {
+    glUniform3fv(it->second, count, glm::value_ptr(*value));
+  } else {
+    spdlog::error("uniform not found {}", name);
+  }
+}
+
+void Shader::SetVec4Arr(const std::string& name, GLuint count, const glm::vec4* value) {
+  auto it = uniform_locations_.find(name);
+  if (it != uniform_locations_.end()) {
+    glUniform4fv(it->second, count, glm::value_ptr(*value));
+  } else {
+    spdlog::error("uniform not found {}", name);
+  }
+}
+
+void Shader::SetMat4Arr(const std::string& name, GLuint count, const glm::mat4* value) {
+  auto it = uniform_locations_.find(name);
+  if (it != uniform_locations_.end()) {
+    glUniformMatrix4fv(it->second, count, GL_FALSE, glm::value_ptr(*value));
+  } else {
+    spdlog::error("uniform not found {}", name);
+  }
+}
+
 void Shader::SetBool(const std::string& name, bool value) {
   auto it = uniform_locations_.find(name);
   if (it != uniform_locations_.end()) {
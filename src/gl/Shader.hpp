@@ -22,6 +22,9 @@ class Shader {
   void SetMat3(const std::string& name, const glm::mat3& mat, bool transpose = false);
   void SetBool(const std::string& name, bool value);
   void SetFloatArr(const std::string& name, GLuint count, const GLfloat* value);
+  void SetVec3Arr(const std::string& name, GLuint count, const glm::vec3* value);
+  void SetVec4Arr(const std::string& name, GLuint count, const glm::vec4* value);
+  void SetMat4Arr(const std::string& name, GLuint count, const glm::mat4* value);
 
   Shader(uint32_t id, std::unordered_map<std::string, uint32_t>& uniform_locations);
   ~Shader() = default;
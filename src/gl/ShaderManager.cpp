@@ -93,6 +93,23 @@ bool CheckProgramLinkSuccess(GLuint id) {
   return true;
 }
 
+// Defines go right after the #version line, which must come first.
+std::string InjectDefines(const std::string &source,
+                          const std::vector<std::pair<std::string, std::string>> &defines) {
+  if (defines.empty()) return source;
+  std::string define_lines;
+  for (const auto &[name, value] : defines) {
+    define_lines += "#define " + name + " " + value + "\n";
+  }
+  const size_t version_pos = source.find("#version");
+  if (version_pos == std::string::npos) return define_lines + source;
+  const size_t line_end = source.find('\n', version_pos);
+  if (line_end == std::string::npos) return source + "\n" + define_lines;
+  std::string result = source;
+  result.insert(line_end + 1, define_lines);
+  return result;
+}
+
 uint32_t CompileShader(ShaderType type, const char *src) {
   uint32_t id = glCreateShader(kShaderTypeToGl[static_cast<int>(type)]);
   glShaderSource(id, 1, &src, nullptr);
@@ -137,7 +154,8 @@ std::optional<ShaderManager::ShaderProgramData> ShaderManager::CompileProgram(
       spdlog::error("Failed to load from file {}", create_info.shaderPath);
       return std::nullopt;
     }
-    uint32_t shader_id = CompileShader(create_info.shaderType, src.value().c_str());
+    const std::string source = InjectDefines(src.value(), create_info.defines);
+    uint32_t shader_id = CompileShader(create_info.shaderType, source.c_str());
     if (!CheckShaderModuleCompilationSuccess(shader_id, create_info.shaderPath.c_str())) {
       spdlog::error("error: {}", create_info.shaderPath.c_str());
       return std::nullopt;
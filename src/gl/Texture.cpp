@@ -12,20 +12,95 @@ GLsizei GetMipLevels(int w, int h) {
   return static_cast<GLsizei>(1 + std::floor(std::log2(std::max(w, h))));
 }
 
+uint32_t StoredBytesPerTexel(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_RGB8:
+    case GL_SRGB8:
+      return 4;
+    default:
+      return BytesPerTexel(internal_format);
+  }
+}
+
 }  // namespace
 
+uint32_t BytesPerTexel(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_R8:
+      return 1;
+    case GL_RG8:
+    case GL_RG16:
+      return 2;
+    case GL_RGB8:
+    case GL_SRGB8:
+      return 3;
+    case GL_RGBA8:
+    case GL_SRGB8_ALPHA8:
+      return 4;
+    case GL_RGB16F:
+      return 6;
+    case GL_RGBA16F:
+      return 8;
+    case GL_RGB32F:
+      return 12;
+    case GL_RGBA32F:
+      return 16;
+    default:
+      spdlog::error("BytesPerTexel: unhandled internal format {}", internal_format);
+      return 4;
+  }
+}
+
+uint32_t BytesPerBlock(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RED_RGTC1:
+      return 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RG_RGTC2:
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+size_t TextureSizeBytes(GLenum internal_format, glm::ivec2 dims, bool mipmapped) {
+  const GLsizei levels = mipmapped ? GetMipLevels(dims.x, dims.y) : 1;
+  const size_t bytes_per_block = BytesPerBlock(internal_format);
+  const size_t bytes_per_texel = bytes_per_block ? 0 : StoredBytesPerTexel(internal_format);
+  size_t size = 0;
+  for (GLsizei level = 0; level < levels; level++) {
+    const size_t w = std::max(dims.x >> level, 1);
+    const size_t h = std::max(dims.y >> level, 1);
+    size += bytes_per_block ? ((w + 3) / 4) * ((h + 3) / 4) * bytes_per_block
+                            : w * h * bytes_per_texel;
+  }
+  return size;
+}
+
 Texture::Texture(const Tex2DCreateInfoEmpty& params) { Load(params); }
 Texture::Texture(const Tex2DCreateInfo& params) { Load(params); }
+Texture::Texture(const Tex2DCompressedCreateInfo& params) { Load(params); }
 Texture::Texture(const Tex2DCreateInfoLoadImage& params) { Load(params); }
 
 Texture::Texture(Texture&& other) noexcept
     : id_(std::exchange(other.id_, 0)),
       bindless_handle_(std::exchange(other.bindless_handle_, 0)),
+      size_bytes_(std::exchange(other.size_bytes_, 0)),
       resident_(std::exchange(other.resident_, false)) {}
 
 Texture& Texture::operator=(Texture&& other) noexcept {
+  if (this == &other) return *this;
+  this->~Texture();
   this->id_ = std::exchange(other.id_, 0);
   this->bindless_handle_ = std::exchange(other.bindless_handle_, 0);
+  this->size_bytes_ = std::exchange(other.size_bytes_, 0);
   this->resident_ = std::exchange(other.resident_, false);
   return *this;
 }
@@ -54,6 +129,7 @@ void Texture::Load(const Tex2DCreateInfoEmpty& params) {
   ZoneScoped;
   glCreateTextures(GL_TEXTURE_2D, 1, &id_);
   glTextureStorage2D(id_, 1, params.internal_format, params.dims.x, params.dims.y);
+  size_bytes_ = TextureSizeBytes(params.internal_format, params.dims, false);
   glTextureParameteri(id_, GL_TEXTURE_WRAP_S, params.wrap_s);
   glTextureParameteri(id_, GL_TEXTURE_WRAP_T, params.wrap_t);
   glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, params.min_filter);
@@ -76,7 +152,12 @@ void Texture::Load(const Tex2DCreateInfoLoadImage& params) {
   glTextureParameteri(id_, GL_TEXTURE_WRAP_T, params.wrap_t);
   glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, params.min_filter);
   glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, params.mag_filter);
-  glTextureSubImage2D(id_, 0, 0, 0, img.width, img.height, params.format, params.type, img.data);
+  {
+    // decoded rows are tightly packed
+    const ScopedUnpackAlignment unpack_alignment{1};
+    glTextureSubImage2D(id_, 0, 0, 0, img.width, img.height, params.format, params.type,
+                        img.data);
+  }
 
   if (params.gen_mipmaps) {
     glGenerateTextureMipmap(id_);
@@ -90,18 +171,68 @@ void Texture::Load(const Tex2DCreateInfoLoadImage& params) {
 
 void Texture::Load(const Tex2DCreateInfo& params) {
   ZoneScoped;
+  const bool prebuilt_mips = !params.level_sizes.empty();
+  GLsizei num_levels = 1;
+  if (prebuilt_mips) {
+    num_levels = static_cast<GLsizei>(params.level_sizes.size());
+  } else if (params.gen_mipmaps) {
+    num_levels = GetMipLevels(params.dims.x, params.dims.y);
+  }
   glCreateTextures(GL_TEXTURE_2D, 1, &id_);
-  glTextureStorage2D(id_, params.gen_mipmaps ? GetMipLevels(params.dims.x, params.dims.y) : 1,
-                     params.internal_format, params.dims.x, params.dims.y);
+  glTextureStorage2D(id_, num_levels, params.internal_format, params.dims.x, params.dims.y);
+  size_bytes_ = TextureSizeBytes(params.internal_format, params.dims, num_levels > 1);
   glTextureParameteri(id_, GL_TEXTURE_WRAP_S, params.wrap_s);
   glTextureParameteri(id_, GL_TEXTURE_WRAP_T, params.wrap_t);
   glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, params.min_filter);
   glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, params.mag_filter);
-  glTextureSubImage2D(id_, 0, 0, 0, params.dims.x, params.dims.y, params.format, params.type,
-                      params.data);
+  glTextureParameteriv(id_, GL_TEXTURE_SWIZZLE_RGBA, &params.swizzle[0]);
+  // rows of RGB, RG and R data are tightly packed
+  const ScopedUnpackAlignment unpack_alignment{1};
+  if (prebuilt_mips) {
+    const unsigned char* level_data = params.data;
+    const auto num_data_levels =
+        static_cast<GLsizei>(params.num_data_levels.value_or(params.level_sizes.size()));
+    for (GLsizei level = 0; level < num_data_levels; level++) {
+      glTextureSubImage2D(id_, level, 0, 0, std::max(params.dims.x >> level, 1),
+                          std::max(params.dims.y >> level, 1), params.format, params.type,
+                          level_data);
+      level_data += params.level_sizes[level];
+    }
+  } else {
+    glTextureSubImage2D(id_, 0, 0, 0, params.dims.x, params.dims.y, params.format, params.type,
+                        params.data);
+    if (params.gen_mipmaps) {
+      glGenerateTextureMipmap(id_);
+    }
+  }
 
-  if (params.gen_mipmaps) {
-    glGenerateTextureMipmap(id_);
+  if (params.bindless) {
+    bindless_handle_ = glGetTextureHandleARB(id_);
+    MakeResident();
+  }
+}
+
+void Texture::Load(const Tex2DCompressedCreateInfo& params) {
+  ZoneScoped;
+  const auto num_levels = static_cast<GLsizei>(params.level_sizes.size());
+  glCreateTextures(GL_TEXTURE_2D, 1, &id_);
+  glTextureStorage2D(id_, num_levels, params.internal_format, params.dims.x, params.dims.y);
+  glTextureParameteri(id_, GL_TEXTURE_WRAP_S, params.wrap_s);
+  glTextureParameteri(id_, GL_TEXTURE_WRAP_T, params.wrap_t);
+  glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, params.min_filter);
+  glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, params.mag_filter);
+  glTextureParameteriv(id_, GL_TEXTURE_SWIZZLE_RGBA, &params.swizzle[0]);
+  const unsigned char* level_data = params.data;
+  const auto num_data_levels =
+      static_cast<GLsizei>(params.num_data_levels.value_or(params.level_sizes.size()));
+  for (GLsizei level = 0; level < num_levels; level++) {
+    size_bytes_ += params.level_sizes[level];
+    if (level >= num_data_levels) continue;
+    const auto level_size = static_cast<GLsizei>(params.level_sizes[level]);
+    glCompressedTextureSubImage2D(id_, level, 0, 0, std::max(params.dims.x >> level, 1),
+                                  std::max(params.dims.y >> level, 1), params.internal_format,
+                                  level_size, level_data);
+    level_data += level_size;
   }
 
   if (params.bindless) {
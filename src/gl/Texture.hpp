@@ -14,6 +14,28 @@ struct Tex2DCreateInfo {
   unsigned char* data;
   bool bindless{true};
   bool gen_mipmaps{true};
+  glm::ivec4 swizzle{GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  // when set, data holds every mip level tightly packed from level 0 down, and gen_mipmaps is
+  // ignored
+  std::vector<size_t> level_sizes{};
+  // levels of level_sizes that data holds, the rest are allocated and left for the caller to fill
+  std::optional<size_t> num_data_levels{};
+};
+
+struct Tex2DCompressedCreateInfo {
+  glm::ivec2 dims;
+  GLuint wrap_s;
+  GLuint wrap_t;
+  GLuint internal_format;
+  GLuint min_filter{GL_LINEAR_MIPMAP_LINEAR};
+  GLuint mag_filter{GL_LINEAR};
+  // every mip level, tightly packed from level 0 down
+  const unsigned char* data;
+  std::vector<size_t> level_sizes;
+  bool bindless{true};
+  glm::ivec4 swizzle{GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  // levels of level_sizes that data holds, the rest are allocated and left for the caller to fill
+  std::optional<size_t> num_data_levels{};
 };
 
 struct Tex2DCreateInfoLoadImage {
@@ -47,17 +69,43 @@ struct TexCubeCreateParamsEmpty {
   bool gen_mipmaps{false};
 };
 
+// Nominal size of uncompressed formats, as tightly packed client data.
+[[nodiscard]] uint32_t BytesPerTexel(GLenum internal_format);
+// Bytes per 4x4 block of BCn formats, 0 if the format isn't block compressed.
+[[nodiscard]] uint32_t BytesPerBlock(GLenum internal_format);
+// VRAM of the texture, with 8 bit 3 channel formats padded to 4 bytes per texel as drivers store
+// them.
+[[nodiscard]] size_t TextureSizeBytes(GLenum internal_format, glm::ivec2 dims, bool mipmapped);
+
+// Sets GL_UNPACK_ALIGNMENT for the scope and restores the previous value, for uploads of tightly
+// packed RGB, RG and R rows.
+class ScopedUnpackAlignment {
+ public:
+  explicit ScopedUnpackAlignment(GLint alignment) {
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previous_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+  }
+  ScopedUnpackAlignment(const ScopedUnpackAlignment& other) = delete;
+  ScopedUnpackAlignment& operator=(const ScopedUnpackAlignment& other) = delete;
+  ~ScopedUnpackAlignment() { glPixelStorei(GL_UNPACK_ALIGNMENT, previous_); }
+
+ private:
+  GLint previous_{4};
+};
+
 class Texture {
  public:
   Texture() = default;
   void Load(const Tex2DCreateInfoEmpty& params);
   void Load(const TexCubeCreateParamsEmpty& params);
   void Load(const Tex2DCreateInfo& params);
+  void Load(const Tex2DCompressedCreateInfo& params);
   void Load(const Tex2DCreateInfoLoadImage& params);
   explicit Texture(const Tex2DCreateInfoEmpty& params);
   explicit Texture(const TexCubeCreateParamsEmpty& params);
   explicit Texture(const Tex2DCreateInfoLoadImage& params);
   explicit Texture(const Tex2DCreateInfo& params);
+  explicit Texture(const Tex2DCompressedCreateInfo& params);
   Texture(const Texture& other) = delete;
   Texture operator=(const Texture& other) = delete;
   Texture(Texture&& other) noexcept;
@@ -65,6 +113,9 @@ class Texture {
   ~Texture();
   [[nodiscard]] uint32_t Id() const { return id_; }
   [[nodiscard]] uint64_t BindlessHandle() const { return bindless_handle_; }
+  [[nodiscard]] bool IsResident() const { return resident_; }
+  // VRAM of the texture's levels, 0 for textures created by the cube and image loaders
+  [[nodiscard]] size_t SizeBytes() const { return size_bytes_; }
   void MakeNonResident();
   void MakeResident();
 
@@ -73,7 +124,8 @@ class Texture {
 
  private:
   uint32_t id_{0};
-  uint32_t bindless_handle_{0};
+  uint64_t bindless_handle_{0};
+  size_t size_bytes_{0};
   bool resident_{false};
 };
 
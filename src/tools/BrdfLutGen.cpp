@@ -0,0 +1,36 @@
+// Generates the BRDF LUT blob pbr_render loads with the analytic fit of it, run by the build.
+//
+// usage: brdf_lut_gen <output>
+
+#include "BrdfLut.hpp"
+#include "IblBaker.hpp"
+#include "IblParams.hpp"
+#include "pch.hpp"
+#include "util/ThreadPool.hpp"
+#include "util/Timer.hpp"
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    spdlog::error("usage: {} <output>", argv[0]);
+    return 1;
+  }
+  ThreadPool::Init();
+  Timer timer;
+  brdf_lut::Lut lut{.map = ibl_baker::BrdfLut()};
+  spdlog::info("generated {}x{} brdf lut in {:.1f} ms", lut.map.dims.x, lut.map.dims.y,
+               timer.ElapsedMS());
+  ThreadPool::Shutdown();
+
+  timer.Reset();
+  const glm::vec2 initial_error = brdf_lut::FitError(lut.fit, lut.map);
+  lut.fit = brdf_lut::FitAnalytic(lut.map);
+  const glm::vec2 fit_error = brdf_lut::FitError(lut.fit, lut.map);
+  spdlog::info("analytic fit in {:.1f} ms: rmse {:.4f} max {:.4f}, published coefficients rmse "
+               "{:.4f} max {:.4f}",
+               timer.ElapsedMS(), fit_error.x, fit_error.y, initial_error.x, initial_error.y);
+  if (!brdf_lut::Write(argv[1], lut)) {
+    spdlog::error("failed to write {}", argv[1]);
+    return 1;
+  }
+  return 0;
+}
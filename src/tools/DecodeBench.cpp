@@ -0,0 +1,102 @@
+// Measures the decode throughput of each image decoder backend over the JPEG and PNG files in a
+// directory, decoding each file the given number of times on one thread.
+//
+// usage: decode_bench <directory> [iterations=5] [channels=4]
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+#include "ImageDecoder.hpp"
+#include "pch.hpp"
+#include "util/Timer.hpp"
+
+namespace {
+
+struct EncodedFile {
+  std::filesystem::path path;
+  ImageContainer container;
+  std::vector<uint8_t> bytes;
+};
+
+std::vector<EncodedFile> LoadFiles(const std::filesystem::path& directory) {
+  std::vector<EncodedFile> files;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+    if (!entry.is_regular_file()) continue;
+    std::ifstream file(entry.path(), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) continue;
+    std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    const ImageContainer container = SniffImageContainer(bytes);
+    if (!file || container == ImageContainer::kUnknown) continue;
+    files.push_back(
+        EncodedFile{.path = entry.path(), .container = container, .bytes = std::move(bytes)});
+  }
+  return files;
+}
+
+const char* ContainerName(ImageContainer container) {
+  switch (container) {
+    case ImageContainer::kJpeg:
+      return "JPEG";
+    case ImageContainer::kPng:
+      return "PNG";
+    case ImageContainer::kUnknown:
+      break;
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    spdlog::error("usage: {} <directory> [iterations=5] [channels=4]", argv[0]);
+    return 1;
+  }
+  const int iterations = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 5;
+  const int channels = argc > 3 ? std::clamp(std::atoi(argv[3]), 0, 4) : 4;
+  const std::vector<EncodedFile> files = LoadFiles(argv[1]);
+  if (files.empty()) {
+    spdlog::error("no JPEG or PNG files in {}", argv[1]);
+    return 1;
+  }
+  spdlog::info("{} files, {} iterations, {} channels requested", files.size(), iterations,
+               channels);
+
+  constexpr double kBytesToMiB = 1.0 / (1024.0 * 1024.0);
+  for (const ImageContainer container : {ImageContainer::kJpeg, ImageContainer::kPng}) {
+    for (const std::unique_ptr<ImageDecoder>& decoder : image_decoder::Decoders()) {
+      if (!decoder->Supports(container)) continue;
+      size_t encoded_bytes = 0;
+      size_t decoded_bytes = 0;
+      size_t num_files = 0;
+      size_t num_declined = 0;
+      double seconds = 0;
+      for (const EncodedFile& file : files) {
+        if (file.container != container) continue;
+        for (int i = 0; i < iterations; i++) {
+          Image image;
+          Timer timer;
+          const bool decoded = decoder->Decode(file.bytes, channels, false, image);
+          const double elapsed = timer.ElapsedSeconds();
+          if (!decoded) {
+            num_declined++;
+            break;
+          }
+          seconds += elapsed;
+          encoded_bytes += file.bytes.size();
+          decoded_bytes += static_cast<size_t>(image.width) * image.height * image.channels;
+        }
+        num_files++;
+      }
+      if (num_files == 0) continue;
+      seconds = std::max(seconds, 1e-9);
+      spdlog::info("{:>5} {:<14} {:4} files ({} declined): {:8.1f} MiB/s in, {:8.1f} MiB/s out",
+                   ContainerName(container), decoder->Name(), num_files, num_declined,
+                   encoded_bytes * kBytesToMiB / seconds, decoded_bytes * kBytesToMiB / seconds);
+    }
+  }
+  return 0;
+}
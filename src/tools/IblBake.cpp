@@ -0,0 +1,163 @@
+// Bakes an environment's IBL maps on the CPU into the IBL cache, where pbr_render loads them
+// instead of baking on the GPU. --compare reports the difference to the entry a GPU bake left in
+// the cache instead of replacing it. --bench repeats the bake and reports the throughput of each
+// stage.
+//
+// usage: ibl_bake <hdr or exr> [--compare] [--bench iterations]
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+
+#include "HalfFloat.hpp"
+#include "HdrImage.hpp"
+#include "IblBaker.hpp"
+#include "IblParams.hpp"
+#include "pch.hpp"
+#include "util/ThreadPool.hpp"
+#include "util/Timer.hpp"
+
+namespace {
+
+struct StageTimes {
+  double env_cube{};
+  double irradiance_sh{};
+  double prefilter{};
+};
+
+BakedEnvironment Bake(const HalfImage& equirect, StageTimes& times) {
+  BakedEnvironment baked;
+  Timer timer;
+  const ibl_baker::CubeMap env = ibl_baker::EquirectToCube(equirect);
+  baked.env_cube = ibl_baker::ToIblMap(env, 1);
+  times.env_cube = timer.ElapsedSeconds();
+  timer.Reset();
+  baked.irradiance_sh = sh::ProjectIrradiance(equirect);
+  times.irradiance_sh = timer.ElapsedSeconds();
+  timer.Reset();
+  baked.prefilter = ibl_baker::ToIblMap(ibl_baker::Prefilter(env), ibl::kPrefilterMipLevels);
+  times.prefilter = timer.ElapsedSeconds();
+  return baked;
+}
+
+void Benchmark(const HalfImage& equirect, int iterations) {
+  StageTimes best{1e9, 1e9, 1e9};
+  for (int i = 0; i < iterations; i++) {
+    StageTimes times;
+    (void)Bake(equirect, times);
+    best.env_cube = std::min(best.env_cube, times.env_cube);
+    best.irradiance_sh = std::min(best.irradiance_sh, times.irradiance_sh);
+    best.prefilter = std::min(best.prefilter, times.prefilter);
+  }
+  // texels written, including the env cube's mip chain, and GGX samples taken
+  double env_texels = 0;
+  for (int size = ibl::kEnvCubeDims.x; size >= 1; size /= 2) env_texels += 6.0 * size * size;
+  double prefilter_samples = 0;
+  for (uint32_t mip = 0; mip < ibl::kPrefilterMipLevels; mip++) {
+    const double size = std::max(ibl::kPrefilterDims.x >> mip, 1);
+    prefilter_samples += 6.0 * size * size * ibl::kPrefilterSampleCounts[mip];
+  }
+  const double equirect_texels = static_cast<double>(equirect.width) * equirect.height;
+  spdlog::info("best of {} on {} threads", iterations,
+               ThreadPool::Get().thread_pool.get_thread_count());
+  spdlog::info("env cube      {:9.2f} ms {:9.1f} Mtexel/s", best.env_cube * 1e3,
+               env_texels / best.env_cube * 1e-6);
+  spdlog::info("irradiance sh {:9.2f} ms {:9.1f} Mtexel/s", best.irradiance_sh * 1e3,
+               equirect_texels / best.irradiance_sh * 1e-6);
+  spdlog::info("prefilter     {:9.2f} ms {:9.1f} Msample/s", best.prefilter * 1e3,
+               prefilter_samples / best.prefilter * 1e-6);
+}
+
+std::vector<float> LevelToFloats(const IblMap& map, size_t level) {
+  const std::vector<uint8_t>& data = map.levels[level];
+  std::vector<float> values(data.size() / sizeof(uint16_t));
+  const auto* src = reinterpret_cast<const uint16_t*>(data.data());
+  half::ToFloats(src, values.data(), values.size());
+  return values;
+}
+
+// Errors relative to the reference's mean, so environments of any brightness compare alike.
+void ReportDifference(std::string_view name, std::span<const float> values,
+                      std::span<const float> reference) {
+  double squared_error = 0;
+  double max_error = 0;
+  double reference_sum = 0;
+  for (size_t i = 0; i < values.size(); i++) {
+    const double error = std::abs(static_cast<double>(values[i]) - reference[i]);
+    squared_error += error * error;
+    max_error = std::max(max_error, error);
+    reference_sum += std::abs(reference[i]);
+  }
+  const double mean = std::max(reference_sum / static_cast<double>(values.size()), 1e-9);
+  const double rmse = std::sqrt(squared_error / static_cast<double>(values.size()));
+  spdlog::info("{:<16} rmse {:10.4g} ({:6.2f}% of mean)  max {:10.4g}", name, rmse,
+               100.0 * rmse / mean, max_error);
+}
+
+bool Compare(const BakedEnvironment& cpu, size_t key) {
+  const std::optional<BakedEnvironment> gpu = ibl_cache::LoadEnvironment(key);
+  if (!gpu) {
+    spdlog::error("no GPU bake of this environment in the cache, run pbr_render with it first");
+    return false;
+  }
+  ReportDifference("env cube", LevelToFloats(cpu.env_cube, 0),
+                   LevelToFloats(gpu->env_cube, 0));
+  const auto& cpu_sh = cpu.irradiance_sh.coeffs;
+  const auto& gpu_sh = gpu->irradiance_sh.coeffs;
+  ReportDifference("irradiance sh", {&cpu_sh[0].x, cpu_sh.size() * 3},
+                   {&gpu_sh[0].x, gpu_sh.size() * 3});
+  for (uint32_t mip = 0; mip < ibl::kPrefilterMipLevels; mip++) {
+    ReportDifference(fmt::format("prefilter mip {}", mip),
+                     LevelToFloats(cpu.prefilter, mip),
+                     LevelToFloats(gpu->prefilter, mip));
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    spdlog::error("usage: {} <hdr or exr> [--compare] [--bench iterations]", argv[0]);
+    return 1;
+  }
+  const std::string path = argv[1];
+  bool compare = false;
+  int bench_iterations = 0;
+  for (int i = 2; i < argc; i++) {
+    if (std::strcmp(argv[i], "--compare") == 0) {
+      compare = true;
+    } else if (std::strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+      bench_iterations = std::max(std::atoi(argv[++i]), 1);
+    } else {
+      spdlog::error("unknown argument {}", argv[i]);
+      return 1;
+    }
+  }
+
+  ThreadPool::Init();
+  const std::optional<size_t> hdr_hash = ibl_cache::HashFile(path);
+  std::optional<HalfImage> equirect = hdr::LoadHalf(path, true);
+  if (!hdr_hash || !equirect) {
+    spdlog::error("failed to load {}", path);
+    return 1;
+  }
+  const size_t key = ibl_cache::EnvironmentKey(hdr_hash.value());
+
+  if (bench_iterations > 0) Benchmark(*equirect, bench_iterations);
+  StageTimes times;
+  const BakedEnvironment baked = Bake(*equirect, times);
+  spdlog::info("baked {} in {:.1f} ms", path,
+               (times.env_cube + times.irradiance_sh + times.prefilter) * 1e3);
+
+  int result = 0;
+  if (compare) {
+    result = Compare(baked, key) ? 0 : 1;
+  } else {
+    ibl_cache::StoreEnvironment(key, baked);
+    spdlog::info("wrote cache entry {:016x}", key);
+  }
+  ThreadPool::Shutdown();
+  return result;
+}
@@ -59,6 +59,16 @@ struct alignas(16) Material {
   uint32_t material_flags{};
 };
 
+// How a material samples a texture, which decides the channels it needs to keep on the GPU.
+enum class TextureRole : uint8_t {
+  kBaseColor,
+  kEmissive,
+  kMetallicRoughness,
+  kOcclusionRoughnessMetallic,
+  kOcclusion,
+  kNormal,
+};
+
 enum class AlphaMode {
   kOpaque,
   kBlend,
@@ -97,11 +107,24 @@ struct CameraData {
   glm::vec3 view_pos;
 };
 
+// The image and role a model's texture was cooked from, so it can be cooked again when the
+// texture quality tier changes.
+struct TextureSource {
+  AssetHandle handle;
+  size_t image_idx;
+  TextureRole role;
+  // size of the image before the quality tier's skipped levels
+  glm::ivec2 dims;
+  int skipped_levels;
+};
+
 struct Model {
+  std::string path;
   // TODO: handle multiple scenes
   std::vector<size_t> scene_0_nodes;
   std::vector<CameraData> camera_data;
   std::vector<AssetHandle> texture_handles;
+  std::vector<TextureSource> texture_sources;
   std::vector<AssetHandle> material_handles;
   std::vector<SceneNode> nodes;
   std::vector<Mesh> meshes;
@@ -114,7 +137,8 @@ struct LightsInfo {
 
 struct PointLight {
   glm::vec3 position;
-  float _pad1;
+  // distance the light is culled at, derived from the intensity by LightManager
+  float radius;
   glm::vec3 color;
   float intensity;
 };
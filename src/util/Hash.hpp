@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+namespace util {
+
+inline size_t HashBytes(const void* data, size_t size_bytes) {
+  return std::hash<std::string_view>{}(
+      std::string_view(static_cast<const char*>(data), size_bytes));
+}
+
+// FNV-1a over 8 byte words with a final mix, unrelated to HashBytes so the two don't collide
+// together.
+inline size_t HashBytesCheck(const void* data, size_t size_bytes) {
+  constexpr uint64_t kPrime = 0x100000001b3;
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = 0xcbf29ce484222325;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size_bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * kPrime;
+    hash ^= hash >> 32;
+  }
+  for (; i < size_bytes; i++) hash = (hash ^ bytes[i]) * kPrime;
+  return static_cast<size_t>(hash ^ size_bytes);
+}
+
+// boost::hash_combine
+inline void HashCombine(size_t& seed, size_t value) {
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// Identifies content by two independent hashes, so a collision of one alone doesn't make
+// different contents equal.
+struct ContentKey {
+  size_t hash{};
+  size_t check{};
+  bool operator==(const ContentKey& other) const = default;
+};
+
+struct ContentKeyHash {
+  size_t operator()(const ContentKey& key) const { return key.hash; }
+};
+
+inline ContentKey HashContent(const void* data, size_t size_bytes) {
+  return {.hash = HashBytes(data, size_bytes), .check = HashBytesCheck(data, size_bytes)};
+}
+
+inline void HashCombine(ContentKey& key, size_t value) {
+  HashCombine(key.hash, value);
+  HashCombine(key.check, value);
+}
+
+}  // namespace util
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace util {
+
+// Runs fn(begin, end) over blocks of [0, count) of at most block_size, and returns once every
+// block is done. The caller takes blocks alongside the pool's threads, so it finishes even when
+// called from a pool task while every other thread is busy.
+template <typename F>
+void ParallelFor(BS::thread_pool& pool, size_t count, size_t block_size, const F& fn) {
+  const size_t num_blocks = (count + block_size - 1) / block_size;
+  if (num_blocks <= 1) {
+    if (count) fn(size_t{0}, count);
+    return;
+  }
+  // helpers that start after every block is taken find nothing to do, but still need the state
+  struct Blocks {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+  };
+  auto blocks = std::make_shared<Blocks>();
+  const auto run_blocks = [blocks, &fn, count, block_size, num_blocks]() {
+    for (size_t block = blocks->next++; block < num_blocks; block = blocks->next++) {
+      const size_t begin = block * block_size;
+      fn(begin, std::min(begin + block_size, count));
+      blocks->done.fetch_add(1, std::memory_order_release);
+    }
+  };
+  const size_t num_helpers = std::min<size_t>(pool.get_thread_count(), num_blocks - 1);
+  for (size_t i = 0; i < num_helpers; i++) pool.detach_task(run_blocks);
+  run_blocks();
+  while (blocks->done.load(std::memory_order_acquire) < num_blocks) std::this_thread::yield();
+}
+
+}  // namespace util